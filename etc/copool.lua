@@ -0,0 +1,41 @@
+-- run requests each in a new coroutine, then reusing a few with
+-- coroutine.recycle; dead threads are pooled, so times should be close
+
+
+local N = tonumber(arg and arg[1]) or 1000000
+local format = string.format
+local create, resume, yield = coroutine.create, coroutine.resume,
+                              coroutine.yield
+local recycle = coroutine.recycle
+
+
+local function handler (req)
+  local parts = {}
+  for i = 1, 3 do parts[i] = yield(req + i) end
+  return #parts
+end
+
+
+local function serve (getco)
+  collectgarbage()
+  local t0 = os.clock()
+  for i = 1, N do
+    local co = getco(i)
+    local _, v = resume(co, i)
+    while coroutine.status(co) == "suspended" do _, v = resume(co, v) end
+    assert(v == 3)
+  end
+  return os.clock() - t0
+end
+
+
+local tnew = serve(function () return create(handler) end)
+print(format("%d requests  new coroutines %.3fs", N, tnew))
+if recycle then
+  local pool = {}
+  for i = 1, 16 do pool[i] = create(handler) end
+  local trec = serve(function (i)
+    return recycle(pool[i % 16 + 1], handler)
+  end)
+  print(format("%d requests  recycled      %.3fs", N, trec))
+end
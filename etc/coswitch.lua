@@ -0,0 +1,33 @@
+-- switch to and from a coroutine, yielding from Lua code and from
+-- inside a pcall; the first case avoids the long jump only when Lua
+-- is built with LUAI_STACKLESSYIELD (see 'lua_yieldk' in ldo.c)
+
+
+local N = tonumber(arg and arg[1]) or 1000000
+local format = string.format
+local yield = coroutine.yield
+
+
+local function time (name, co)
+  local t0 = os.clock()
+  local v = 0
+  for i = 1, N do v = co(i) end
+  local t = os.clock() - t0
+  assert(v == N)
+  print(format("%-10s %.3fs  %10.0f switches/s", name, t, 2 * N / t))
+end
+
+
+time("wrap", coroutine.wrap(function (x)
+  while true do x = yield(x) end
+end))
+
+local co = coroutine.create(function (x)
+  while true do x = yield(x) end
+end)
+local resume = coroutine.resume
+time("resume", function (x) return select(2, resume(co, x)) end)
+
+time("pcall", coroutine.wrap(function (x)
+  while true do x = select(2, pcall(yield, x)) end
+end))
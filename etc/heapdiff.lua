@@ -0,0 +1,222 @@
+-- summarize a heap snapshot (from debug.heapsnapshot), with the
+-- objects that retain most memory, or list the objects in a second
+-- snapshot that are not in the first (both must come from the same
+-- state, whose ids name the same objects in all its snapshots)
+
+
+local function usage ()
+  io.stderr:write("usage: lua heapdiff.lua [-n count] snapshot [newsnapshot]\n")
+  os.exit(1)
+end
+
+
+-- read a snapshot; returns a map from ids to nodes, with fields
+-- 'type', 'size', 'label' and 'refs' (a list of {id, name})
+local function readsnapshot (fname)
+  local f = assert(io.open(fname, "rb"))
+  local nodes = {}
+  local n = 0
+  for line in f:lines() do
+    n = n + 1
+    local id = line:match('^{"id":"([^"]*)"')
+    if not id then
+      error(string.format("%s:%d: bad snapshot line", fname, n))
+    end
+    local node = {
+      type = line:match('"type":"([^"]*)"'),
+      size = tonumber(line:match('"size":(%d+)')) or 0,
+      label = line:match('"value":"([^"]*)"') or
+              line:match('"source":"([^"]*)"'),
+      refs = {},
+    }
+    local weak = line:match('"weak":"([^"]*)"') or ""
+    local weakk, weakv = weak:find("k"), weak:find("v")
+    local refs = line:sub((line:find('"refs":[', 1, true)))
+    for rid, name in refs:gmatch('%["([^"]*)","([^"]*)"%]') do
+      local iskey = (name == "(key)")
+      -- (weak tables keep their metatables and the keys of their shapes
+      -- alive, but the snapshot does not tell shape keys apart)
+      if not ((iskey and weakk) or
+              (not iskey and name ~= "(metatable)" and weakv)) then
+        node.refs[#node.refs + 1] = {rid, name}
+      end
+    end
+    nodes[id] = node
+  end
+  f:close()
+  assert(nodes.root, "snapshot without a root")
+  return nodes
+end
+
+
+-- depth-first search from the root; returns the nodes in reverse
+-- postorder, and sets 'po' (postorder number), 'via' (name of the edge
+-- that reached the node) and 'preds' (predecessors) in each node
+local function search (nodes)
+  local post = {}
+  local root = nodes.root
+  root.via = ""
+  local stack = {{root, 1}}
+  local visited = {[root] = true}
+  while #stack > 0 do
+    local top = stack[#stack]
+    local node, i = top[1], top[2]
+    local ref = node.refs[i]
+    if ref then
+      top[2] = i + 1
+      local child = nodes[ref[1]]
+      if child then
+        child.preds = child.preds or {}
+        child.preds[#child.preds + 1] = node
+        if not visited[child] then
+          visited[child] = true
+          child.via = ref[2]
+          stack[#stack + 1] = {child, 1}
+        end
+      end
+    else
+      stack[#stack] = nil
+      post[#post + 1] = node
+      node.po = #post
+    end
+  end
+  local rpo = {}
+  for i = #post, 1, -1 do rpo[#rpo + 1] = post[i] end
+  return rpo
+end
+
+
+-- immediate dominators, with the iterative algorithm by Cooper, Harvey
+-- and Kennedy ("A Simple, Fast Dominance Algorithm")
+local function dominators (rpo)
+  local root = rpo[1]
+  root.idom = root
+  local function intersect (a, b)
+    while a ~= b do
+      while a.po < b.po do a = a.idom end
+      while b.po < a.po do b = b.idom end
+    end
+    return a
+  end
+  local changed = true
+  while changed do
+    changed = false
+    for i = 2, #rpo do
+      local node = rpo[i]
+      local new
+      for _, p in ipairs(node.preds) do
+        if p.idom then
+          new = new and intersect(p, new) or p
+        end
+      end
+      if node.idom ~= new then
+        node.idom = new
+        changed = true
+      end
+    end
+  end
+end
+
+
+-- compute 'retained' for all nodes reachable from the root; returns
+-- the number of unreachable objects and their total size
+local function retained (nodes)
+  local rpo = search(nodes)
+  dominators(rpo)
+  for i = #rpo, 1, -1 do  -- children before their dominators
+    local node = rpo[i]
+    node.retained = (node.retained or 0) + node.size
+    if i > 1 then
+      node.idom.retained = (node.idom.retained or 0) + node.retained
+    end
+  end
+  local count, size = 0, 0
+  for _, node in pairs(nodes) do
+    if not node.po then count = count + 1; size = size + node.size end
+  end
+  return count, size
+end
+
+
+local function describe (id, node)
+  local label = node.label and string.format(" %q", node.label) or ""
+  return string.format("%-10s %-18s%s (via %s)", node.type, id, label,
+                       node.via or "?")
+end
+
+
+local function printtop (nodes, n, filter)
+  local list = {}
+  for id, node in pairs(nodes) do
+    if id ~= "root" and node.retained and (not filter or filter(id)) then
+      list[#list + 1] = id
+    end
+  end
+  table.sort(list, function (a, b)
+    return nodes[a].retained > nodes[b].retained
+  end)
+  print(string.format("%12s %12s  object", "retained", "size"))
+  for i = 1, math.min(n, #list) do
+    local node = nodes[list[i]]
+    print(string.format("%12d %12d  %s", node.retained, node.size,
+                        describe(list[i], node)))
+  end
+end
+
+
+-- count and size per type of the nodes accepted by 'filter'
+local function printtypes (nodes, filter)
+  local count, size, types = {}, {}, {}
+  local total = 0
+  for id, node in pairs(nodes) do
+    local t = node.type
+    if id ~= "root" and (not filter or filter(id)) then
+      if not count[t] then types[#types + 1] = t; count[t] = 0; size[t] = 0 end
+      count[t] = count[t] + 1
+      size[t] = size[t] + node.size
+      total = total + node.size
+    end
+  end
+  table.sort(types, function (a, b) return size[a] > size[b] end)
+  print(string.format("%-10s %10s %12s", "type", "count", "bytes"))
+  for _, t in ipairs(types) do
+    print(string.format("%-10s %10d %12d", t, count[t], size[t]))
+  end
+  print(string.format("%-10s %10s %12d", "total", "", total))
+end
+
+
+local top = 20
+local files = {}
+do
+  local i = 1
+  while arg[i] do
+    if arg[i] == "-n" then
+      top = tonumber(arg[i + 1]) or usage()
+      i = i + 2
+    else
+      files[#files + 1] = arg[i]
+      i = i + 1
+    end
+  end
+end
+if #files < 1 or #files > 2 then usage() end
+
+local nodes = readsnapshot(files[1])
+if #files == 1 then
+  local ucount, usize = retained(nodes)
+  printtypes(nodes)
+  print(string.format("unreachable: %d objects, %d bytes", ucount, usize))
+  print()
+  printtop(nodes, top)
+else
+  local new = readsnapshot(files[2])
+  retained(new)
+  local function isnew (id)
+    return not nodes[id] or nodes[id].type ~= new[id].type
+  end
+  print("new objects:")
+  printtypes(new, isnew)
+  print()
+  printtop(new, top, isnew)
+end
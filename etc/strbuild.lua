@@ -0,0 +1,61 @@
+-- build a long string with '..' and with table.concat; both
+-- should grow linearly with the count (see 'luaS_extend')
+
+
+local N = tonumber(arg and arg[1]) or 20000
+local format = string.format
+
+local items = {}
+for i = 1, 100 do
+  items[i] = {name = "item" .. i, price = i * 1.25, tags = {"a", "b", "c"}}
+end
+
+
+local function render (emit)
+  for i = 1, N do
+    local item = items[i % #items + 1]
+    emit("<li class=\"item\">")
+    emit(item.name)
+    emit("<span>")
+    emit(format("%.2f", item.price))
+    emit("</span>")
+    for _, tag in ipairs(item.tags) do
+      emit(" #" .. tag)
+    end
+    emit("</li>\n")
+  end
+end
+
+
+local function withconcat ()
+  local s = ""
+  render(function (piece) s = s .. piece end)
+  return s
+end
+
+
+local function withtable ()
+  local t = {}
+  render(function (piece) t[#t + 1] = piece end)
+  return table.concat(t)
+end
+
+
+local function time (f)
+  collectgarbage()
+  local t0 = os.clock()
+  local s = f()
+  return os.clock() - t0, s
+end
+
+
+local n = N
+for _ = 1, 3 do
+  N = n
+  local t1, s1 = time(withconcat)
+  local t2, s2 = time(withtable)
+  assert(s1 == s2)
+  print(format("%8d pieces %10d bytes  '..' %.3fs  table.concat %.3fs",
+               N * 8, #s1, t1, t2))
+  n = n * 2
+end
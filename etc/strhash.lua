@@ -0,0 +1,51 @@
+-- time creating and indexing with several kinds of keys;
+-- compare builds with different LUAI_STRHASH (see lstring.c)
+
+
+local N = tonumber(arg and arg[1]) or 100000
+local rep, format = string.rep, string.format
+
+
+local sets = {
+  {"identifiers", function (i)
+    return format("%s_%s%d", ({"get", "set", "on", "is", "make"})[i % 5 + 1],
+                  ({"value", "name", "item", "node", "count"})[i % 7 % 5 + 1], i)
+  end},
+  {"numbers", function (i) return tostring(i * 7919) end},
+  {"record keys", function (i) return format("user:%d:session", i) end},
+  {"paths", function (i)
+    return format("/usr/local/share/app/resources/images/icons/%08d.png", i)
+  end},
+  {"urls", function (i)
+    return format("https://example.com/api/v2/items/%d?fields=id,name,price", i)
+  end},
+  {"uuids", function (i)
+    return format("%08x-%04x-4%03x-a%03x-%012x", i * 2654435761 % 2^32,
+                  i % 65536, i % 4096, i * 7 % 4096, i * 40503)
+  end},
+}
+
+
+print(format("%-12s %7s %10s %10s", "keys", "length", "create(s)",
+             "index(s)"))
+for _, set in ipairs(sets) do
+  local name, gen = set[1], set[2]
+  local keys, len = {}, 0
+  for i = 1, N do
+    local k = gen(i)
+    keys[i] = k
+    len = len + #k
+  end
+  collectgarbage()
+  local t0 = os.clock()
+  for i = 1, N do rep(keys[i], 1) end    -- hash + lookup
+  local t1 = os.clock()
+  local t = {}
+  for i = 1, N do t[keys[i]] = i end
+  for r = 1, 4 do
+    for i = 1, N do assert(t[keys[i]] == i) end
+  end
+  local t2 = os.clock()
+  print(format("%-12s %7.1f %10.3f %10.3f", name, len / N,
+               t1 - t0, t2 - t1))
+end
@@ -425,6 +425,12 @@ LUA_API const char *lua_tolstring(lua_State *L, int idx, size_t *len)
 		o = index2addr(L, idx); /* previous call may reallocate the stack */
 		lua_unlock(L);
 	}
+	else if (isbuffstr(tsvalue(o)))
+	{ /* its bytes will be used as a C string */
+		lua_lock(L);
+		luaS_sealbuff(L, tsvalue(o));
+		lua_unlock(L);
+	}
 	if (len != NULL)
 		*len = vslen(o);
 	return svalue(o);
@@ -570,6 +576,21 @@ LUA_API const char *lua_pushstring(lua_State *L, const char *s)
 	return s;
 }
 
+LUA_API const char *lua_pushexternalstring(lua_State *L, const char *s,
+										   size_t len, lua_FreeF freef,
+										   void *ud)
+{
+	TString *ts;
+	lua_lock(L);
+	api_check(L, s[len] == '\0', "string not ending with a zero");
+	ts = luaS_newextstr(L, s, len, freef, ud);
+	setsvalue2s(L, L->top, ts);
+	api_incr_top(L);
+	luaC_checkGC(L);
+	lua_unlock(L);
+	return getstr(ts);
+}
+
 LUA_API const char *lua_pushvfstring(lua_State *L, const char *fmt,
 									 va_list argp)
 {
@@ -1223,8 +1244,8 @@ LUA_API int lua_gc(lua_State *L, int what, int data)
 			luaC_checkGC(L);
 		}
 		g->gcrunning = oldrunning;				/* restore previous state */
-		if (debt > 0 && g->gcstate == GCSpause) /* end of cycle? */
-			res = 1;							/* signal it */
+		if (debt > 0 && (g->gcstate == GCSpause || isgenerational(g)))
+			res = 1; /* end of cycle (each generational step is one): signal it */
 		break;
 	}
 	case LUA_GCSETPAUSE:
@@ -1246,6 +1267,65 @@ LUA_API int lua_gc(lua_State *L, int what, int data)
 		res = g->gcrunning;
 		break;
 	}
+	case LUA_GCGEN:
+	case LUA_GCINC:
+	{
+		res = isgenerational(g) ? LUA_GCGEN : LUA_GCINC; /* previous mode */
+		luaC_changemode(L, (what == LUA_GCGEN) ? KGC_GEN : KGC_NORMAL);
+		break;
+	}
+	case LUA_GCSETMINORMUL:
+	{
+		res = g->genminormul;
+		if (data < 1)
+			data = 1; /* avoid a minor collection at each allocation */
+		g->genminormul = data;
+		break;
+	}
+	case LUA_GCSETMAJORMUL:
+	{
+		res = g->genmajormul;
+		g->genmajormul = data;
+		break;
+	}
+	case LUA_GCBGFREE:
+	{
+		res = luaC_bgfree(L, data);
+		break;
+	}
+	case LUA_GCSETSTEPTIME:
+	{
+		res = g->gcsteptime;
+		g->gcsteptime = (data > 0) ? data : 0;
+		break;
+	}
+	case LUA_GCSETMAXPAUSE:
+	{
+		res = g->gcmaxpause;
+		g->gcmaxpause = (data > 0) ? data : 0;
+		break;
+	}
+	case LUA_GCMEMRATE:
+	{
+		res = luaM_setmemrate(L, data);
+		break;
+	}
+	case LUA_GCSETSOFTLIMIT:
+	case LUA_GCSETHARDLIMIT:
+	{
+		lu_mem *limit = (what == LUA_GCSETSOFTLIMIT) ? &g->memsoft : &g->memhard;
+		res = cast_int(*limit >> 10);
+		*limit = (data > 0) ? cast(lu_mem, data) << 10 : 0;
+		luaE_setmemcheck(g);
+		break;
+	}
+	case LUA_GCPARALLEL:
+	{
+		res = g->gcthreads;
+		g->gcthreads = (data < 1) ? 1 :
+		               (data > LUAI_GCMAXTHREADS) ? LUAI_GCMAXTHREADS : data;
+		break;
+	}
 	default:
 		res = -1; /* invalid option */
 	}
@@ -1253,6 +1333,70 @@ LUA_API int lua_gc(lua_State *L, int what, int data)
 	return res;
 }
 
+LUA_API void lua_gcstats(lua_State *L, lua_GCStats *s)
+{
+	lua_lock(L);
+	*s = G(L)->gcstats;
+	lua_unlock(L);
+}
+
+LUA_API lua_GCPhaseF lua_getgcphasef(lua_State *L, void **ud)
+{
+	lua_GCPhaseF f;
+	lua_lock(L);
+	if (ud)
+		*ud = G(L)->gcphaseud;
+	f = G(L)->gcphasef;
+	lua_unlock(L);
+	return f;
+}
+
+LUA_API void lua_setgcphasef(lua_State *L, lua_GCPhaseF f, void *ud)
+{
+	lua_lock(L);
+	G(L)->gcphaseud = ud;
+	G(L)->gcphasef = f;
+	lua_unlock(L);
+}
+
+LUA_API lua_MemLimitF lua_getmemlimitf(lua_State *L, void **ud)
+{
+	lua_MemLimitF f;
+	lua_lock(L);
+	if (ud)
+		*ud = G(L)->memlimitud;
+	f = G(L)->memlimitf;
+	lua_unlock(L);
+	return f;
+}
+
+LUA_API void lua_setmemlimitf(lua_State *L, lua_MemLimitF f, void *ud)
+{
+	lua_lock(L);
+	G(L)->memlimitud = ud;
+	G(L)->memlimitf = f;
+	lua_unlock(L);
+}
+
+LUA_API int lua_memdump(lua_State *L, lua_Writer writer, void *data)
+{
+	int status;
+	lua_lock(L);
+	status = luaM_memdump(L, writer, data);
+	lua_unlock(L);
+	return status;
+}
+
+
+LUA_API int lua_heapsnapshot(lua_State *L, lua_Writer writer, void *data)
+{
+	int status;
+	lua_lock(L);
+	status = luaC_snapshot(L, writer, data);
+	lua_unlock(L);
+	return status;
+}
+
 /*
 ** miscellaneous functions
 */
@@ -1312,6 +1456,24 @@ LUA_API void lua_len(lua_State *L, int idx)
 	lua_unlock(L);
 }
 
+LUA_API const char *lua_pinstring(lua_State *L, const char *s)
+{
+	TString *ts;
+	lua_lock(L);
+	ts = luaS_pin(L, s);
+	luaC_checkGC(L);
+	lua_unlock(L);
+	return getstr(ts);
+}
+
+LUA_API void lua_strcachestats(lua_State *L, size_t *hits, size_t *misses)
+{
+	lua_lock(L);
+	*hits = G(L)->strcachehits;
+	*misses = G(L)->strcachemisses;
+	lua_unlock(L);
+}
+
 LUA_API lua_Alloc lua_getallocf(lua_State *L, void **ud)
 {
 	lua_Alloc f;
@@ -1325,9 +1487,12 @@ LUA_API lua_Alloc lua_getallocf(lua_State *L, void **ud)
 
 LUA_API void lua_setallocf(lua_State *L, lua_Alloc f, void *ud)
 {
+	int bg;
 	lua_lock(L);
+	bg = luaC_bgfree(L, 0);  /* pending blocks go to the old allocator */
 	G(L)->ud = ud;
 	G(L)->frealloc = f;
+	luaC_bgfree(L, bg);
 	lua_unlock(L);
 }
 
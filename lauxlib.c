@@ -1060,6 +1060,187 @@ LUALIB_API lua_State *luaL_newstate (void) {
 }
 
 
+/*
+** {======================================================
+** Arena allocator: blocks up to LUAL_ARENAMAX bytes come from chunks
+** owned by the state, one free list for each size class. Lua always
+** tells the size of the block it frees, so blocks need no header. A
+** state is used by one thread at a time, so the lists need no locks
+** (and the allocator is not thread safe: it must never be combined
+** with background freeing, LUA_GCBGFREE). Everything goes back to
+** 'malloc' at once when the state itself (the first block allocated)
+** is freed. Shrinking a block never fails.
+** =======================================================
+*/
+
+/* largest block served by the arena (larger ones go to 'realloc') */
+#if !defined(LUAL_ARENAMAX)
+#define LUAL_ARENAMAX	256
+#endif
+
+/* size of each chunk of an arena */
+#if !defined(LUAL_ARENACHUNK)
+#define LUAL_ARENACHUNK	(64 * 1024)
+#endif
+
+/* block sizes are multiples of this */
+#define ARENAGRAIN	16
+
+#define NSIZECLASSES	(LUAL_ARENAMAX / ARENAGRAIN)
+
+/* size class of a (non-zero) block size, and the size of a class */
+#define sizeclass(sz)	(((sz) - 1) / ARENAGRAIN)
+#define classsize(c)	(((c) + 1) * ARENAGRAIN)
+
+#define inarena(sz)	((sz) != 0 && (sz) <= LUAL_ARENAMAX)
+
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *previous;
+} ArenaChunk;
+
+/* space for a chunk header, keeping blocks aligned */
+#define CHUNKHEAD  \
+  ((sizeof(ArenaChunk) + ARENAGRAIN - 1) / ARENAGRAIN * ARENAGRAIN)
+
+/*
+** blocks outside the arena are never smaller than a chunk with one
+** block, so that a shrink into the arena can always use the old block
+** (see 'arenaadopt')
+*/
+#define MINLARGE	(CHUNKHEAD + LUAL_ARENAMAX)
+#define largesize(sz)	((sz) < MINLARGE ? MINLARGE : (sz))
+
+
+typedef struct Arena {
+  void *freeblocks[NSIZECLASSES];  /* free blocks of each class */
+  char *top;  /* free space in the newest chunk */
+  char *limit;  /* end of the newest chunk */
+  ArenaChunk *chunks;  /* list of all chunks */
+  void *state;  /* first block allocated (the state itself) */
+} Arena;
+
+
+static void arenafree (Arena *a, void *block, size_t size) {
+  if (inarena(size)) {
+    int c = sizeclass(size);
+    *(void **)block = a->freeblocks[c];
+    a->freeblocks[c] = block;
+  }
+  else
+    free(block);
+}
+
+
+static void *arenanew (Arena *a, size_t size) {
+  int c = sizeclass(size);
+  size_t bsize = classsize(c);
+  void *block = a->freeblocks[c];
+  if (block != NULL) {  /* reuse a free block? */
+    a->freeblocks[c] = *(void **)block;
+    return block;
+  }
+  if ((size_t)(a->limit - a->top) < bsize) {  /* chunk is full? */
+    ArenaChunk *ch = (ArenaChunk *)malloc(LUAL_ARENACHUNK);
+    if (ch == NULL) return NULL;
+    if (a->limit != a->top)  /* keep what is left of the old chunk */
+      arenafree(a, a->top, (size_t)(a->limit - a->top));
+    ch->previous = a->chunks;
+    a->chunks = ch;
+    a->top = (char *)ch + CHUNKHEAD;
+    a->limit = (char *)ch + LUAL_ARENACHUNK;
+  }
+  block = a->top;
+  a->top += bsize;
+  return block;
+}
+
+
+/*
+** Turns a block from outside the arena into a chunk of its own,
+** holding only its first 'size' bytes, moved after the chunk header
+*/
+static void *arenaadopt (Arena *a, void *block, size_t size) {
+  ArenaChunk *ch = (ArenaChunk *)block;
+  memmove((char *)block + CHUNKHEAD, block, size);
+  ch->previous = a->chunks;
+  a->chunks = ch;
+  return (char *)block + CHUNKHEAD;
+}
+
+
+/* give back all memory of an arena */
+static void arenarelease (Arena *a) {
+  ArenaChunk *ch = a->chunks;
+  while (ch != NULL) {
+    ArenaChunk *previous = ch->previous;
+    free(ch);
+    ch = previous;
+  }
+  free(a);
+}
+
+
+static void *l_arenaalloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Arena *a = (Arena *)ud;
+  void *newblock;
+  if (ptr == NULL) osize = 0;  /* 'osize' is the type of a new object */
+  if (nsize == 0) {
+    if (ptr != NULL) {
+      int isstate = (ptr == a->state);
+      arenafree(a, ptr, osize);
+      if (isstate)  /* freed the state? */
+        arenarelease(a);  /* then everything else is free too */
+    }
+    return NULL;
+  }
+  if (inarena(osize) && inarena(nsize) &&
+      (sizeclass(osize) == sizeclass(nsize) ||
+       (nsize < osize && a->freeblocks[sizeclass(nsize)] == NULL)))
+    return ptr;  /* right size, or a shrink with no block to move to */
+  if (!inarena(osize) && !inarena(nsize) && ptr != NULL) {
+    newblock = realloc(ptr, largesize(nsize));
+    return (newblock == NULL && nsize < osize) ? ptr : newblock;
+  }
+  newblock = inarena(nsize) ? arenanew(a, nsize) : malloc(largesize(nsize));
+  if (newblock == NULL && ptr != NULL && nsize < osize)  /* shrink? */
+    return arenaadopt(a, ptr, nsize);  /* old block has room for it */
+  if (ptr == NULL && a->state == NULL) {  /* first block? */
+    if (newblock == NULL) {  /* could not create the state? */
+      arenarelease(a);
+      return NULL;
+    }
+    a->state = newblock;
+  }
+  else if (newblock != NULL && ptr != NULL) {
+    memcpy(newblock, ptr, (osize < nsize) ? osize : nsize);
+    arenafree(a, ptr, osize);
+  }
+  return newblock;
+}
+
+
+/*
+** Creates a state whose memory comes from an arena of its own. The
+** allocator releases the arena when the state is freed, either by
+** 'lua_close' or by a failed 'lua_newstate'.
+*/
+LUALIB_API lua_State *luaL_newarenastate (void) {
+  lua_State *L;
+  Arena *a = (Arena *)malloc(sizeof(Arena));
+  if (a == NULL) return NULL;
+  memset(a->freeblocks, 0, sizeof(a->freeblocks));
+  a->top = a->limit = NULL;
+  a->chunks = NULL;
+  a->state = NULL;
+  L = lua_newstate(l_arenaalloc, a);
+  if (L) lua_atpanic(L, &panic);
+  return L;
+}
+
+/* }====================================================== */
+
+
 LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver, size_t sz) {
   const lua_Number *v = lua_version(L);
   if (sz != LUAL_NUMSIZES)  /* check numeric types */
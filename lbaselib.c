@@ -170,16 +170,84 @@ static int luaB_rawset (lua_State *L) {
 }
 
 
+/* 'collectgarbage' options that are not 'lua_gc' options */
+#define GCSTATS		(-1)
+#define GCMEMDUMP	(-2)
+
+static void setcount (lua_State *L, const char *k, size_t v) {
+  lua_pushinteger(L, (lua_Integer)v);
+  lua_setfield(L, -2, k);
+}
+
+
+static void setcounts (lua_State *L, const char *k, const size_t *count) {
+  int t;
+  lua_createtable(L, 0, LUA_TTHREAD - LUA_TSTRING + 1);
+  for (t = LUA_TSTRING; t <= LUA_TTHREAD; t++)  /* collectable types */
+    setcount(L, lua_typename(L, t), count[t]);
+  lua_setfield(L, -2, k);
+}
+
+
+static int pushgcstats (lua_State *L) {
+  static const char *const phases[LUA_NUMGCPHASES] = {"propagate",
+    "atomic", "sweepallgc", "sweepfinobj", "sweeptobefnz", "sweepend",
+    "callfin", "pause"};
+  lua_GCStats s;
+  int i;
+  lua_gcstats(L, &s);
+  lua_createtable(L, 0, 9);
+  setcount(L, "cycles", s.cycles);
+  setcount(L, "minors", s.minors);
+  setcount(L, "emergencies", s.emergencies);
+  lua_createtable(L, 0, LUA_NUMGCPHASES);
+  for (i = 0; i < LUA_NUMGCPHASES; i++)
+    setcount(L, phases[i], s.phasetime[i]);
+  lua_setfield(L, -2, "phasetime");
+  setcount(L, "maxatomic", s.maxatomic);
+  setcounts(L, "marked", s.marked);
+  setcounts(L, "swept", s.swept);
+  setcount(L, "freedbytes", s.freedbytes);
+  setcount(L, "finalizers", s.finalizers);
+  return 1;
+}
+
+
+static int memwriter (lua_State *L, const void *b, size_t size, void *B) {
+  (void)L;
+  luaL_addlstring((luaL_Buffer *)B, (const char *)b, size);
+  return 0;
+}
+
+
+static int pushmemdump (lua_State *L) {
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  lua_memdump(L, memwriter, &b);
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "isrunning", NULL};
+    "isrunning", "generational", "incremental",
+    "setminormul", "setmajormul",
+    "setsteptime", "setmaxpause", "stats", "memrate", "memdump", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCISRUNNING};
+    LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC,
+    LUA_GCSETMINORMUL, LUA_GCSETMAJORMUL,
+    LUA_GCSETSTEPTIME, LUA_GCSETMAXPAUSE, GCSTATS, LUA_GCMEMRATE, GCMEMDUMP};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
-  int ex = (int)luaL_optinteger(L, 2, 0);
-  int res = lua_gc(L, o, ex);
+  int ex, res;
+  if (o == GCSTATS)
+    return pushgcstats(L);
+  else if (o == GCMEMDUMP)
+    return pushmemdump(L);
+  ex = (int)luaL_optinteger(L, 2, 0);
+  res = lua_gc(L, o, ex);
   switch (o) {
     case LUA_GCCOUNT: {
       int b = lua_gc(L, LUA_GCCOUNTB, 0);
@@ -190,6 +258,10 @@ static int luaB_collectgarbage (lua_State *L) {
       lua_pushboolean(L, res);
       return 1;
     }
+    case LUA_GCGEN: case LUA_GCINC: {  /* return previous mode */
+      lua_pushstring(L, (res == LUA_GCGEN) ? "generational" : "incremental");
+      return 1;
+    }
     default: {
       lua_pushinteger(L, res);
       return 1;
@@ -147,29 +147,64 @@ static int luaB_yield (lua_State *L) {
 }
 
 
-static int luaB_costatus (lua_State *L) {
-	lua_State *co = getco(L);
-	if (L == co) lua_pushliteral(L, "running");
+/* coroutine statuses, as returned by 'auxstatus' */
+#define COS_RUN		0
+#define COS_DEAD	1
+#define COS_YIELD	2
+#define COS_NORM	3
+
+
+static const char *const statname[] =
+	{"running", "dead", "suspended", "normal"};
+
+
+static int auxstatus (lua_State *L, lua_State *co) {
+	if (L == co) return COS_RUN;
 	else {
 		switch (lua_status(co)) {
 			case LUA_YIELD:
-				lua_pushliteral(L, "suspended");
-				break;
+				return COS_YIELD;
 			case LUA_OK: {
 							 lua_Debug ar;
 							 if (lua_getstack(co, 0, &ar) > 0)  /* does it have frames? */
-								 lua_pushliteral(L, "normal");  /* it is running */
+								 return COS_NORM;  /* it is running */
 							 else if (lua_gettop(co) == 0)
-								 lua_pushliteral(L, "dead");
+								 return COS_DEAD;
 							 else
-								 lua_pushliteral(L, "suspended");  /* initial state */
-							 break;
+								 return COS_YIELD;  /* initial state */
 						 }
 			default:  /* some error occurred */
-						 lua_pushliteral(L, "dead");
-						 break;
+						 return COS_DEAD;
 		}
 	}
+}
+
+
+static int luaB_costatus (lua_State *L) {
+	lua_State *co = getco(L);
+	lua_pushstring(L, statname[auxstatus(L, co)]);
+	return 1;
+}
+
+
+/**
+ * 回收协程: 清空一个没有运行的协程(dead/suspended)的栈以便重用,
+ * 可选地设置新的主函数
+ * Lua: co = coroutine.recycle(co [, f])
+ */
+static int luaB_corecycle (lua_State *L) {
+	lua_State *co = getco(L);
+	int status = auxstatus(L, co);
+	if (status == COS_RUN || status == COS_NORM)
+		return luaL_error(L, "cannot recycle a %s coroutine", statname[status]);
+	if (!lua_isnoneornil(L, 2))
+		luaL_checktype(L, 2, LUA_TFUNCTION);
+	lua_resetthread(co);
+	if (!lua_isnoneornil(L, 2)) {  /* new body? */
+		lua_pushvalue(L, 2);
+		lua_xmove(L, co, 1);
+	}
+	lua_settop(L, 1);
 	return 1;
 }
 
@@ -192,6 +227,7 @@ static const luaL_Reg co_funcs[] = {
 	{"resume", luaB_coresume},
 	{"running", luaB_corunning},
 	{"status", luaB_costatus},
+	{"recycle", luaB_corecycle},
 	{"wrap", luaB_cowrap},
 	{"yield", luaB_yield},
 	{"isyieldable", luaB_yieldable},
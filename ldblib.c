@@ -428,10 +428,49 @@ static int db_traceback (lua_State *L) {
 }
 
 
+static int snapbuffer (lua_State *L, const void *b, size_t size, void *B) {
+  (void)L;
+  luaL_addlstring((luaL_Buffer *)B, (const char *)b, size);
+  return 0;
+}
+
+
+static int snapfile (lua_State *L, const void *b, size_t size, void *f) {
+  (void)L;
+  return (fwrite(b, 1, size, (FILE *)f) != size);
+}
+
+
+/*
+** heapsnapshot([filename]): writes a snapshot of the heap to the given
+** file or, without a file name, returns it as a string
+*/
+static int db_heapsnapshot (lua_State *L) {
+  const char *fname = luaL_optstring(L, 1, NULL);
+  if (fname == NULL) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    lua_heapsnapshot(L, snapbuffer, &b);
+    luaL_pushresult(&b);
+    return 1;
+  }
+  else {
+    FILE *f = fopen(fname, "wb");
+    int res;
+    if (f == NULL)
+      return luaL_fileresult(L, 0, fname);
+    res = (lua_heapsnapshot(L, snapfile, f) == 0);
+    res = (fclose(f) == 0) && res;
+    return luaL_fileresult(L, res, fname);
+  }
+}
+
+
 static const luaL_Reg dblib[] = {
   {"debug", db_debug},
   {"getuservalue", db_getuservalue},
   {"gethook", db_gethook},
+  {"heapsnapshot", db_heapsnapshot},
   {"getinfo", db_getinfo},
   {"getlocal", db_getlocal},
   {"getregistry", db_getregistry},
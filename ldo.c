@@ -468,6 +468,8 @@ Cfunc: {
 		   lua_unlock(L);
 		   n = (*f)(L);  /* 直接调用C语言闭包函数 do the actual call */
 		   lua_lock(L);
+		   if (luaD_yielded(L))  /* yielded without a long jump? */
+			   return 1;  /* leave 'ci' as 'lua_yieldk' left it */
 		   api_checknelems(L, n);
 		   luaD_poscall(L, ci, L->top - n, n); //调整堆栈
 		   return 1; /*返回1 C语言本身函数*/
@@ -569,6 +571,8 @@ static void finishCcall (lua_State *L, int status) {
 	lua_unlock(L);
 	n = (*ci->u.c.k)(L, status, ci->u.c.ctx);  /* call continuation function */
 	lua_lock(L);
+	if (luaD_yielded(L))  /* yielded again (see 'lua_yieldk')? */
+		return;
 	api_checknelems(L, n);
 	luaD_poscall(L, ci, L->top - n, n);  /* finish 'luaD_precall' */
 }
@@ -577,7 +581,8 @@ static void finishCcall (lua_State *L, int status) {
 /**
  * Executes "full continuation" (everything in the stack) of a
  * previously interrupted coroutine until the stack is empty (or another
- * interruption long-jumps out of the loop). If the coroutine is
+ * interruption long-jumps out of the loop, or the coroutine yields
+ * without a long jump; see 'lua_yieldk'). If the coroutine is
  * recovering from an error, 'ud' points to the error status, which must
  * be passed to the first continuation function (otherwise the default
  * status is LUA_YIELD).
@@ -586,7 +591,8 @@ static void finishCcall (lua_State *L, int status) {
 static void unroll (lua_State *L, void *ud) {
 	if (ud != NULL)  /* error status? */
 		finishCcall(L, *(int *)ud);  /* finish 'lua_pcallk' callee */
-	while (L->ci != &L->base_ci) {  /* something in the stack */
+	/* something in the stack and not suspended again? */
+	while (L->ci != &L->base_ci && L->status == LUA_OK) {
 		if (!isLua(L->ci))  /* C function? */
 			finishCcall(L, LUA_YIELD);  /* complete its execution */
 		else {  /* Lua function */
@@ -692,6 +698,8 @@ static void resume (lua_State *L, void *ud) {
 				lua_unlock(L);
 				n = (*ci->u.c.k)(L, LUA_YIELD, ci->u.c.ctx); /* call continuation */
 				lua_lock(L);
+				if (luaD_yielded(L))  /* yielded again (see 'lua_yieldk')? */
+					return;
 				api_checknelems(L, n);
 				firstArg = L->top - n;  /* yield results come from continuation */
 			}
@@ -730,6 +738,7 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
 	L->nCcalls = (from) ? from->nCcalls + 1 : 1;
 	if (L->nCcalls >= LUAI_MAXCCALLS)
 		return resume_error(L, "C stack overflow", nargs);
+	L->nCbase = L->nCcalls;
 	luai_userstateresume(L, nargs);
 	L->nny = 0;  /* allow yields */
 	api_checknelems(L, (L->status == LUA_OK) ? nargs + 1 : nargs);
@@ -746,7 +755,10 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
 			seterrorobj(L, status, L->top);  /* push error message */
 			L->ci->top = L->top;
 		}
-		else lua_assert(status == L->status);  /* normal end or yield */
+		else {  /* normal end or yield */
+			lua_assert(status == L->status || status == LUA_OK);
+			status = L->status;  /* it may have yielded without a long jump */
+		}
 	}
 	L->nny = oldnny;  /* restore 'nny' */
 	L->nCcalls--;
@@ -786,6 +798,19 @@ LUA_API int lua_yieldk (lua_State *L, int nresults, lua_KContext ctx,
 		if ((ci->u.c.k = k) != NULL)  /* is there a continuation? */
 			ci->u.c.ctx = ctx;  /* save context */
 		ci->func = L->top - nresults - 1;  /* protect stack below results */
+#if LUAI_STACKLESSYIELD
+		/*
+		 * When this function was called straight from 'resume', 'unroll',
+		 * or the 'luaV_execute' they run (no other C call in between),
+		 * returning is enough: 'luaD_precall' (or the continuation call)
+		 * sees the status and every level returns up to 'lua_resume',
+		 * leaving the thread as the long jump would leave it.
+		 */
+		if (L->nCcalls == L->nCbase && !(ci->callstatus & CIST_HOOKED)) {
+			lua_unlock(L);
+			return 0;  /* caller must return it at once (see manual) */
+		}
+#endif
 		luaD_throw(L, LUA_YIELD);//抛出一个LUA_YIELD
 	}
 	lua_assert(ci->callstatus & CIST_HOOKED);  /* must be inside a hook */
@@ -28,6 +28,51 @@
 #define luaD_checkstack(L,n)	luaD_checkstackaux(L,n,(void)0,(void)0)
 
 
+/*
+** With LUAI_STACKLESSYIELD on, 'lua_yieldk' called straight from the
+** Lua code of a coroutine returns to its C function instead of
+** long-jumping back to 'lua_resume'. That C function must then return
+** at once what 'lua_yieldk' returned, which C modules written for the
+** standard API need not do; so it is off unless the host knows that
+** all of its C functions follow that rule.
+*/
+#if !defined(LUAI_STACKLESSYIELD)
+#define LUAI_STACKLESSYIELD	0
+#endif
+
+/*
+** true when the C function (or continuation) that just returned yielded
+** without a long jump; never without LUAI_STACKLESSYIELD, so that calls
+** to C do not pay for that check
+*/
+#if LUAI_STACKLESSYIELD
+#define luaD_yielded(L)	((L)->status == LUA_YIELD)
+#else
+#define luaD_yielded(L)	0
+#endif
+
+
+
+/*
+** Fast path of 'luaD_precall' for the most common call: a non-vararg
+** Lua function (with prototype 'p') called with exactly its 'n'
+** parameters, with enough stack above 'L->top' for its frame, a
+** CallInfo already allocated, and no hooks. 'luaD_fastcall' then
+** enters the function just as 'luaD_precall' would.
+*/
+#define luaD_canfastcall(L,p,n)  \
+	(!(p)->is_vararg && (p)->numparams == (n) && (L)->hookmask == 0 && \
+	 (L)->ci->next != NULL && (L)->stack_last - (L)->top > (p)->maxstacksize)
+
+#define luaD_fastcall(L,fn,nres,p)  { \
+	CallInfo *ci_ = (L)->ci = (L)->ci->next; \
+	ci_->nresults = (nres); \
+	ci_->func = (fn); \
+	ci_->u.l.base = (fn) + 1; \
+	(L)->top = ci_->top = (fn) + 1 + (p)->maxstacksize; \
+	ci_->u.l.savedpc = (p)->code; \
+	ci_->callstatus = CIST_LUA; }
+
 
 #define savestack(L,p)		((char *)(p) - (char *)L->stack)
 #define restorestack(L,n)	((TValue *)((char *)L->stack + (n)))
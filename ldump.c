@@ -15,6 +15,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -87,9 +88,23 @@ static void DumpString (const TString *s, DumpState *D) {
 }
 
 
+/*
+** Dump the code of a function. Quickened instructions are saved in
+** their generic form, as they are valid only inside a running state.
+*/
 static void DumpCode (const Proto *f, DumpState *D) {
+  Instruction buff[64];
+  int i, n = 0;
   DumpInt(f->sizecode, D);
-  DumpVector(f->code, f->sizecode, D);
+  for (i = 0; i < f->sizecode; i++) {
+    Instruction inst = f->code[i];
+    SET_OPCODE(inst, genericop(GET_OPCODE(inst)));
+    buff[n++] = inst;
+    if (n == sizeof(buff) / sizeof(buff[0]) || i == f->sizecode - 1) {
+      DumpVector(buff, n, D);
+      n = 0;
+    }
+  }
 }
 
 
@@ -16,6 +16,7 @@
 
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -122,6 +123,8 @@ Proto *luaF_newproto (lua_State *L) {
   f->code = NULL;
   f->cache = NULL;
   f->sizecode = 0;
+  f->icache = NULL;
+  f->sizeicache = 0;
   f->lineinfo = NULL;
   f->sizelineinfo = 0;
   f->upvalues = NULL;
@@ -134,21 +137,42 @@ Proto *luaF_newproto (lua_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+  f->jit = NULL;
+  f->jitcount = LUAI_JITHOT;
   return f;
 }
 
 
 void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->code, f->sizecode);
+  luaM_freearray(L, f->icache, f->sizeicache);
   luaM_freearray(L, f->p, f->sizep);
   luaM_freearray(L, f->k, f->sizek);
   luaM_freearray(L, f->lineinfo, f->sizelineinfo);
   luaM_freearray(L, f->locvars, f->sizelocvars);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
+#if LUA_USE_JIT
+  if (f->jit)
+    luaJ_free(f);
+#endif
   luaM_free(L, f);
 }
 
 
+/*
+** Create the inline caches of a prototype, one slot per instruction.
+** Each slot keeps a hint (a hash-node index) for the table access done
+** by its instruction; any initial value is a valid (if useless) hint.
+*/
+void luaF_initicache (lua_State *L, Proto *f) {
+  int i;
+  f->icache = luaM_newvector(L, f->sizecode, unsigned int);
+  f->sizeicache = f->sizecode;
+  for (i = 0; i < f->sizeicache; i++)
+    f->icache[i] = 0;
+}
+
+
 /*
 ** Look for n-th local variable at line 'line' in function 'func'.
 ** Returns NULL if not found.
@@ -10,7 +10,9 @@
 #include "lprefix.h"
 
 
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "lua.h"
 
@@ -25,6 +27,13 @@
 #include "ltable.h"
 #include "ltm.h"
 
+#if LUAI_GCPTHREADS
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
 
 /*
  ** internal state for collector while inside the atomic phase. The
@@ -60,15 +69,15 @@
 
 
 /*
- ** 'makewhite' erases all color bits then sets only the current white
- ** bit
+ ** 'makewhite' erases all color bits (and the old bit) then sets only
+ ** the current white bit
  */
-#define maskcolors	(~(bitmask(BLACKBIT) | WHITEBITS))
+#define maskcolors	(~(bit2mask(BLACKBIT, OLDBIT) | WHITEBITS))
 #define makewhite(g,x)	\
 	(x->marked = cast_byte((x->marked & maskcolors) | luaC_white(g)))
 
 #define white2gray(x)	resetbits(x->marked, WHITEBITS)
-#define black2gray(x)	resetbit(x->marked, BLACKBIT)
+#define black2gray(x)	setmarked(x, getmarked(x) & ~bitmask(BLACKBIT))
 
 
 #define valiswhite(x)   (iscollectable(x) && iswhite(gcvalue(x)))
@@ -95,6 +104,62 @@
 static void reallymarkobject (global_State *g, GCObject *o);
 
 
+#if LUAI_GCPTHREADS && LUAI_GCMAXTHREADS > 1
+
+/* size of the deque of each marker (must be a power of 2) */
+#define GCDEQUESIZE	1024
+
+/*
+** State of one of the threads marking in parallel. Its gray objects
+** live in a work-stealing deque: the owner pushes and pops them at
+** 'bottom' while the other markers steal them at 'top'. Objects that
+** do not fit there go to 'overflow', linked by their 'gclist' fields.
+** The other lists get what the collector would link into the global
+** lists with the same names; they are appended to those lists when
+** marking ends.
+*/
+typedef struct GCMarker {
+	long top;
+	long bottom;
+	GCObject *deque[GCDEQUESIZE];
+	GCObject *overflow;
+	GCObject *grayagain;
+	GCObject *weak;
+	GCObject *ephemeron;
+	GCObject *allweak;
+	struct lua_State *twups;
+	lu_mem GCmemtrav;
+	struct GCMarkers *ms;  /* pool it belongs to */
+	pthread_t thread;
+} GCMarker;
+
+/* marker run by the current thread (NULL when not marking in parallel) */
+static __thread GCMarker *gcmarker = NULL;
+
+#define inparallel()	(gcmarker != NULL)
+
+/* field 'f' of the collector, or of the marker run by this thread */
+#define gcfield(g,f)	(*(inparallel() ? &gcmarker->f : &(g)->f))
+
+/* turn white object 'o' gray; false if another marker already did it */
+#define trymark(o)	(inparallel() ? casmark(o) : (white2gray(o), 1))
+
+#define linkgray(g,o,x)  \
+	(inparallel() ? pushgray(gcmarker, o) : (void)linkgclist(x, (g)->gray))
+
+static int casmark (GCObject *o);
+static void pushgray (GCMarker *m, GCObject *o);
+
+#else
+
+#define inparallel()	0
+#define gcfield(g,f)	((g)->f)
+#define trymark(o)	(white2gray(o), 1)
+#define linkgray(g,o,x)	linkgclist(x, (g)->gray)
+
+#endif
+
+
 /*
  ** {======================================================
  ** Generic functions
@@ -108,12 +173,52 @@ static void reallymarkobject (global_State *g, GCObject *o);
 #define gnodelast(h)	gnode(h, cast(size_t, sizenode(h)))
 
 
+/*
+** nodes of part 'p' of the hash of 'h': 0 is its hash part, and 1 the
+** nodes not moved yet from the part it is growing from (see 'ltable.c')
+*/
+static int noderange (Table *h, int p, Node **n, Node **limit) {
+	if (p == 0) {
+		*n = gnode(h, 0);
+		*limit = gnodelast(h);
+		return 1;
+	}
+	else if (p == 1 && h->oldhash != NULL) {
+		*n = h->oldhash->node + h->oldhash->pos;
+		*limit = h->oldhash->node + twoto(h->oldhash->lsizenode);
+		return 1;
+	}
+	else
+		return 0;
+}
+
+/* loop 'n' over all nodes of 'h' */
+#define fornodes(h,p,n,limit) \
+	for (p = 0; noderange(h, p, &n, &limit); p++) \
+		for (; n < limit; n++)
+
+
 /*
  ** link collectable object 'o' into list pointed by 'p'
  */
 #define linkgclist(o,p)	((o)->gclist = (p), (p) = obj2gco(o))
 
 
+/*
+ ** field 'gclist' of an object that can be gray
+ */
+static GCObject **getgclist (GCObject *o) {
+	switch (o->tt) {
+		case LUA_TTABLE: return &gco2t(o)->gclist;
+		case LUA_TLCL: return &gco2lcl(o)->gclist;
+		case LUA_TCCL: return &gco2ccl(o)->gclist;
+		case LUA_TTHREAD: return &gco2th(o)->gclist;
+		case LUA_TPROTO: return &gco2p(o)->gclist;
+		default: lua_assert(0); return NULL;
+	}
+}
+
+
 /*
  ** If key is not marked, mark its entry as dead. This allows key to be
  ** collected, but keeps its entry in the table.  A dead node is needed
@@ -293,7 +398,8 @@ GCObject *luaC_newobj (lua_State *L, int tt, size_t sz) {
  */
 static void reallymarkobject (global_State *g, GCObject *o) {
 reentry:
-	white2gray(o);
+	if (!trymark(o))
+		return;  /* another marker got it first */
 	switch (o->tt)
 	{
 		case LUA_TSHRSTR:
@@ -304,7 +410,7 @@ reentry:
 				 * 所以直接标记为黑色
 				 */
 				gray2black(o);
-				g->GCmemtrav += sizelstring(gco2ts(o)->shrlen);
+				gcfield(g, GCmemtrav) += sizelstring(gco2ts(o)->shrlen);
 				break;
 			}
 		case LUA_TLNGSTR:
@@ -315,7 +421,7 @@ reentry:
 				 * 所以直接标记为黑色
 				 */
 				gray2black(o);
-				g->GCmemtrav += sizelstring(gco2ts(o)->u.lnglen);
+				gcfield(g, GCmemtrav) += sizelngstr(gco2ts(o));
 				break;
 			}
 		case LUA_TUSERDATA:
@@ -329,7 +435,7 @@ reentry:
 				TValue uvalue;
 				markobjectN(g, gco2u(o)->metatable);	/* mark its metatable */
 				gray2black(o);
-				g->GCmemtrav += sizeudata(gco2u(o));
+				gcfield(g, GCmemtrav) += sizeudata(gco2u(o));
 				getuservalue(g->mainthread, gco2u(o), &uvalue);
 				if (valiswhite(&uvalue)) {	/* markvalue(g, &uvalue); */
 					o = gcvalue(&uvalue);
@@ -339,27 +445,27 @@ reentry:
 			}
 		case LUA_TLCL:
 			{
-				linkgclist(gco2lcl(o), g->gray);
+				linkgray(g, o, gco2lcl(o));
 				break;
 			}
 		case LUA_TCCL:
 			{
-				linkgclist(gco2ccl(o), g->gray);
+				linkgray(g, o, gco2ccl(o));
 				break;
 			}
 		case LUA_TTABLE:
 			{
-				linkgclist(gco2t(o), g->gray);
+				linkgray(g, o, gco2t(o));
 				break;
 			}
 		case LUA_TTHREAD:
 			{
-				linkgclist(gco2th(o), g->gray);
+				linkgray(g, o, gco2th(o));
 				break;
 			}
 		case LUA_TPROTO:
 			{
-				linkgclist(gco2p(o), g->gray);
+				linkgray(g, o, gco2p(o));
 				break;
 			}
 		default: lua_assert(0); break;
@@ -428,6 +534,8 @@ static void restartcollection (global_State *g) {
 	 */
 	markobject(g, g->mainthread);
 	markvalue(g, &g->l_registry);
+	markobjectN(g, g->pinned);
+	markobjectN(g, g->snapids);
 	markmt(g);
 	markbeingfnz(g);  /* mark any finalizing object left from previous cycle */
 }
@@ -441,6 +549,35 @@ static void restartcollection (global_State *g) {
  ** =======================================================
  */
 
+/*
+ ** memory used by objects with parts of their own (what traversing
+ ** them costs)
+ */
+static lu_mem tablesize (Table *h) {
+	return sizeof(Table) + sizeof(TValue) * h->sizearray +
+		sizeof(Node) * cast(size_t, allocsizenode(h)) +
+		(h->oldhash ? sizeof(Node) * twoto(h->oldhash->lsizenode) : 0) +
+		(h->shape ? sizeof(TValue) * cast(size_t, h->shape->nkeys) : 0);
+}
+
+
+static lu_mem protosize (Proto *f) {
+	return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
+		sizeof(unsigned int) * f->sizeicache +
+		sizeof(Proto *) * f->sizep +
+		sizeof(TValue) * f->sizek +
+		sizeof(int) * f->sizelineinfo +
+		sizeof(LocVar) * f->sizelocvars +
+		sizeof(Upvaldesc) * f->sizeupvalues;
+}
+
+
+static lu_mem threadsize (lua_State *th) {
+	return (sizeof(lua_State) + sizeof(TValue) * th->stacksize +
+			sizeof(CallInfo) * th->nci);
+}
+
+
 /*
  ** Traverse a table with weak values and link it to proper list. During
  ** propagate phase, keep it in 'grayagain' list, to be revisited in the
@@ -448,11 +585,12 @@ static void restartcollection (global_State *g) {
  ** put it in 'weak' list, to be cleared.
  */
 static void traverseweakvalue (global_State *g, Table *h) {
-	Node *n, *limit = gnodelast(h);
-	/* if there is array part, assume it may have white values (it is not
-	   worth traversing it now just to check) */
-	int hasclears = (h->sizearray > 0);
-	for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+	Node *n, *limit;
+	int p;
+	/* if there is array part (or slots), assume it may have white values
+	   (it is not worth traversing it now just to check) */
+	int hasclears = (h->sizearray > 0 || (h->shape && h->shape->nkeys > 0));
+	fornodes(h, p, n, limit) {  /* traverse hash part */
 		checkdeadkey(n);
 		if (ttisnil(gval(n)))  /* entry is empty? */
 			removeentry(n);  /* remove it */
@@ -464,9 +602,11 @@ static void traverseweakvalue (global_State *g, Table *h) {
 		}
 	}
 	if (g->gcstate == GCSpropagate)
-		linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
+		linkgclist(h, gcfield(g, grayagain));  /* must retraverse it in atomic phase */
 	else if (hasclears)
-		linkgclist(h, g->weak);  /* has to be cleared later */
+		linkgclist(h, gcfield(g, weak));  /* has to be cleared later */
+	else
+		gray2black(h);  /* nothing to clear; no need to keep it gray */
 }
 
 
@@ -484,7 +624,8 @@ static int traverseephemeron (global_State *g, Table *h) {
 	int marked = 0;  /* true if an object is marked in this traversal */
 	int hasclears = 0;  /* true if table has white keys */
 	int hasww = 0;  /* true if table has entry "white-key -> white-value" */
-	Node *n, *limit = gnodelast(h);
+	Node *n, *limit;
+	int p;
 	unsigned int i;
 	/* traverse array part */
 	for (i = 0; i < h->sizearray; i++) {
@@ -493,8 +634,17 @@ static int traverseephemeron (global_State *g, Table *h) {
 			reallymarkobject(g, gcvalue(&h->array[i]));
 		}
 	}
+	if (h->shape) {  /* traverse slots (their keys are never cleared) */
+		int j;
+		for (j = 0; j < h->shape->nkeys; j++) {
+			if (valiswhite(&h->slots[j])) {
+				marked = 1;
+				reallymarkobject(g, gcvalue(&h->slots[j]));
+			}
+		}
+	}
 	/* traverse hash part */
-	for (n = gnode(h, 0); n < limit; n++) {
+	fornodes(h, p, n, limit) {
 		checkdeadkey(n);
 		if (ttisnil(gval(n)))  /* entry is empty? */
 			removeentry(n);  /* remove it */
@@ -510,21 +660,29 @@ static int traverseephemeron (global_State *g, Table *h) {
 	}
 	/* link table into proper list */
 	if (g->gcstate == GCSpropagate)
-		linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
+		linkgclist(h, gcfield(g, grayagain));  /* must retraverse it in atomic phase */
 	else if (hasww)  /* table has white->white entries? */
-		linkgclist(h, g->ephemeron);  /* have to propagate again */
+		linkgclist(h, gcfield(g, ephemeron));  /* have to propagate again */
 	else if (hasclears)  /* table has white keys? */
-		linkgclist(h, g->allweak);  /* may have to clean white keys */
+		linkgclist(h, gcfield(g, allweak));  /* may have to clean white keys */
+	else
+		gray2black(h);  /* nothing to clear; no need to keep it gray */
 	return marked;
 }
 
 
 static void traversestrongtable (global_State *g, Table *h) {
-	Node *n, *limit = gnodelast(h);
+	Node *n, *limit;
+	int p;
 	unsigned int i;
 	for (i = 0; i < h->sizearray; i++)  /* traverse array part */
 		markvalue(g, &h->array[i]);
-	for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+	if (h->shape) {  /* traverse slots */
+		int j;
+		for (j = 0; j < h->shape->nkeys; j++)
+			markvalue(g, &h->slots[j]);
+	}
+	fornodes(h, p, n, limit) {  /* traverse hash part */
 		checkdeadkey(n);
 		if (ttisnil(gval(n)))  /* entry is empty? */
 			removeentry(n);  /* remove it */
@@ -537,6 +695,20 @@ static void traversestrongtable (global_State *g, Table *h) {
 }
 
 
+/*
+** Get the '__mode' field of metatable 'mt'. Unlike 'gfasttm', it does
+** not cache an absent field in 'mt->flags': markers running in
+** parallel may traverse tables sharing that metatable.
+*/
+static const TValue *getmode (global_State *g, Table *mt) {
+	const TValue *mode;
+	if (mt == NULL || (mt->flags & (1u << TM_MODE)))
+		return NULL;
+	mode = luaH_getshortstr(mt, g->tmname[TM_MODE]);
+	return ttisnil(mode) ? NULL : mode;
+}
+
+
 /**
  * 在traversetable函数中，
  * 如果扫描到该表是弱表，那么将会把该对象加入weak链表中，
@@ -546,8 +718,13 @@ static void traversestrongtable (global_State *g, Table *h) {
  */
 static lu_mem traversetable (global_State *g, Table *h) {
 	const char *weakkey, *weakvalue;
-	const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
+	const TValue *mode = getmode(g, h->metatable);
 	markobjectN(g, h->metatable);
+	if (h->shape) {  /* mark keys of its shape (even in weak tables) */
+		int j;
+		for (j = 0; j < h->shape->nkeys; j++)
+			markobject(g, h->shape->keys[j]);
+	}
 	if (mode && ttisstring(mode) &&  /* is there a weak mode? */
 			((weakkey = strchr(svalue(mode), 'k')),
 			 (weakvalue = strchr(svalue(mode), 'v')),
@@ -567,7 +744,7 @@ static lu_mem traversetable (global_State *g, Table *h) {
 		else if (!weakvalue)  /* strong values? */
 			traverseephemeron(g, h);
 		else  /* all weak */
-			linkgclist(h, g->allweak);  /* nothing to traverse now */
+			linkgclist(h, gcfield(g, allweak));  /* nothing to traverse now */
 	}
 	else
 	{
@@ -577,8 +754,7 @@ static lu_mem traversetable (global_State *g, Table *h) {
 		 */
 		traversestrongtable(g, h);
 	}
-	return sizeof(Table) + sizeof(TValue) * h->sizearray +
-		sizeof(Node) * cast(size_t, allocsizenode(h));
+	return tablesize(h);
 }
 
 
@@ -601,12 +777,7 @@ static int traverseproto (global_State *g, Proto *f) {
 		markobjectN(g, f->p[i]);
 	for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
 		markobjectN(g, f->locvars[i].varname);
-	return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
-		sizeof(Proto *) * f->sizep +
-		sizeof(TValue) * f->sizek +
-		sizeof(int) * f->sizelineinfo +
-		sizeof(LocVar) * f->sizelocvars +
-		sizeof(Upvaldesc) * f->sizeupvalues;
+	return protosize(f);
 }
 
 
@@ -658,406 +829,1611 @@ static lu_mem traversethread (global_State *g, lua_State *th) {
 			setnilvalue(o);
 		/* 'remarkupvals' may have removed thread from 'twups' list */
 		if (!isintwups(th) && th->openupval != NULL) {
-			th->twups = g->twups;  /* link it back to the list */
-			g->twups = th;
+			th->twups = gcfield(g, twups);  /* link it back to the list */
+			gcfield(g, twups) = th;
 		}
+		/* old threads are traversed only here (markers cannot reallocate) */
+		if (isgenerational(g) && !inparallel())
+			luaD_shrinkstack(th);
 	}
-	else if (g->gckind != KGC_EMERGENCY)
-		luaD_shrinkstack(th); /* do not change stack in emergency cycle */
-	return (sizeof(lua_State) + sizeof(TValue) * th->stacksize +
-			sizeof(CallInfo) * th->nci);
+	/* do not change stack in emergency cycle or while marking in parallel */
+	else if (g->gckind != KGC_EMERGENCY && !inparallel())
+		luaD_shrinkstack(th);
+	return threadsize(th);
 }
 
 
 /**
  * traverse one gray object, turning it to black (except for threads,
- * which are always gray).
+ * which are always gray). Returns the memory it occupies.
  * 里将对象从灰色标记成黑色，表示这个对象及其所引用的对象都已经标记过
  * 会根据不同的类型调用对应的traverse*函数进行标记（会递归调用）
  */
-static void propagatemark (global_State *g) {
-	lu_mem size;
-	GCObject *o = g->gray;
+static lu_mem traversegray (global_State *g, GCObject *o) {
 	lua_assert(isgray(o));
 	gray2black(o);
 	switch (o->tt)
 	{
-		case LUA_TTABLE:
-			{
-				Table *h = gco2t(o);
-				g->gray = h->gclist;  /* remove from 'gray' list */
-				size = traversetable(g, h);
-				break;
-			}
-		case LUA_TLCL:
-			{
-				LClosure *cl = gco2lcl(o);
-				g->gray = cl->gclist;  /* remove from 'gray' list */
-				size = traverseLclosure(g, cl);
-				break;
-			}
-		case LUA_TCCL:
-			{
-				CClosure *cl = gco2ccl(o);
-				g->gray = cl->gclist;  /* remove from 'gray' list */
-				size = traverseCclosure(g, cl);
-				break;
-			}
+		case LUA_TTABLE: return traversetable(g, gco2t(o));
+		case LUA_TLCL: return traverseLclosure(g, gco2lcl(o));
+		case LUA_TCCL: return traverseCclosure(g, gco2ccl(o));
 		case LUA_TTHREAD:
 			{
 				lua_State *th = gco2th(o);
-				g->gray = th->gclist;  /* remove from 'gray' list */
-				linkgclist(th, g->grayagain);  /* insert into 'grayagain' list */
+				linkgclist(th, gcfield(g, grayagain));  /* insert into 'grayagain' list */
 				black2gray(o);
-				size = traversethread(g, th);
-				break;
-			}
-		case LUA_TPROTO:
-			{
-				Proto *p = gco2p(o);
-				g->gray = p->gclist;  /* remove from 'gray' list */
-				size = traverseproto(g, p);
-				break;
+				return traversethread(g, th);
 			}
-		default: lua_assert(0); return;
+		case LUA_TPROTO: return traverseproto(g, gco2p(o));
+		default: lua_assert(0); return 0;
 	}
-	g->GCmemtrav += size;
 }
 
 
-static void propagateall (global_State *g) {
-	while (g->gray) propagatemark(g);
+static void propagatemark (global_State *g) {
+	GCObject *o = g->gray;
+	g->gray = *getgclist(o);  /* remove from 'gray' list */
+	g->GCmemtrav += traversegray(g, o);
 }
 
 
-/**
+#if LUAI_GCPTHREADS
+
+/*
+** Memory for the collector's own threads (markers and freer). It does
+** not go through 'luaM_', which could raise an error or collect in the
+** middle of a cycle, but it is counted in 'totalbytes' all the same.
 */
-static void convergeephemerons (global_State *g) {
-	int changed;	// 关键值，指示对 g->ephemeron 的一次遍历中是否有对象被重新mark
-	do {
-		GCObject *w;
-		GCObject *next = g->ephemeron;  /* get ephemeron list */
-		g->ephemeron = NULL;  /* tables may return to this list when traversed */
-		changed = 0;
-		while ((w = next) != NULL) {
-			next = gco2t(w)->gclist;
-			if (traverseephemeron(g, gco2t(w))) {  /* traverse marked some value? */
-				propagateall(g);  /* propagate changes */
-				changed = 1;  /* will have to revisit all ephemeron tables */
-			}
-		}
-	} while (changed);	// 无对象可 mark 时，退出
+static void *gcrealloc (global_State *g, void *block, size_t osize,
+                        size_t nsize) {
+	void *newblock = (*g->frealloc)(g->ud, block, osize, nsize);
+	if (newblock != NULL || nsize == 0)
+		g->GCdebt += cast(l_mem, nsize) - cast(l_mem, osize);
+	return newblock;
 }
 
-/* }====================================================== */
+#endif
+
 
+#if LUAI_GCPTHREADS && LUAI_GCMAXTHREADS > 1
 
 /*
  ** {======================================================
- ** Sweep Functions
+ ** Parallel marking
  ** =======================================================
  */
 
+/*
+** Draining the gray list in the atomic phase and in full collections
+** is a stop-the-world pause, so it is split among a pool of threads
+** (markers). Each marker traverses the gray objects in its own deque,
+** pushing there the objects it turns gray, and steals from the other
+** deques when its own is empty. Marks are set with an atomic
+** compare-and-swap, so that only one marker wins (and traverses) each
+** object; only the winner writes the other bits of that object. What
+** traversals link into the global lists goes into lists of the marker
+** (see 'gcfield'), merged when all markers are done. Ephemerons are
+** still converged by the collector thread ('convergeephemerons'),
+** which marks in parallel what they make reachable. Markers neither
+** allocate nor free memory: thread stacks are not shrunk by them.
+*/
+
+
+/* number of processors available for marking */
+#if !defined(luai_ncpus)
+#define luai_ncpus()	cast_int(sysconf(_SC_NPROCESSORS_ONLN))
+#endif
+
+
+typedef struct GCMarkers {
+	GCMarker *m;  /* markers ('m[0]' is run by the collector itself) */
+	int nmarkers;  /* number of markers (1 if there are no helpers) */
+	int active;  /* number of markers that may still have work */
+	int finished;  /* number of helpers done with the current round */
+	int quit;  /* true when helpers must exit */
+	unsigned long round;  /* number of current round of marking */
+	global_State *g;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;  /* helpers wait here for a new round */
+	pthread_cond_t done;  /* collector waits here for the helpers */
+} GCMarkers;
+
+
+static int casmark (GCObject *o) {
+	lu_byte m = __atomic_load_n(&o->marked, __ATOMIC_RELAXED);
+	do {
+		if (!(m & WHITEBITS))
+			return 0;  /* already marked */
+	} while (!__atomic_compare_exchange_n(&o->marked, &m,
+	            cast_byte(m & ~WHITEBITS), 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return 1;
+}
+
 
 /*
- ** clear entries with unmarked keys from all weaktables in list 'l' up
- ** to element 'f'
- */
-static void clearkeys (global_State *g, GCObject *l, GCObject *f) {
-	for (; l != f; l = gco2t(l)->gclist) {
-		Table *h = gco2t(l);
-		Node *n, *limit = gnodelast(h);
-		for (n = gnode(h, 0); n < limit; n++) {
-			if (!ttisnil(gval(n)) && (iscleared(g, gkey(n)))) {
-				setnilvalue(gval(n));  /* remove value ... */
-			}
-			if (ttisnil(gval(n)))  /* is entry empty? */
-				removeentry(n);  /* remove entry from table */
-		}
+** Deque operations ('pushgray' and 'popdeque' only by the owner). The
+** owner and a thief race for the last element through 'top'.
+*/
+static void pushgray (GCMarker *m, GCObject *o) {
+	long b = m->bottom;
+	if (b - __atomic_load_n(&m->top, __ATOMIC_ACQUIRE) >= GCDEQUESIZE) {
+		*getgclist(o) = m->overflow;  /* deque is full */
+		m->overflow = o;
+	}
+	else {
+		__atomic_store_n(&m->deque[b & (GCDEQUESIZE - 1)], o, __ATOMIC_RELAXED);
+		__atomic_store_n(&m->bottom, b + 1, __ATOMIC_RELEASE);
 	}
 }
 
 
-/*
- ** clear entries with unmarked values from all weaktables in list 'l' up
- ** to element 'f'
- */
-static void clearvalues (global_State *g, GCObject *l, GCObject *f) {
-	for (; l != f; l = gco2t(l)->gclist) {
-		Table *h = gco2t(l);
-		Node *n, *limit = gnodelast(h);
-		unsigned int i;
-		for (i = 0; i < h->sizearray; i++) {
-			TValue *o = &h->array[i];
-			if (iscleared(g, o))  /* value was collected? */
-				setnilvalue(o);  /* remove value */
-		}
-		for (n = gnode(h, 0); n < limit; n++) {
-			if (!ttisnil(gval(n)) && iscleared(g, gval(n))) {
-				setnilvalue(gval(n));  /* remove value ... */
-				removeentry(n);  /* and remove entry from table */
-			}
+static GCObject *popdeque (GCMarker *m) {
+	long b = m->bottom - 1;
+	long t;
+	GCObject *o = NULL;
+	__atomic_store_n(&m->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&m->top, __ATOMIC_RELAXED);
+	if (t <= b) {  /* deque not empty? */
+		o = __atomic_load_n(&m->deque[b & (GCDEQUESIZE - 1)], __ATOMIC_RELAXED);
+		if (t == b) {  /* last element? */
+			if (!__atomic_compare_exchange_n(&m->top, &t, t + 1, 0,
+			                                 __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				o = NULL;  /* a thief got it */
+			__atomic_store_n(&m->bottom, b + 1, __ATOMIC_RELAXED);
 		}
 	}
+	else  /* deque was empty */
+		__atomic_store_n(&m->bottom, b + 1, __ATOMIC_RELAXED);
+	return o;
 }
 
 
-void luaC_upvdeccount (lua_State *L, UpVal *uv) {
-	lua_assert(uv->refcount > 0);
-	uv->refcount--;
-	if (uv->refcount == 0 && !upisopen(uv))
-		luaM_free(L, uv);
+static GCObject *stealdeque (GCMarker *m) {
+	long t = __atomic_load_n(&m->top, __ATOMIC_ACQUIRE);
+	long b;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&m->bottom, __ATOMIC_ACQUIRE);
+	if (t < b) {
+		GCObject *o = __atomic_load_n(&m->deque[t & (GCDEQUESIZE - 1)],
+		                              __ATOMIC_RELAXED);
+		if (__atomic_compare_exchange_n(&m->top, &t, t + 1, 0,
+		                                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			return o;
+	}
+	return NULL;  /* empty, or lost the race */
 }
 
 
-static void freeLclosure (lua_State *L, LClosure *cl) {
-	int i;
-	for (i = 0; i < cl->nupvalues; i++) {
-		UpVal *uv = cl->upvals[i];
-		if (uv)
-			luaC_upvdeccount(L, uv);
+/*
+** Get next gray object of marker 'm'. When its deque is empty, refill
+** it from the overflow list, so that the other markers can steal them.
+*/
+static GCObject *popgray (GCMarker *m) {
+	GCObject *o = popdeque(m);
+	if (o == NULL && (o = m->overflow) != NULL) {
+		int n;
+		m->overflow = *getgclist(o);
+		for (n = 0; n < GCDEQUESIZE / 2 && m->overflow != NULL; n++) {
+			GCObject *o1 = m->overflow;
+			m->overflow = *getgclist(o1);
+			pushgray(m, o1);
+		}
 	}
-	luaM_freemem(L, cl, sizeLclosure(cl->nupvalues));
+	return o;
 }
 
 
-static void freeobj (lua_State *L, GCObject *o) {
-	switch (o->tt)
-	{
-		case LUA_TPROTO: luaF_freeproto(L, gco2p(o)); break;
-		case LUA_TLCL:
-						 {
-							 freeLclosure(L, gco2lcl(o));
-							 break;
-						 }
-		case LUA_TCCL:
-						 {
-							 luaM_freemem(L, o, sizeCclosure(gco2ccl(o)->nupvalues));
-							 break;
-						 }
-		case LUA_TTABLE: luaH_free(L, gco2t(o)); break;
-		case LUA_TTHREAD: luaE_freethread(L, gco2th(o)); break;
-		case LUA_TUSERDATA: luaM_freemem(L, o, sizeudata(gco2u(o))); break;
-		case LUA_TSHRSTR:
-							luaS_remove(L, gco2ts(o));  /* remove it from hash table */
-							luaM_freemem(L, o, sizelstring(gco2ts(o)->shrlen));
-							break;
-		case LUA_TLNGSTR:
-							{
-								luaM_freemem(L, o, sizelstring(gco2ts(o)->u.lnglen));
-								break;
-							}
-		default: lua_assert(0);
+static GCObject *stealgray (GCMarkers *ms, GCMarker *m) {
+	int i;
+	int self = cast_int(m - ms->m);
+	for (i = 1; i < ms->nmarkers; i++) {
+		GCObject *o = stealdeque(&ms->m[(self + i) % ms->nmarkers]);
+		if (o != NULL) return o;
 	}
+	return NULL;
 }
 
 
-#define sweepwholelist(L,p)	sweeplist(L,p,MAX_LUMEM)
-static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count);
-
+static int hasloot (GCMarkers *ms) {
+	int i;
+	for (i = 0; i < ms->nmarkers; i++) {
+		GCMarker *m = &ms->m[i];
+		if (__atomic_load_n(&m->top, __ATOMIC_ACQUIRE) <
+		    __atomic_load_n(&m->bottom, __ATOMIC_ACQUIRE))
+			return 1;
+	}
+	return 0;
+}
 
-/**
- * sweep at most 'count' elements from a list of GCObjects erasing dead
- * objects, where a dead object is one marked with the old (non current)
- * white; change all non-dead objects back to white, preparing for next
- * collection cycle. Return where to continue the traversal or NULL if
- * list is finished.
- */
-static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
-	global_State *g = G(L);
-	int ow = otherwhite(g);		//本次GC操作不可以被回收的白色类型。
-	int white = luaC_white(g);  /* current white */
 
-	/**
-	 * 依次遍历链表中的数据，判断每个对象的白色是否满足被回收的颜色条件
-	 */
-	while (*p != NULL && count-- > 0) {
-		GCObject *curr = *p;
-		int marked = curr->marked;
-		if (isdeadm(ow, marked)) {  /* is 'curr' dead? */
-			*p = curr->next;  /* remove 'curr' from list */
-			freeobj(L, curr);  /* erase 'curr' */
-		}
-		else {  /* change mark to 'white' */
-			curr->marked = cast_byte((marked & maskcolors) | white);
-			p = &curr->next;  /* go to next element */
+/*
+** Mark until there are no gray objects left in any marker. A marker
+** only gets idle when it has no objects of its own, and it counts
+** itself as active again before stealing; so, all deques are empty
+** once 'active' gets to zero.
+*/
+static void markloop (global_State *g, GCMarkers *ms, GCMarker *m) {
+	for (;;) {
+		GCObject *o;
+		while ((o = popgray(m)) != NULL || (o = stealgray(ms, m)) != NULL)
+			m->GCmemtrav += traversegray(g, o);
+		__atomic_sub_fetch(&ms->active, 1, __ATOMIC_SEQ_CST);
+		for (;;) {  /* idle */
+			if (__atomic_load_n(&ms->active, __ATOMIC_SEQ_CST) == 0)
+				return;  /* marking is done */
+			if (hasloot(ms)) {
+				__atomic_add_fetch(&ms->active, 1, __ATOMIC_SEQ_CST);
+				break;  /* try to steal it */
+			}
+			sched_yield();
 		}
 	}
-	return (*p == NULL) ? NULL : p;
 }
 
 
-/*
- ** sweep a list until a live object (or end of list)
- */
-static GCObject **sweeptolive (lua_State *L, GCObject **p) {
-	GCObject **old = p;
-	do {
-		p = sweeplist(L, p, 1);
-	} while (p == old);
-	return p;
+static void *helpermain (void *ud) {
+	GCMarker *m = cast(GCMarker *, ud);
+	GCMarkers *ms = m->ms;
+	unsigned long round = 0;
+	gcmarker = m;
+	pthread_mutex_lock(&ms->lock);
+	for (;;) {
+		while (ms->round == round && !ms->quit)
+			pthread_cond_wait(&ms->wake, &ms->lock);
+		if (ms->quit) break;
+		round = ms->round;
+		pthread_mutex_unlock(&ms->lock);
+		markloop(ms->g, ms, m);
+		pthread_mutex_lock(&ms->lock);
+		if (++ms->finished == ms->nmarkers - 1)
+			pthread_cond_signal(&ms->done);
+	}
+	pthread_mutex_unlock(&ms->lock);
+	return NULL;
 }
 
-/* }====================================================== */
+
+static void freemarkers (global_State *g) {
+	GCMarkers *ms = g->gcmarkers;
+	if (ms == NULL) return;
+	if (ms->nmarkers > 1) {
+		int i;
+		pthread_mutex_lock(&ms->lock);
+		ms->quit = 1;
+		pthread_cond_broadcast(&ms->wake);
+		pthread_mutex_unlock(&ms->lock);
+		for (i = 1; i < ms->nmarkers; i++)
+			pthread_join(ms->m[i].thread, NULL);
+		pthread_cond_destroy(&ms->done);
+		pthread_cond_destroy(&ms->wake);
+		pthread_mutex_destroy(&ms->lock);
+	}
+	if (ms->m != NULL)
+		gcrealloc(g, ms->m, LUAI_GCMAXTHREADS * sizeof(GCMarker), 0);
+	gcrealloc(g, ms, sizeof(GCMarkers), 0);
+	g->gcmarkers = NULL;
+}
+
+
+/*
+** Start helper threads. When their memory (or anything else) is not
+** available, the pool is left with a single marker and the collector
+** marks alone.
+*/
+static void startmarkers (global_State *g, GCMarkers *ms) {
+	int n = luai_ncpus();
+	int i;
+	sigset_t all, old;
+	if (n > g->gcthreads) n = g->gcthreads;
+	if (n < 2) return;  /* nobody to help */
+	ms->m = cast(GCMarker *, gcrealloc(g, NULL, 0,
+	                                   LUAI_GCMAXTHREADS * sizeof(GCMarker)));
+	if (ms->m == NULL) return;
+	memset(ms->m, 0, LUAI_GCMAXTHREADS * sizeof(GCMarker));
+	if (pthread_mutex_init(&ms->lock, NULL) != 0) return;
+	if (pthread_cond_init(&ms->wake, NULL) != 0) {
+		pthread_mutex_destroy(&ms->lock);
+		return;
+	}
+	if (pthread_cond_init(&ms->done, NULL) != 0) {
+		pthread_cond_destroy(&ms->wake);
+		pthread_mutex_destroy(&ms->lock);
+		return;
+	}
+	ms->m[0].ms = ms;
+	sigfillset(&all);  /* signals are for the threads running Lua */
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (i = 1; i < n; i++) {
+		ms->m[i].ms = ms;
+		if (pthread_create(&ms->m[i].thread, NULL, helpermain, &ms->m[i]) != 0)
+			break;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	ms->nmarkers = i;
+	if (i == 1) {  /* could not start any helper? */
+		pthread_cond_destroy(&ms->done);
+		pthread_cond_destroy(&ms->wake);
+		pthread_mutex_destroy(&ms->lock);
+	}
+}
+
+
+/*
+** Get the pool of markers, creating it in the first parallel mark of an
+** atomic phase (or full collection). Returns NULL if there are no
+** helpers to mark in parallel. The helpers are stopped when that phase
+** ends (see 'runatomic'), so that idle states keep no threads and a
+** process may fork between collections.
+*/
+static GCMarkers *getmarkers (global_State *g) {
+	GCMarkers *ms = g->gcmarkers;
+	if (ms == NULL) {
+		if (g->gckind == KGC_EMERGENCY)
+			return NULL;  /* do not try to allocate now */
+		ms = cast(GCMarkers *, gcrealloc(g, NULL, 0, sizeof(GCMarkers)));
+		if (ms == NULL) return NULL;
+		memset(ms, 0, sizeof(GCMarkers));
+		ms->g = g;
+		ms->nmarkers = 1;
+		g->gcmarkers = ms;
+		startmarkers(g, ms);
+	}
+	return (ms->nmarkers > 1) ? ms : NULL;
+}
+
+
+/* append list 'l' of a marker to collector list 'p' */
+static void appendgclist (GCObject **p, GCObject *l) {
+	if (l != NULL) {
+		GCObject *last = l;
+		while (*getgclist(last) != NULL)
+			last = *getgclist(last);
+		*getgclist(last) = *p;
+		*p = l;
+	}
+}
+
+
+static void mergemarker (global_State *g, GCMarker *m) {
+	lua_assert(m->top == m->bottom && m->overflow == NULL);
+	appendgclist(&g->grayagain, m->grayagain);
+	appendgclist(&g->weak, m->weak);
+	appendgclist(&g->ephemeron, m->ephemeron);
+	appendgclist(&g->allweak, m->allweak);
+	if (m->twups != NULL) {
+		lua_State *last = m->twups;
+		while (last->twups != NULL)
+			last = last->twups;
+		last->twups = g->twups;
+		g->twups = m->twups;
+	}
+	g->GCmemtrav += m->GCmemtrav;
+	m->grayagain = m->weak = m->ephemeron = m->allweak = NULL;
+	m->twups = NULL;
+	m->GCmemtrav = 0;
+}
+
+
+/*
+** Propagate marks from all objects in the gray list with all markers:
+** deal the gray objects among the markers, wake the helpers, mark
+** with them, and then wait for them to finish.
+*/
+static void parallelmark (global_State *g, GCMarkers *ms) {
+	int i = 0;
+	GCObject *o;
+	while ((o = g->gray) != NULL) {
+		g->gray = *getgclist(o);
+		pushgray(&ms->m[i], o);
+		i = (i + 1) % ms->nmarkers;
+	}
+	ms->active = ms->nmarkers;
+	pthread_mutex_lock(&ms->lock);
+	ms->finished = 0;
+	ms->round++;
+	pthread_cond_broadcast(&ms->wake);
+	pthread_mutex_unlock(&ms->lock);
+	gcmarker = &ms->m[0];
+	markloop(g, ms, gcmarker);
+	gcmarker = NULL;
+	pthread_mutex_lock(&ms->lock);
+	while (ms->finished < ms->nmarkers - 1)
+		pthread_cond_wait(&ms->done, &ms->lock);
+	pthread_mutex_unlock(&ms->lock);
+	for (i = 0; i < ms->nmarkers; i++)
+		mergemarker(g, &ms->m[i]);
+}
+
+/* }====================================================== */
+
+#else
+
+#define freemarkers(g)	((void)0)
+
+#endif
+
+
+static void propagateall (global_State *g) {
+#if LUAI_GCPTHREADS && LUAI_GCMAXTHREADS > 1
+	GCMarkers *ms;
+	if (g->gray != NULL && g->gcthreads > 1 &&
+	    gettotalbytes(g) >= LUAI_GCPARMIN && (ms = getmarkers(g)) != NULL) {
+		parallelmark(g, ms);
+		return;
+	}
+#endif
+	while (g->gray) propagatemark(g);
+}
+
+
+/**
+*/
+static void convergeephemerons (global_State *g) {
+	int changed;	// 关键值，指示对 g->ephemeron 的一次遍历中是否有对象被重新mark
+	do {
+		GCObject *w;
+		GCObject *next = g->ephemeron;  /* get ephemeron list */
+		g->ephemeron = NULL;  /* tables may return to this list when traversed */
+		changed = 0;
+		while ((w = next) != NULL) {
+			next = gco2t(w)->gclist;
+			if (traverseephemeron(g, gco2t(w))) {  /* traverse marked some value? */
+				propagateall(g);  /* propagate changes */
+				changed = 1;  /* will have to revisit all ephemeron tables */
+			}
+		}
+	} while (changed);	// 无对象可 mark 时，退出
+}
+
+/* }====================================================== */
+
+
+/*
+ ** {======================================================
+ ** Background freeing
+ ** =======================================================
+ */
+
+/*
+** While sweeping with a background freer, 'luaM_realloc_' does not give
+** the blocks of dead objects back to the allocator: it passes them to
+** 'luaC_deferfree', which links them into a batch (reusing the dead
+** blocks themselves as list nodes). Sweeps hand full batches to the
+** freer thread, which calls the allocator to free them. The collector
+** still unlinks dead objects and flips their colors by itself, and
+** counts their memory as freed at once; only the calls to the
+** allocator move to the other thread, so the allocator must be
+** thread safe.
+*/
+
+
+/* number of blocks in a batch worth handing to the freer */
+#define FREEBATCH	256
+
+
+/* a dead block waiting to be freed */
+typedef struct FreeBlock {
+	struct FreeBlock *next;
+	size_t size;
+} FreeBlock;
+
+
+#if LUAI_GCPTHREADS
+
+typedef struct GCFreer {
+	FreeBlock *batch;  /* blocks being collected by the sweep */
+	FreeBlock *batchlast;  /* last block in 'batch' */
+	int nbatch;  /* number of blocks in 'batch' */
+	int busy;  /* true while the freer frees some blocks */
+	int quit;  /* true when the freer must exit */
+	FreeBlock *queue;  /* blocks handed to the freer */
+	lua_Alloc frealloc;  /* allocator (and its data) used by the freer */
+	void *ud;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t work;  /* freer waits here for blocks */
+	pthread_cond_t idle;  /* collector waits here for the freer */
+} GCFreer;
+
+
+static void *freermain (void *ud) {
+	GCFreer *fr = cast(GCFreer *, ud);
+	pthread_mutex_lock(&fr->lock);
+	for (;;) {
+		FreeBlock *b;
+		while (fr->queue == NULL && !fr->quit)
+			pthread_cond_wait(&fr->work, &fr->lock);
+		if (fr->queue == NULL) break;  /* quit (with nothing left to free) */
+		b = fr->queue;
+		fr->queue = NULL;
+		fr->busy = 1;
+		pthread_mutex_unlock(&fr->lock);
+		while (b != NULL) {
+			FreeBlock *next = b->next;
+			(*fr->frealloc)(fr->ud, b, b->size, 0);
+			b = next;
+		}
+		pthread_mutex_lock(&fr->lock);
+		fr->busy = 0;
+		pthread_cond_broadcast(&fr->idle);
+	}
+	pthread_mutex_unlock(&fr->lock);
+	return NULL;
+}
+
+
+/*
+** Hand the current batch to the freer, if it is large enough or if
+** 'force' is true
+*/
+static void sendfrees (global_State *g, int force) {
+	GCFreer *fr = g->gcfreer;
+	g->deferfree = 0;
+	if (fr != NULL && fr->batch != NULL && (force || fr->nbatch >= FREEBATCH)) {
+		pthread_mutex_lock(&fr->lock);
+		fr->batchlast->next = fr->queue;
+		fr->queue = fr->batch;
+		pthread_cond_signal(&fr->work);
+		pthread_mutex_unlock(&fr->lock);
+		fr->batch = fr->batchlast = NULL;
+		fr->nbatch = 0;
+	}
+}
+
+
+/*
+** Wait until the freer has freed everything handed to it
+*/
+static void waitfreer (global_State *g) {
+	GCFreer *fr = g->gcfreer;
+	if (fr != NULL) {
+		sendfrees(g, 1);
+		pthread_mutex_lock(&fr->lock);
+		while (fr->queue != NULL || fr->busy)
+			pthread_cond_wait(&fr->idle, &fr->lock);
+		pthread_mutex_unlock(&fr->lock);
+	}
+}
+
+
+void luaC_deferfree (global_State *g, void *block, size_t size) {
+	GCFreer *fr = g->gcfreer;
+	if (size < sizeof(FreeBlock))  /* too small to be linked? */
+		(*g->frealloc)(g->ud, block, size, 0);  /* free it now */
+	else {
+		FreeBlock *b = cast(FreeBlock *, block);
+		b->next = fr->batch;
+		b->size = size;
+		if (fr->batch == NULL) fr->batchlast = b;
+		fr->batch = b;
+		fr->nbatch++;
+	}
+}
+
+
+static void stopfreer (global_State *g) {
+	GCFreer *fr = g->gcfreer;
+	if (fr != NULL) {
+		sendfrees(g, 1);
+		pthread_mutex_lock(&fr->lock);
+		fr->quit = 1;
+		pthread_cond_signal(&fr->work);
+		pthread_mutex_unlock(&fr->lock);
+		pthread_join(fr->thread, NULL);  /* it frees all pending blocks */
+		pthread_cond_destroy(&fr->idle);
+		pthread_cond_destroy(&fr->work);
+		pthread_mutex_destroy(&fr->lock);
+		g->gcfreer = NULL;
+		gcrealloc(g, fr, sizeof(GCFreer), 0);
+	}
+}
+
+
+/*
+** Start a freer thread. Leaves 'g->gcfreer' NULL on failures.
+*/
+static void startfreer (global_State *g) {
+	sigset_t all, old;
+	int ok;
+	GCFreer *fr = cast(GCFreer *, gcrealloc(g, NULL, 0, sizeof(GCFreer)));
+	if (fr == NULL) return;
+	memset(fr, 0, sizeof(GCFreer));
+	fr->frealloc = g->frealloc;
+	fr->ud = g->ud;
+	if (pthread_mutex_init(&fr->lock, NULL) != 0) goto fail0;
+	if (pthread_cond_init(&fr->work, NULL) != 0) goto fail1;
+	if (pthread_cond_init(&fr->idle, NULL) != 0) goto fail2;
+	sigfillset(&all);  /* signals are for the threads running Lua */
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ok = (pthread_create(&fr->thread, NULL, freermain, fr) == 0);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ok) {
+		g->gcfreer = fr;
+		return;
+	}
+	pthread_cond_destroy(&fr->idle);
+fail2:
+	pthread_cond_destroy(&fr->work);
+fail1:
+	pthread_mutex_destroy(&fr->lock);
+fail0:
+	gcrealloc(g, fr, sizeof(GCFreer), 0);
+}
+
+
+/*
+** Turn background freeing on or off; returns whether it was on.
+*/
+int luaC_bgfree (lua_State *L, int on) {
+	global_State *g = G(L);
+	int old = (g->gcfreer != NULL);
+	if (on && !old)
+		startfreer(g);
+	else if (!on && old)
+		stopfreer(g);
+	return old;
+}
+
+#else
+
+#define sendfrees(g,f)	((void)0)
+#define waitfreer(g)	((void)0)
+#define stopfreer(g)	((void)0)
+
+
+void luaC_deferfree (global_State *g, void *block, size_t size) {
+	(*g->frealloc)(g->ud, block, size, 0);  /* never called */
+}
+
+
+int luaC_bgfree (lua_State *L, int on) {
+	UNUSED(L); UNUSED(on);
+	return 0;  /* not available */
+}
+
+#endif
+
+/* }====================================================== */
+
+
+/*
+ ** {======================================================
+ ** Sweep Functions
+ ** =======================================================
+ */
+
+
+/*
+ ** clear entries with unmarked keys from all weaktables in list 'l' up
+ ** to element 'f'
+ */
+static void clearkeys (global_State *g, GCObject *l, GCObject *f) {
+	for (; l != f; l = gco2t(l)->gclist) {
+		Table *h = gco2t(l);
+		Node *n, *limit;
+		int p;
+		fornodes(h, p, n, limit) {
+			if (!ttisnil(gval(n)) && (iscleared(g, gkey(n)))) {
+				setnilvalue(gval(n));  /* remove value ... */
+			}
+			if (ttisnil(gval(n)))  /* is entry empty? */
+				removeentry(n);  /* remove entry from table */
+		}
+	}
+}
+
+
+/*
+ ** clear entries with unmarked values from all weaktables in list 'l' up
+ ** to element 'f'
+ */
+static void clearvalues (global_State *g, GCObject *l, GCObject *f) {
+	for (; l != f; l = gco2t(l)->gclist) {
+		Table *h = gco2t(l);
+		Node *n, *limit;
+		int p;
+		unsigned int i;
+		for (i = 0; i < h->sizearray; i++) {
+			TValue *o = &h->array[i];
+			if (iscleared(g, o))  /* value was collected? */
+				setnilvalue(o);  /* remove value */
+		}
+		if (h->shape) {
+			int j;
+			for (j = 0; j < h->shape->nkeys; j++) {
+				TValue *o = &h->slots[j];
+				if (iscleared(g, o))  /* value was collected? */
+					setnilvalue(o);  /* remove value */
+			}
+		}
+		fornodes(h, p, n, limit) {
+			if (!ttisnil(gval(n)) && iscleared(g, gval(n))) {
+				setnilvalue(gval(n));  /* remove value ... */
+				removeentry(n);  /* and remove entry from table */
+			}
+		}
+	}
+}
+
+
+void luaC_upvdeccount (lua_State *L, UpVal *uv) {
+	lua_assert(uv->refcount > 0);
+	uv->refcount--;
+	if (uv->refcount == 0 && !upisopen(uv))
+		luaM_free(L, uv);
+}
+
+
+static void freeLclosure (lua_State *L, LClosure *cl) {
+	int i;
+	for (i = 0; i < cl->nupvalues; i++) {
+		UpVal *uv = cl->upvals[i];
+		if (uv)
+			luaC_upvdeccount(L, uv);
+	}
+	luaM_freemem(L, cl, sizeLclosure(cl->nupvalues));
+}
+
+
+static void freeobj (lua_State *L, GCObject *o) {
+	luaC_dropid(G(L), o);
+	switch (o->tt)
+	{
+		case LUA_TPROTO: luaF_freeproto(L, gco2p(o)); break;
+		case LUA_TLCL:
+						 {
+							 freeLclosure(L, gco2lcl(o));
+							 break;
+						 }
+		case LUA_TCCL:
+						 {
+							 luaM_freemem(L, o, sizeCclosure(gco2ccl(o)->nupvalues));
+							 break;
+						 }
+		case LUA_TTABLE: luaH_free(L, gco2t(o)); break;
+		case LUA_TTHREAD: luaE_freethread(L, gco2th(o)); break;
+		case LUA_TUSERDATA: luaM_freemem(L, o, sizeudata(gco2u(o))); break;
+		case LUA_TSHRSTR:
+							luaS_remove(L, gco2ts(o));  /* remove it from hash table */
+							luaM_freemem(L, o, sizelstring(gco2ts(o)->shrlen));
+							break;
+		case LUA_TLNGSTR:
+							{
+								luaS_freelngstr(L, gco2ts(o));
+								break;
+							}
+		default: lua_assert(0);
+	}
+}
+
+
+#define sweepwholelist(L,p)	sweeplist(L,p,MAX_LUMEM)
+
+/* type under which an object is counted in the statistics */
+#define stattype(o)  \
+	(((o)->tt == LUA_TPROTO) ? LUA_TFUNCTION : novariant((o)->tt))
+static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count);
+
+
+/**
+ * sweep at most 'count' elements from a list of GCObjects erasing dead
+ * objects, where a dead object is one marked with the old (non current)
+ * white; change all non-dead objects back to white, preparing for next
+ * collection cycle. Return where to continue the traversal or NULL if
+ * list is finished.
+ */
+static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
+	global_State *g = G(L);
+	int ow = otherwhite(g);		//本次GC操作不可以被回收的白色类型。
+	int white = luaC_white(g);  /* current white */
+	lu_mem before = gettotalbytes(g);
+	g->deferfree = (g->gcfreer != NULL);  /* give dead blocks to the freer */
+
+	/**
+	 * 依次遍历链表中的数据，判断每个对象的白色是否满足被回收的颜色条件
+	 */
+	while (*p != NULL && count-- > 0) {
+		GCObject *curr = *p;
+		int marked = curr->marked;
+		if (isdeadm(ow, marked)) {  /* is 'curr' dead? */
+			*p = curr->next;  /* remove 'curr' from list */
+			g->gcstats.swept[stattype(curr)]++;
+			freeobj(L, curr);  /* erase 'curr' */
+		}
+		else {  /* change mark to 'white' */
+			if (!testbits(marked, WHITEBITS))  /* marked in this cycle? */
+				g->gcstats.marked[stattype(curr)]++;
+			curr->marked = cast_byte((marked & maskcolors) | white);
+			p = &curr->next;  /* go to next element */
+		}
+	}
+	g->gcstats.freedbytes += before - gettotalbytes(g);
+	sendfrees(g, 0);
+	return (*p == NULL) ? NULL : p;
+}
+
+
+/*
+ ** sweep a list until a live object (or end of list)
+ */
+static GCObject **sweeptolive (lua_State *L, GCObject **p) {
+	GCObject **old = p;
+	do {
+		p = sweeplist(L, p, 1);
+	} while (p == old);
+	return p;
+}
+
+/* }====================================================== */
+
+
+/*
+ ** {======================================================
+ ** Finalization
+ ** =======================================================
+ */
+
+/*
+ ** If possible, shrink string table
+ */
+static void checkSizes (lua_State *L, global_State *g) {
+	if (g->gckind != KGC_EMERGENCY) {
+		l_mem olddebt = g->GCdebt;
+		if (g->strt.nuse < g->strt.size / 4)  /* string table too big? */
+			luaS_resize(L, g->strt.size / 2);  /* shrink it a little */
+		g->GCestimate += g->GCdebt - olddebt;  /* update estimate */
+	}
+}
+
+
+static GCObject *udata2finalize (global_State *g) {
+	GCObject *o = g->tobefnz;  /* get first element */
+	lua_assert(tofinalize(o));
+	g->tobefnz = o->next;  /* remove it from 'tobefnz' list */
+	o->next = g->allgc;  /* return it to 'allgc' list */
+	g->allgc = o;
+	resetbit(o->marked, FINALIZEDBIT);  /* object is "normal" again */
+	resetoldbit(o);  /* young objects come first in a list */
+	if (issweepphase(g))
+		makewhite(g, o);  /* "sweep" object */
+	return o;
+}
+
+
+static void dothecall (lua_State *L, void *ud) {
+	UNUSED(ud);
+	luaD_callnoyield(L, L->top - 2, 0);
+}
+
+
+/**
+ * 循环遍历tmudata链表中的对象，针对每个对象调用fasttm函数，其中会使用GC元方法来进行对象的回收
+ */
+static void GCTM (lua_State *L, int propagateerrors) {
+	global_State *g = G(L);
+	const TValue *tm;
+	TValue v;
+	setgcovalue(L, &v, udata2finalize(g));
+	tm = luaT_gettmbyobj(L, &v, TM_GC);
+	if (tm != NULL && ttisfunction(tm)) {  /* is there a finalizer? */
+		int status;
+		lu_byte oldah = L->allowhook;
+		int running  = g->gcrunning;
+		g->gcstats.finalizers++;
+		L->allowhook = 0;  /* stop debug hooks during GC metamethod */
+		g->gcrunning = 0;  /* avoid GC steps */
+		setobj2s(L, L->top, tm);  /* push finalizer... */
+		setobj2s(L, L->top + 1, &v);  /* ... and its argument */
+		L->top += 2;  /* and (next line) call the finalizer */
+		L->ci->callstatus |= CIST_FIN;  /* will run a finalizer */
+		status = luaD_pcall(L, dothecall, NULL, savestack(L, L->top - 2), 0);
+		L->ci->callstatus &= ~CIST_FIN;  /* not running a finalizer anymore */
+		L->allowhook = oldah;  /* restore hooks */
+		g->gcrunning = running;  /* restore state */
+		if (status != LUA_OK && propagateerrors) {  /* error while running __gc? */
+			if (status == LUA_ERRRUN) {  /* is there an error object? */
+				const char *msg = (ttisstring(L->top - 1))
+					? svalue(L->top - 1)
+					: "no message";
+				luaO_pushfstring(L, "error in __gc metamethod (%s)", msg);
+				status = LUA_ERRGCMM;  /* error in __gc metamethod */
+			}
+			luaD_throw(L, status);  /* re-throw error */
+		}
+	}
+}
+
+
+/*
+ ** call a few (up to 'g->gcfinnum') finalizers
+ */
+static int runafewfinalizers (lua_State *L) {
+	global_State *g = G(L);
+	unsigned int i;
+	lua_assert(!g->tobefnz || g->gcfinnum > 0);
+	for (i = 0; g->tobefnz && i < g->gcfinnum; i++)
+		GCTM(L, 1);  /* call one finalizer */
+	g->gcfinnum = (!g->tobefnz) ? 0  /* nothing more to finalize? */
+		: g->gcfinnum * 2;  /* else call a few more next time */
+	return i;
+}
+
+
+/*
+ ** call all pending finalizers
+ */
+static void callallpendingfinalizers (lua_State *L) {
+	global_State *g = G(L);
+	while (g->tobefnz)
+		GCTM(L, 0);
+}
+
+
+/*
+ ** call all pending finalizers, propagating their errors (generational
+ ** mode runs them after each collection)
+ */
+static void runallfinalizers (lua_State *L) {
+	global_State *g = G(L);
+	while (g->tobefnz)
+		GCTM(L, 1);
+}
+
+
+/*
+ ** find last 'next' field in list 'p' list (to add elements in its end)
+ */
+static GCObject **findlast (GCObject **p) {
+	while (*p != NULL)
+		p = &(*p)->next;
+	return p;
+}
+
+
+/**
+ * move all unreachable objects (or 'all' objects) that need
+ * finalization from list 'finobj' to list 'tobefnz' (to be finalized)
+ * 将所有不再存活的对象从finobj链表移到tobefnz链表等待调用
+ * 此时会遍历整个 finobj 链表, 因此如果系统中存在太多带有 finalizer 的对象可能在这里会有效率问题
+ */
+static void separatetobefnz (global_State *g, int all) {
+	GCObject *curr;
+	GCObject **p = &g->finobj;
+	GCObject **lastnext = findlast(&g->tobefnz);
+	while ((curr = *p) != NULL) {  /* traverse all finalizable objects */
+		lua_assert(tofinalize(curr));
+		if (!(iswhite(curr) || all))  /* not being collected? */
+			p = &curr->next;  /* don't bother with it */
+		else {
+			*p = curr->next;  /* remove 'curr' from 'finobj' list */
+			curr->next = *lastnext;  /* link at the end of 'tobefnz' list */
+			*lastnext = curr;
+			lastnext = &curr->next;
+		}
+	}
+}
+
+
+/*
+ ** if object 'o' has a finalizer, remove it from 'allgc' list (must
+ ** search the list to find it) and link it in 'finobj' list.
+ */
+void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
+	global_State *g = G(L);
+	if (tofinalize(o) ||                 /* obj. is already marked... */
+			gfasttm(g, mt, TM_GC) == NULL)   /* or has no finalizer? */
+		return;  /* nothing to be done */
+	else {  /* move 'o' to 'finobj' list */
+		GCObject **p;
+		if (issweepphase(g)) {
+			makewhite(g, o);  /* "sweep" object 'o' */
+			if (g->sweepgc == &o->next)  /* should not remove 'sweepgc' object */
+				g->sweepgc = sweeptolive(L, g->sweepgc);  /* change 'sweepgc' */
+		}
+		/* search for pointer pointing to 'o' */
+		for (p = &g->allgc; *p != o; p = &(*p)->next) { /* empty */ }
+		*p = o->next;  /* remove 'o' from 'allgc' list */
+		o->next = g->finobj;  /* link it in 'finobj' list */
+		g->finobj = o;
+		l_setbit(o->marked, FINALIZEDBIT);  /* mark it as such */
+		resetoldbit(o);  /* young objects come first in a list */
+	}
+}
+
+/* }====================================================== */
+
 
 
 /*
  ** {======================================================
- ** Finalization
+ ** Statistics
  ** =======================================================
  */
 
 /*
- ** If possible, shrink string table
+ ** clock for timed steps and statistics, in microseconds (only
+ ** differences between two readings are used)
  */
-static void checkSizes (lua_State *L, global_State *g) {
-	if (g->gckind != KGC_EMERGENCY) {
-		l_mem olddebt = g->GCdebt;
-		if (g->strt.nuse < g->strt.size / 4)  /* string table too big? */
-			luaS_resize(L, g->strt.size / 2);  /* shrink it a little */
-		g->GCestimate += g->GCdebt - olddebt;  /* update estimate */
+#if !defined(luai_gcclock)
+#if defined(LUA_USE_POSIX) && defined(CLOCK_MONOTONIC)
+static lu_mem posixclock (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return cast(lu_mem, ts.tv_sec) * 1000000u + cast(lu_mem, ts.tv_nsec / 1000);
+}
+#define luai_gcclock()	posixclock()
+#else
+#define luai_gcclock()	cast(lu_mem, (double)clock() * 1e6 / CLOCKS_PER_SEC)
+#endif
+#endif
+
+
+/*
+ ** charge the time since the last clock reading to the current phase;
+ ** the clock is read when the collector starts some work ('starttime'),
+ ** when it changes phase and when it stops
+ */
+static void chargetime (global_State *g) {
+	lu_mem now = luai_gcclock();
+	int s = (g->gcstate == GCSinsideatomic) ? GCSatomic : g->gcstate;
+	g->gcstats.phasetime[s] += now - g->gcclock;
+	g->gcclock = now;
+}
+
+#define starttime(g)	((g)->gcclock = luai_gcclock())
+
+
+/*
+ ** move the collector to phase 's', telling the phase callback
+ */
+static void setphase (global_State *g, int s) {
+	int from = (g->gcstate == GCSinsideatomic) ? GCSatomic : g->gcstate;
+	chargetime(g);
+	g->gcstate = cast_byte(s);
+	if (from == GCScallfin && s == GCSpause)
+		g->gcstats.cycles++;
+	if (g->gcphasef != NULL && from != s)
+		g->gcphasef(g->gcphaseud, from, s);
+}
+
+
+/*
+** a long string with its bytes in a 'StrBuff' is charged with an
+** equal share of the buffer
+*/
+static lu_mem lngstrsize (TString *ts) {
+	if (isbuffstr(ts)) {
+		StrBuff *b = getbuff(ts);
+		return sizebuffstr + (sizeof(StrBuff) + b->size) / b->refs;
+	}
+	else
+		return sizelstring(ts->u.lnglen);
+}
+
+
+static lu_mem objsize (GCObject *o) {
+	switch (o->tt) {
+		case LUA_TSHRSTR: return sizelstring(gco2ts(o)->shrlen);
+		case LUA_TLNGSTR: return lngstrsize(gco2ts(o));
+		case LUA_TTABLE: return tablesize(gco2t(o));
+		case LUA_TLCL: return sizeLclosure(gco2lcl(o)->nupvalues);
+		case LUA_TCCL: return sizeCclosure(gco2ccl(o)->nupvalues);
+		case LUA_TUSERDATA: return sizeudata(gco2u(o));
+		case LUA_TTHREAD: return threadsize(gco2th(o));
+		case LUA_TPROTO: return protosize(gco2p(o));
+		default: lua_assert(0); return 0;
+	}
+}
+
+
+static void countlist (global_State *g, GCObject *o,
+		lu_mem *count, lu_mem *bytes) {
+	for (; o != NULL; o = o->next) {
+		if (!(issweepphase(g) && isdead(g, o))) {  /* not known garbage? */
+			count[novariant(o->tt)]++;
+			bytes[novariant(o->tt)] += objsize(o);
+		}
+	}
+}
+
+
+/*
+ ** count the objects of each type (by basic type tag, with prototypes
+ ** apart) and the memory they use; objects already known to be dead
+ ** are left out, but garbage not found by a cycle yet is counted
+ */
+void luaC_memusage (global_State *g, lu_mem *count, lu_mem *bytes) {
+	int i;
+	for (i = 0; i < LUA_TOTALTAGS; i++)
+		count[i] = bytes[i] = 0;
+	countlist(g, g->allgc, count, bytes);
+	countlist(g, g->finobj, count, bytes);
+	countlist(g, g->tobefnz, count, bytes);
+	countlist(g, g->fixedgc, count, bytes);
+	count[LUA_TTHREAD]++;  /* main thread */
+	bytes[LUA_TTHREAD] += threadsize(g->mainthread);
+}
+
+
+/*
+ ** memory used by the threads kept for reuse (see 'luaE_freethread');
+ ** they are not objects anymore, so 'luaC_memusage' does not count them
+ */
+lu_mem luaC_poolusage (global_State *g) {
+	lu_mem bytes = 0;
+	GCObject *o;
+	for (o = g->threadpool; o != NULL; o = o->next)
+		bytes += threadsize(gco2th(o));
+	return bytes;
+}
+
+/* }====================================================== */
+
+
+
+/*
+ ** {======================================================
+ ** Heap snapshots
+ ** =======================================================
+ */
+
+/*
+ ** A snapshot is written as JSON lines, one object per line:
+ **   {"id":"N","type":"table","addr":"0x..","size":N,...,"refs":[["N","name"],...]}
+ ** The first line is a pseudo-object "root", whose references are the
+ ** roots of the collector. Reference names are table keys ("[1]" for
+ ** non-string keys), upvalue names or a tag in parentheses. Characters
+ ** that would need escapes ('"', '\' and controls) are written as
+ ** \u00XX, so that strings never contain quotes.
+ */
+
+#if !defined(LUAI_SNAPBUFF)
+#define LUAI_SNAPBUFF	1024
+#endif
+
+/* maximum number of bytes of strings written as names or values */
+#define SNAPSTRLEN	64
+
+typedef struct Snapshot {
+	lua_State *L;
+	lua_Writer writer;
+	void *data;
+	int status;
+	int nrefs;  /* references written for current object */
+	size_t n;  /* bytes in buffer */
+	char buff[LUAI_SNAPBUFF];
+} Snapshot;
+
+
+static void snapflush (Snapshot *S) {
+	if (S->status == 0 && S->n > 0) {
+		lua_unlock(S->L);
+		S->status = (*S->writer)(S->L, S->buff, S->n, S->data);
+		lua_lock(S->L);
+	}
+	S->n = 0;
+}
+
+
+static void snapwrite (Snapshot *S, const char *s, size_t l) {
+	while (l > 0) {
+		size_t m = LUAI_SNAPBUFF - S->n;
+		if (m == 0) {
+			snapflush(S);
+			m = LUAI_SNAPBUFF;
+		}
+		if (m > l) m = l;
+		memcpy(S->buff + S->n, s, m);
+		S->n += m;
+		s += m;
+		l -= m;
+	}
+}
+
+#define snaplit(S,s)	snapwrite(S, "" s, sizeof(s) - 1)
+
+
+static void snapstr (Snapshot *S, const char *s) {
+	snapwrite(S, s, strlen(s));
+}
+
+
+/* write string 's' (at most SNAPSTRLEN bytes of it) between quotes */
+static void snapquoted (Snapshot *S, const char *s, size_t l) {
+	size_t i;
+	if (l > SNAPSTRLEN) l = SNAPSTRLEN;
+	snaplit(S, "\"");
+	for (i = 0; i < l; i++) {
+		unsigned char c = cast(unsigned char, s[i]);
+		if (c < 0x20 || c == '"' || c == '\\' || c == 0x7f) {
+			char buff[8];
+			l_sprintf(buff, sizeof(buff), "\\u%04x", c);
+			snapwrite(S, buff, 6);
+		}
+		else
+			snapwrite(S, s + i, 1);
+	}
+	snaplit(S, "\"");
+}
+
+
+/*
+** Objects are named by serial numbers, which 'g->snapids' keeps (keyed
+** by address) from the first snapshot on. An object loses its id when
+** freed, so that a new object reusing its address gets another one:
+** the same id names the same object in all snapshots of a state.
+*/
+static void snapid (Snapshot *S, const void *p) {
+	lua_State *L = S->L;
+	global_State *g = G(L);
+	char buff[LUAI_MAXSHORTLEN];
+	TValue k;
+	const TValue *v;
+	setpvalue(&k, cast(void *, p));
+	v = luaH_get(g->snapids, &k);
+	if (ttisnil(v)) {  /* first time in a snapshot? */
+		TValue *nv = luaH_set(L, g->snapids, &k);  /* (may raise an error) */
+		setivalue(nv, ++g->snapserial);
+		v = nv;
+	}
+	l_sprintf(buff, sizeof(buff), LUA_INTEGER_FMT, ivalue(v));
+	snaplit(S, "\"");
+	snapstr(S, buff);
+	snaplit(S, "\"");
+}
+
+
+void luaC_dropid_ (global_State *g, GCObject *o) {
+	TValue k;
+	const TValue *v;
+	setpvalue(&k, o);
+	v = luaH_get(g->snapids, &k);
+	if (!ttisnil(v))
+		setnilvalue(cast(TValue *, v));  /* remove entry */
+}
+
+
+static void snapnum (Snapshot *S, const char *field, lu_mem n) {
+	char buff[LUAI_MAXSHORTLEN];
+	l_sprintf(buff, sizeof(buff), "%lu", cast(unsigned long, n));
+	snaplit(S, ",\"");
+	snapstr(S, field);
+	snaplit(S, "\":");
+	snapstr(S, buff);
+}
+
+
+static void snapbegin (Snapshot *S, const void *p, const char *type) {
+	snaplit(S, "{\"id\":");
+	if (p == NULL)
+		snaplit(S, "\"root\"");
+	else
+		snapid(S, p);
+	snaplit(S, ",\"type\":\"");
+	snapstr(S, type);
+	snaplit(S, "\"");
+	if (p != NULL) {
+		char buff[LUAI_MAXSHORTLEN];
+		int l = lua_pointer2str(buff, sizeof(buff), p);
+		snaplit(S, ",\"addr\":\"");
+		snapwrite(S, buff, l);
+		snaplit(S, "\"");
+	}
+}
+
+
+static void snaprefs (Snapshot *S) {
+	snaplit(S, ",\"refs\":[");
+	S->nrefs = 0;
+}
+
+
+static void snapend (Snapshot *S) {
+	snaplit(S, "]}\n");
+}
+
+
+/* write a reference to object 'o' named with 'l' bytes from 'name' */
+static void snapref (Snapshot *S, GCObject *o, const char *name, size_t l) {
+	if (o == NULL) return;
+	if (S->nrefs++ > 0) snaplit(S, ",");
+	snaplit(S, "[");
+	snapid(S, o);
+	snaplit(S, ",");
+	snapquoted(S, name, l);
+	snaplit(S, "]");
+}
+
+#define snapreflit(S,o,s)	snapref(S, o, "" s, sizeof(s) - 1)
+
+#define snapvalue(S,v,s) \
+	{ if (iscollectable(v)) snapreflit(S, gcvalue(v), s); }
+
+
+/* write a reference to value 'v' named after key 'k' */
+static void snapfield (Snapshot *S, const TValue *k, const TValue *v) {
+	char buff[LUAI_MAXSHORTLEN + 2];
+	if (!iscollectable(v)) return;
+	if (ttisstring(k))
+		snapref(S, gcvalue(v), svalue(k), vslen(k));
+	else {
+		if (ttisinteger(k))
+			l_sprintf(buff, sizeof(buff), "[" LUA_INTEGER_FMT "]",
+			          cast(LUAI_UACINT, ivalue(k)));
+		else if (ttisfloat(k))
+			l_sprintf(buff, sizeof(buff), "[" LUA_NUMBER_FMT "]",
+			          cast(LUAI_UACNUMBER, fltvalue(k)));
+		else if (ttisboolean(k))
+			l_sprintf(buff, sizeof(buff), "[%s]", bvalue(k) ? "true" : "false");
+		else
+			l_sprintf(buff, sizeof(buff), "[%s]", ttypename(ttnov(k)));
+		snapref(S, gcvalue(v), buff, strlen(buff));
+	}
+}
+
+
+/*
+ ** Tables follow 'traversetable': metatable, shape keys and slots,
+ ** array part and hash part (including nodes not moved yet from an
+ ** old hash). Weak tables are written with their mode, so that a
+ ** reader can discard their weak references.
+ */
+static void snaptable (Snapshot *S, global_State *g, Table *h) {
+	const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
+	unsigned int i;
+	Node *n, *limit;
+	int p;
+	snapbegin(S, h, "table");
+	snapnum(S, "size", tablesize(h));
+	if (mode && ttisstring(mode) &&
+			(strchr(svalue(mode), 'k') || strchr(svalue(mode), 'v'))) {
+		snaplit(S, ",\"weak\":\"");
+		if (strchr(svalue(mode), 'k')) snaplit(S, "k");
+		if (strchr(svalue(mode), 'v')) snaplit(S, "v");
+		snaplit(S, "\"");
+	}
+	snaprefs(S);
+	if (h->metatable)
+		snapreflit(S, obj2gco(h->metatable), "(metatable)");
+	if (h->shape) {
+		int j;
+		for (j = 0; j < h->shape->nkeys; j++) {
+			TString *key = h->shape->keys[j];
+			snapreflit(S, obj2gco(key), "(key)");
+			if (iscollectable(&h->slots[j]))
+				snapref(S, gcvalue(&h->slots[j]), getstr(key), tsslen(key));
+		}
+	}
+	for (i = 0; i < h->sizearray; i++) {
+		TValue k;
+		setivalue(&k, cast(lua_Integer, i) + 1);
+		snapfield(S, &k, &h->array[i]);
+	}
+	fornodes(h, p, n, limit) {
+		if (!ttisnil(gval(n))) {
+			const TValue *k = gkey(n);
+			if (iscollectable(k))
+				snapreflit(S, gcvalue(k), "(key)");
+			snapfield(S, k, gval(n));
+		}
+	}
+	snapend(S);
+}
+
+
+/* like 'traverseLclosure', plus the names of the upvalues */
+static void snapLclosure (Snapshot *S, LClosure *cl) {
+	int i;
+	snapbegin(S, cl, "function");
+	snapnum(S, "size", sizeLclosure(cl->nupvalues));
+	snaprefs(S);
+	snapreflit(S, obj2gco(cl->p), "(proto)");
+	for (i = 0; i < cl->nupvalues; i++) {
+		UpVal *uv = cl->upvals[i];
+		if (uv != NULL && iscollectable(uv->v)) {
+			TString *name = (i < cl->p->sizeupvalues) ? cl->p->upvalues[i].name
+			                                          : NULL;
+			if (name != NULL)
+				snapref(S, gcvalue(uv->v), getstr(name), tsslen(name));
+			else
+				snapreflit(S, gcvalue(uv->v), "(upvalue)");
+		}
 	}
+	snapend(S);
 }
 
 
-static GCObject *udata2finalize (global_State *g) {
-	GCObject *o = g->tobefnz;  /* get first element */
-	lua_assert(tofinalize(o));
-	g->tobefnz = o->next;  /* remove it from 'tobefnz' list */
-	o->next = g->allgc;  /* return it to 'allgc' list */
-	g->allgc = o;
-	resetbit(o->marked, FINALIZEDBIT);  /* object is "normal" again */
-	if (issweepphase(g))
-		makewhite(g, o);  /* "sweep" object */
-	return o;
+static void snapCclosure (Snapshot *S, CClosure *cl) {
+	int i;
+	snapbegin(S, cl, "function");
+	snapnum(S, "size", sizeCclosure(cl->nupvalues));
+	snaprefs(S);
+	for (i = 0; i < cl->nupvalues; i++)
+		snapvalue(S, &cl->upvalue[i], "(upvalue)");
+	snapend(S);
 }
 
 
-static void dothecall (lua_State *L, void *ud) {
-	UNUSED(ud);
-	luaD_callnoyield(L, L->top - 2, 0);
+static void snapudata (Snapshot *S, Udata *u) {
+	TValue uv;
+	snapbegin(S, u, "userdata");
+	snapnum(S, "size", sizeudata(u));
+	snaprefs(S);
+	if (u->metatable)
+		snapreflit(S, obj2gco(u->metatable), "(metatable)");
+	getuservalue(S->L, u, &uv);
+	snapvalue(S, &uv, "(uservalue)");
+	snapend(S);
 }
 
 
-/**
- * 循环遍历tmudata链表中的对象，针对每个对象调用fasttm函数，其中会使用GC元方法来进行对象的回收
- */
-static void GCTM (lua_State *L, int propagateerrors) {
-	global_State *g = G(L);
-	const TValue *tm;
-	TValue v;
-	setgcovalue(L, &v, udata2finalize(g));
-	tm = luaT_gettmbyobj(L, &v, TM_GC);
-	if (tm != NULL && ttisfunction(tm)) {  /* is there a finalizer? */
-		int status;
-		lu_byte oldah = L->allowhook;
-		int running  = g->gcrunning;
-		L->allowhook = 0;  /* stop debug hooks during GC metamethod */
-		g->gcrunning = 0;  /* avoid GC steps */
-		setobj2s(L, L->top, tm);  /* push finalizer... */
-		setobj2s(L, L->top + 1, &v);  /* ... and its argument */
-		L->top += 2;  /* and (next line) call the finalizer */
-		L->ci->callstatus |= CIST_FIN;  /* will run a finalizer */
-		status = luaD_pcall(L, dothecall, NULL, savestack(L, L->top - 2), 0);
-		L->ci->callstatus &= ~CIST_FIN;  /* not running a finalizer anymore */
-		L->allowhook = oldah;  /* restore hooks */
-		g->gcrunning = running;  /* restore state */
-		if (status != LUA_OK && propagateerrors) {  /* error while running __gc? */
-			if (status == LUA_ERRRUN) {  /* is there an error object? */
-				const char *msg = (ttisstring(L->top - 1))
-					? svalue(L->top - 1)
-					: "no message";
-				luaO_pushfstring(L, "error in __gc metamethod (%s)", msg);
-				status = LUA_ERRGCMM;  /* error in __gc metamethod */
-			}
-			luaD_throw(L, status);  /* re-throw error */
-		}
+/* like 'traversethread': live part of the stack */
+static void snapthread (Snapshot *S, lua_State *th) {
+	StkId o;
+	snapbegin(S, th, "thread");
+	snapnum(S, "size", threadsize(th));
+	snaprefs(S);
+	if (th->stack != NULL) {  /* stack already built? */
+		for (o = th->stack; o < th->top; o++)
+			snapvalue(S, o, "(stack)");
 	}
+	snapend(S);
 }
 
 
-/*
- ** call a few (up to 'g->gcfinnum') finalizers
- */
-static int runafewfinalizers (lua_State *L) {
-	global_State *g = G(L);
-	unsigned int i;
-	lua_assert(!g->tobefnz || g->gcfinnum > 0);
-	for (i = 0; g->tobefnz && i < g->gcfinnum; i++)
-		GCTM(L, 1);  /* call one finalizer */
-	g->gcfinnum = (!g->tobefnz) ? 0  /* nothing more to finalize? */
-		: g->gcfinnum * 2;  /* else call a few more next time */
-	return i;
+/* like 'traverseproto', plus where the function was defined */
+static void snapproto (Snapshot *S, Proto *f) {
+	char buff[LUAI_MAXSHORTLEN];
+	int i;
+	snapbegin(S, f, "proto");
+	snapnum(S, "size", protosize(f));
+	snaplit(S, ",\"source\":");
+	l_sprintf(buff, sizeof(buff), ":%d", f->linedefined);
+	if (f->source) {
+		char name[SNAPSTRLEN + LUAI_MAXSHORTLEN];
+		size_t l = tsslen(f->source);
+		if (l > SNAPSTRLEN) l = SNAPSTRLEN;
+		memcpy(name, getstr(f->source), l);
+		memcpy(name + l, buff, strlen(buff));
+		snapquoted(S, name, l + strlen(buff));
+	}
+	else
+		snapquoted(S, buff, strlen(buff));
+	snaprefs(S);
+	if (f->source)
+		snapreflit(S, obj2gco(f->source), "(source)");
+	for (i = 0; i < f->sizek; i++)
+		snapvalue(S, &f->k[i], "(constant)");
+	for (i = 0; i < f->sizeupvalues; i++) {
+		if (f->upvalues[i].name)
+			snapreflit(S, obj2gco(f->upvalues[i].name), "(name)");
+	}
+	for (i = 0; i < f->sizep; i++) {
+		if (f->p[i])
+			snapreflit(S, obj2gco(f->p[i]), "(proto)");
+	}
+	for (i = 0; i < f->sizelocvars; i++) {
+		if (f->locvars[i].varname)
+			snapreflit(S, obj2gco(f->locvars[i].varname), "(name)");
+	}
+	snapend(S);
 }
 
 
-/*
- ** call all pending finalizers
- */
-static void callallpendingfinalizers (lua_State *L) {
-	global_State *g = G(L);
-	while (g->tobefnz)
-		GCTM(L, 0);
+static void snapobject (Snapshot *S, lua_State *L, GCObject *o) {
+	switch (o->tt) {
+		case LUA_TSHRSTR: case LUA_TLNGSTR: {
+			TString *ts = gco2ts(o);
+			snapbegin(S, o, "string");
+			snapnum(S, "size", objsize(o));
+			snaplit(S, ",\"value\":");
+			snapquoted(S, getstr(ts), tsslen(ts));
+			snaprefs(S);
+			snapend(S);
+			break;
+		}
+		case LUA_TTABLE: snaptable(S, G(L), gco2t(o)); break;
+		case LUA_TLCL: snapLclosure(S, gco2lcl(o)); break;
+		case LUA_TCCL: snapCclosure(S, gco2ccl(o)); break;
+		case LUA_TUSERDATA: snapudata(S, gco2u(o)); break;
+		case LUA_TTHREAD: snapthread(S, gco2th(o)); break;
+		case LUA_TPROTO: snapproto(S, gco2p(o)); break;
+		default: lua_assert(0);
+	}
 }
 
 
-/*
- ** find last 'next' field in list 'p' list (to add elements in its end)
- */
-static GCObject **findlast (GCObject **p) {
-	while (*p != NULL)
-		p = &(*p)->next;
-	return p;
+static void snaplist (Snapshot *S, lua_State *L, GCObject *o) {
+	global_State *g = G(L);
+	for (; o != NULL && S->status == 0; o = o->next) {
+		if (o == obj2gco(g->snapids))
+			continue;  /* not part of the program's heap */
+		if (!(issweepphase(g) && isdead(g, o)))  /* not known garbage? */
+			snapobject(S, L, o);
+	}
 }
 
 
-/**
- * move all unreachable objects (or 'all' objects) that need
- * finalization from list 'finobj' to list 'tobefnz' (to be finalized)
- * 将所有不再存活的对象从finobj链表移到tobefnz链表等待调用
- * 此时会遍历整个 finobj 链表, 因此如果系统中存在太多带有 finalizer 的对象可能在这里会有效率问题
- */
-static void separatetobefnz (global_State *g, int all) {
-	GCObject *curr;
-	GCObject **p = &g->finobj;
-	GCObject **lastnext = findlast(&g->tobefnz);
-	while ((curr = *p) != NULL) {  /* traverse all finalizable objects */
-		lua_assert(tofinalize(curr));
-		if (!(iswhite(curr) || all))  /* not being collected? */
-			p = &curr->next;  /* don't bother with it */
-		else {
-			*p = curr->next;  /* remove 'curr' from 'finobj' list */
-			curr->next = *lastnext;  /* link at the end of 'tobefnz' list */
-			*lastnext = curr;
-			lastnext = &curr->next;
+/* pseudo-object with the roots used by 'restartcollection' */
+static void snaproot (Snapshot *S, global_State *g) {
+	GCObject *o;
+	int i;
+	snapbegin(S, NULL, "root");
+	snaprefs(S);
+	snapvalue(S, &g->l_registry, "(registry)");
+	snapreflit(S, obj2gco(g->mainthread), "(main thread)");
+	if (g->pinned)
+		snapreflit(S, obj2gco(g->pinned), "(pinned strings)");
+	for (i = 0; i < LUA_NUMTAGS; i++) {
+		if (g->mt[i]) {
+			char buff[LUAI_MAXSHORTLEN];
+			l_sprintf(buff, sizeof(buff), "(metatable %s)", ttypename(i));
+			snapref(S, obj2gco(g->mt[i]), buff, strlen(buff));
 		}
 	}
+	for (o = g->tobefnz; o != NULL; o = o->next)
+		snapreflit(S, o, "(finalizing)");
+	for (o = g->threadpool; o != NULL; o = o->next)
+		snapreflit(S, o, "(thread pool)");
+	snapend(S);
+}
+
+
+/* threads kept for reuse; their stacks hold only stale values */
+static void snappool (Snapshot *S, global_State *g) {
+	GCObject *o;
+	for (o = g->threadpool; o != NULL && S->status == 0; o = o->next) {
+		snapbegin(S, o, "thread");
+		snapnum(S, "size", threadsize(gco2th(o)));
+		snaprefs(S);
+		snapend(S);
+	}
+}
+
+
+static void snapall (lua_State *L, void *ud) {
+	Snapshot *S = cast(Snapshot *, ud);
+	global_State *g = G(L);
+	if (g->snapids == NULL)
+		g->snapids = luaH_new(L);
+	snaproot(S, g);
+	snapthread(S, g->mainthread);
+	snaplist(S, L, g->allgc);
+	snaplist(S, L, g->finobj);
+	snaplist(S, L, g->tobefnz);
+	snaplist(S, L, g->fixedgc);
+	snappool(S, g);
+	snapflush(S);
 }
 
 
 /*
- ** if object 'o' has a finalizer, remove it from 'allgc' list (must
- ** search the list to find it) and link it in 'finobj' list.
+ ** write a snapshot of all objects in the heap; the collector does not
+ ** run while it is being written (not even an emergency collection), so
+ ** that lists stay stable even if the writer allocates memory. An error
+ ** in the writer is propagated after the collector is back to its
+ ** previous state. Returns the status of the writer.
  */
-void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
+int luaC_snapshot (lua_State *L, lua_Writer writer, void *data) {
 	global_State *g = G(L);
-	if (tofinalize(o) ||                 /* obj. is already marked... */
-			gfasttm(g, mt, TM_GC) == NULL)   /* or has no finalizer? */
-		return;  /* nothing to be done */
-	else {  /* move 'o' to 'finobj' list */
-		GCObject **p;
-		if (issweepphase(g)) {
-			makewhite(g, o);  /* "sweep" object 'o' */
-			if (g->sweepgc == &o->next)  /* should not remove 'sweepgc' object */
-				g->sweepgc = sweeptolive(L, g->sweepgc);  /* change 'sweepgc' */
-		}
-		/* search for pointer pointing to 'o' */
-		for (p = &g->allgc; *p != o; p = &(*p)->next) { /* empty */ }
-		*p = o->next;  /* remove 'o' from 'allgc' list */
-		o->next = g->finobj;  /* link it in 'finobj' list */
-		g->finobj = o;
-		l_setbit(o->marked, FINALIZEDBIT);  /* mark it as such */
-	}
+	lu_byte running = g->gcrunning;
+	lu_byte stopem = g->gcstopem;
+	int status;
+	Snapshot S;
+	S.L = L;
+	S.writer = writer;
+	S.data = data;
+	S.status = 0;
+	S.n = 0;
+	g->gcrunning = 0;  /* avoid GC steps */
+	g->gcstopem = 1;  /* and emergency collections */
+	status = luaD_rawrunprotected(L, snapall, &S);
+	g->gcrunning = running;  /* restore state */
+	g->gcstopem = stopem;
+	if (status != LUA_OK)
+		luaD_throw(L, status);  /* propagate error from the writer */
+	return S.status;
 }
 
 /* }====================================================== */
@@ -1084,8 +2460,14 @@ static void setpause (global_State *g) {
 	threshold = (g->gcpause < MAX_LMEM / estimate)  /* overflow? */
 		? estimate * g->gcpause  /* no overflow */
 		: MAX_LMEM;  /* overflow; truncate to maximum */
+	if (g->memsoft > 0 && cast(lu_mem, threshold) > g->memsoft) {
+		/* start next cycle at the soft limit (now, if already above it) */
+		threshold = cast(l_mem, (gettotalbytes(g) < g->memsoft) ? g->memsoft
+		                                                        : gettotalbytes(g));
+	}
 	debt = gettotalbytes(g) - threshold;
 	luaE_setdebt(g, debt);
+	luaE_setmemcheck(g);
 }
 
 
@@ -1098,7 +2480,7 @@ static void setpause (global_State *g) {
  */
 static void entersweep (lua_State *L) {
 	global_State *g = G(L);
-	g->gcstate = GCSswpallgc;
+	setphase(g, GCSswpallgc);
 	lua_assert(g->sweepgc == NULL);
 	g->sweepgc = sweeplist(L, &g->allgc, 1);
 }
@@ -1108,16 +2490,19 @@ static void entersweep (lua_State *L) {
  */
 void luaC_freeallobjects (lua_State *L) {
 	global_State *g = G(L);
+	stopfreer(g);  /* free everything in this thread */
 	separatetobefnz(g, 1);  /* separate all objects with finalizers */
 	lua_assert(g->finobj == NULL);
 	callallpendingfinalizers(L);
 	lua_assert(g->tobefnz == NULL);
+	g->snapids = NULL;  /* no more ids to forget */
 	g->currentwhite = WHITEBITS; /* this "white" makes all objects look dead */
 	g->gckind = KGC_NORMAL;
 	sweepwholelist(L, &g->finobj);
 	sweepwholelist(L, &g->allgc);
 	sweepwholelist(L, &g->fixedgc);  /* collect fixed objects */
 	lua_assert(g->strt.nuse == 0);
+	freemarkers(g);
 }
 
 
@@ -1127,12 +2512,15 @@ static l_mem atomic (lua_State *L) {
 	GCObject *origweak, *origall;
 	GCObject *grayagain = g->grayagain;  /* save original list */
 	lua_assert(g->ephemeron == NULL && g->weak == NULL);
+	g->grayagain = NULL;  /* will get the (gray) threads traversed here */
 	lua_assert(!iswhite(g->mainthread));
 	g->gcstate = GCSinsideatomic;
 	g->GCmemtrav = 0;  /* start counting work */
 	markobject(g, L);  /* mark running thread */
 	/* registry and global metatables may be changed by API */
 	markvalue(g, &g->l_registry);
+	markobjectN(g, g->pinned);  /* may be created or changed by API too */
+	markobjectN(g, g->snapids);  /* may be created by a snapshot */
 	markmt(g);  /* mark global metatables */
 	/**
 	 * remark occasional upvalues of (maybe) dead threads
@@ -1201,6 +2589,25 @@ static l_mem atomic (lua_State *L) {
 }
 
 
+/*
+ ** run the atomic phase (after emptying the gray list), keeping how long
+ ** it took
+ */
+static l_mem runatomic (lua_State *L, global_State *g) {
+	lu_mem t0 = luai_gcclock();
+	l_mem work;
+	propagateall(g);  /* make sure gray list is empty */
+	if (g->gcstate != GCSatomic)  /* coming straight from propagate? */
+		setphase(g, GCSatomic);
+	work = atomic(L);
+	freemarkers(g);  /* stop the helpers (if any) */
+	g->gcatomictime = luai_gcclock() - t0;
+	if (g->gcatomictime > g->gcstats.maxatomic)
+		g->gcstats.maxatomic = g->gcatomictime;
+	return work;
+}
+
+
 static lu_mem sweepstep (lua_State *L, global_State *g,
 		int nextstate, GCObject **nextlist) {
 	if (g->sweepgc) {
@@ -1211,7 +2618,7 @@ static lu_mem sweepstep (lua_State *L, global_State *g,
 			return (GCSWEEPMAX * GCSWEEPCOST);
 	}
 	/* else enter next state */
-	g->gcstate = nextstate;
+	setphase(g, nextstate);
 	g->sweepgc = nextlist;
 	return 0;
 }
@@ -1224,7 +2631,7 @@ static lu_mem singlestep (lua_State *L) {
 			{
 				g->GCmemtrav = g->strt.size * sizeof(GCObject*);
 				restartcollection(g);		//标记为灰色
-				g->gcstate = GCSpropagate;
+				setphase(g, GCSpropagate);
 				return g->GCmemtrav;
 			}
 		case GCSpropagate:	// 传播阶段
@@ -1233,14 +2640,12 @@ static lu_mem singlestep (lua_State *L) {
 				lua_assert(g->gray);
 				propagatemark(g);		// 转换灰成黑（除了线程，一直是灰）
 				if (g->gray == NULL)	// 如果没有灰对象了，就执行下一个阶段 /* no more gray objects? */
-					g->gcstate = GCSatomic;  /* finish propagate phase */
+					setphase(g, GCSatomic);  /* finish propagate phase */
 				return g->GCmemtrav;  /* memory traversed in this step */
 			}
 		case GCSatomic:
 			{
-				lu_mem work;
-				propagateall(g);  /* make sure gray list is empty */
-				work = atomic(L);  /* work is what was traversed by 'atomic' */
+				lu_mem work = runatomic(L, g);  /* what 'atomic' traversed */
 				entersweep(L);		// 进入回收阶段
 				g->GCestimate = gettotalbytes(g);  /* first estimate */;
 				return work;
@@ -1260,8 +2665,9 @@ static lu_mem singlestep (lua_State *L) {
 		case GCSswpend:
 			{  /* finish sweeps */
 				makewhite(g, g->mainthread);  /* sweep main thread */
+				sendfrees(g, 1);  /* hand what is left of this sweep */
 				checkSizes(L, g);
-				g->gcstate = GCScallfin;
+				setphase(g, GCScallfin);
 				return 0;
 			}
 		case GCScallfin:
@@ -1273,7 +2679,7 @@ static lu_mem singlestep (lua_State *L) {
 				}
 				else 
 				{  /* emergency mode or no more finalizers */
-					g->gcstate = GCSpause;  /* finish collection */
+					setphase(g, GCSpause);  /* finish collection */
 					return 0;
 				}
 			}
@@ -1288,8 +2694,28 @@ static lu_mem singlestep (lua_State *L) {
  */
 void luaC_runtilstate (lua_State *L, int statesmask) {
 	global_State *g = G(L);
+	starttime(g);
 	while (!testbit(statesmask, g->gcstate))
 		singlestep(L);
+	chargetime(g);
+}
+
+
+/* generational mode (see below) */
+static void setminordebt (global_State *g);
+static void enterinc (global_State *g);
+static void fullgen (lua_State *L, global_State *g);
+static void genstep (lua_State *L, global_State *g);
+
+
+/*
+ ** step multiplier, doubled while memory use is above the soft limit
+ */
+static int getstepmul (global_State *g) {
+	int stepmul = g->gcstepmul;
+	if (g->memover && stepmul < MAX_INT / 2)
+		stepmul *= 2;
+	return stepmul;
 }
 
 
@@ -1302,7 +2728,7 @@ void luaC_runtilstate (lua_State *L, int statesmask) {
  **/
 static l_mem getdebt (global_State *g) {
 	l_mem debt = g->GCdebt;
-	int stepmul = g->gcstepmul;
+	int stepmul = getstepmul(g);
 	if (debt <= 0) return 0;  /* minimal debt */
 	else {
 		debt = (debt / STEPMULADJ) + 1;
@@ -1311,6 +2737,30 @@ static l_mem getdebt (global_State *g) {
 	}
 }
 
+/*
+ ** Does steps until spending 'gcsteptime' microseconds (twice that above
+ ** the soft limit) or reaching the end of the cycle. The atomic phase
+ ** cannot be split, so it is left for the next step when, judging by
+ ** how long the last one took, it would stretch this step beyond
+ ** 'gcmaxpause'. Returns the debt left.
+ */
+static l_mem timedstep (lua_State *L, global_State *g, l_mem debt) {
+	lu_mem budget = cast(lu_mem, g->gcsteptime);
+	lu_mem start = luai_gcclock();
+	lu_mem elapsed = 0;
+	if (g->memover)  /* above the soft limit? */
+		budget *= 2;
+	do {
+		if (g->gcstate == GCSatomic && elapsed > 0 && g->gcmaxpause > 0 &&
+		    elapsed + g->gcatomictime > cast(lu_mem, g->gcmaxpause))
+			break;  /* start next step with the atomic phase */
+		debt -= singlestep(L);
+		elapsed = luai_gcclock() - start;
+	} while (elapsed < budget && g->gcstate != GCSpause);
+	return debt;
+}
+
+
 /*
  ** performs a basic GC step when collector is running
  */
@@ -1322,20 +2772,34 @@ void luaC_step (lua_State *L) {
 		luaE_setdebt(g, -GCSTEPSIZE * 10);  /* avoid being called too often */
 		return;
 	}
+	starttime(g);
+	if (isgenerational(g)) {  /* each step is a whole (minor) collection */
+		genstep(L, g);
+		chargetime(g);
+		return;
+	}
 	// 2. 循环执行singlestep,直到GC周期完毕,或debt小于某个值
-	do {  /* repeat until pause or enough "credit" (negative debt) */
-		lu_mem work = singlestep(L);  /* perform one single step */
-		debt -= work;
-	} while (debt > -GCSTEPSIZE && g->gcstate != GCSpause);
+	if (g->gcsteptime > 0) {  /* paced by time? */
+		debt = timedstep(L, g, debt);
+		if (debt > -GCSTEPSIZE)  /* behind allocation? */
+			debt = -GCSTEPSIZE;  /* let the program run a little anyway */
+	}
+	else {
+		do {  /* repeat until pause or enough "credit" (negative debt) */
+			lu_mem work = singlestep(L);  /* perform one single step */
+			debt -= work;
+		} while (debt > -GCSTEPSIZE && g->gcstate != GCSpause);
+	}
 	// 3. 如果GC结束,计算下一个阀值
 	if (g->gcstate == GCSpause)
 		setpause(g);  /* pause until next cycle */
 	else {
 		// 4. 否则计算下一次触发的时机
-		debt = (debt / g->gcstepmul) * STEPMULADJ;  /* convert 'work units' to Kb */
+		debt = (debt / getstepmul(g)) * STEPMULADJ;  /* convert 'work units' to Kb */
 		luaE_setdebt(g, debt);
 		runafewfinalizers(L);
 	}
+	chargetime(g);
 }
 
 
@@ -1350,7 +2814,22 @@ void luaC_step (lua_State *L) {
  */
 void luaC_fullgc (lua_State *L, int isemergency) {
 	global_State *g = G(L);
-	lua_assert(g->gckind == KGC_NORMAL);
+	int origkind = g->gckind;
+	lua_assert(origkind != KGC_EMERGENCY);
+	starttime(g);
+	if (isemergency) g->gcstats.emergencies++;
+	if (origkind == KGC_GEN) {
+		if (!isemergency) {
+			fullgen(L, g);  /* a major collection */
+			luaE_freethreadpool(L);
+			waitfreer(g);  /* memory must be really free after a full GC */
+			setminordebt(g);
+			runallfinalizers(L);
+			chargetime(g);
+			return;
+		}
+		enterinc(g);  /* make all objects white (see below) */
+	}
 	if (isemergency) g->gckind = KGC_EMERGENCY;  /* set flag */
 	if (keepinvariant(g)) {  /* black objects? */
 		entersweep(L); /* sweep everything to turn them back to white */
@@ -1358,14 +2837,226 @@ void luaC_fullgc (lua_State *L, int isemergency) {
 	/* finish any pending sweep phase to start a new cycle */
 	luaC_runtilstate(L, bitmask(GCSpause));
 	luaC_runtilstate(L, ~bitmask(GCSpause));  /* start new collection */
+	lua_assert(g->gcstate == GCSpropagate);
+	propagateall(g);  /* mark all at once (maybe in parallel) */
+	setphase(g, GCSatomic);
 	luaC_runtilstate(L, bitmask(GCScallfin));  /* run up to finalizers */
 	/* estimate must be correct after a full GC cycle */
 	lua_assert(g->GCestimate == gettotalbytes(g));
 	luaC_runtilstate(L, bitmask(GCSpause));  /* finish collection */
+	luaE_freethreadpool(L);  /* pooled threads too */
+	waitfreer(g);  /* memory must be really free after a full GC */
 	g->gckind = KGC_NORMAL;
 	setpause(g);
+	if (origkind == KGC_GEN) {
+		/* an emergency collection happens inside an allocation, maybe while
+		   building an object with no barriers yet; so, instead of making
+		   all objects old (and black), go back to generational mode with
+		   all of them young: the next minor collection will mark them all */
+		luaC_runtilstate(L, bitmask(GCSpropagate));  /* mark roots */
+		g->gckind = KGC_GEN;
+		setminordebt(g);
+	}
+	chargetime(g);
 }
 
 /* }====================================================== */
 
 
+/*
+ ** {======================================================
+ ** Generational mode
+ ** =======================================================
+ */
+
+/*
+ ** In generational mode, an object surviving a collection gets the old
+ ** bit and stays black (threads stay gray, as they are never black), so
+ ** the collector rests with its invariant kept: black objects never
+ ** point to white ones. A minor collection does not restart the marking
+ ** but goes on from the gray objects, which are young objects reached
+ ** through 'luaC_barrier_' or 'luaC_upvalbarrier_', old tables touched
+ ** since the last collection ('grayagain', filled by 'luaC_barrierback_')
+ ** and all threads (which are also kept in 'grayagain'). As nothing old
+ ** points to an unmarked young object, it is enough to sweep the young
+ ** objects, which come first in each list because new objects are linked
+ ** in the head of their lists; an object moved to the head of a list
+ ** loses its old bit. A major collection makes all objects young and
+ ** white again and runs a full (non incremental) cycle.
+ */
+
+
+/*
+ ** set debt for the next minor collection, which will happen when
+ ** memory grows 'genminormul'%
+ */
+static void setminordebt (global_State *g) {
+	l_mem debt = cast(l_mem, gettotalbytes(g) / 100) * g->genminormul;
+	if (g->memsoft > 0 && gettotalbytes(g) + debt > g->memsoft) {
+		/* next collection at the soft limit (or soon, if above it) */
+		debt = (gettotalbytes(g) < g->memsoft)
+		     ? cast(l_mem, g->memsoft - gettotalbytes(g)) : GCSTEPSIZE;
+	}
+	luaE_setdebt(g, -debt);
+	luaE_setmemcheck(g);
+}
+
+
+/*
+ ** sweep the young objects of list 'p', that is, all objects before the
+ ** first old one: free the dead objects and make the others old. All
+ ** surviving objects were marked in this cycle.
+ */
+static void sweepgen (lua_State *L, GCObject **p) {
+	global_State *g = G(L);
+	int ow = otherwhite(g);
+	GCObject *curr;
+	lu_mem before = gettotalbytes(g);
+	g->deferfree = (g->gcfreer != NULL);  /* give dead blocks to the freer */
+	while ((curr = *p) != NULL && !isold(curr)) {
+		int marked = curr->marked;
+		if (isdeadm(ow, marked)) {  /* is 'curr' dead? */
+			*p = curr->next;  /* remove 'curr' from list */
+			g->gcstats.swept[stattype(curr)]++;
+			freeobj(L, curr);  /* erase 'curr' */
+		}
+		else {  /* make it old */
+			lua_assert(!iswhite(curr));
+			g->gcstats.marked[stattype(curr)]++;
+			curr->marked = cast_byte(marked | bitmask(OLDBIT));
+			p = &curr->next;  /* go to next element */
+		}
+	}
+	g->gcstats.freedbytes += before - gettotalbytes(g);
+	sendfrees(g, 1);
+}
+
+
+/*
+ ** Weak tables that must be cleared are kept gray in their lists; after
+ ** the cycle they hold only old objects, so they can be black (and
+ ** caught by the barrier when they get a young object).
+ */
+static void blacklist (GCObject *l) {
+	for (; l != NULL; l = gco2t(l)->gclist)
+		gray2black(l);
+}
+
+
+/*
+ ** finish a generational collection after its atomic phase: make all
+ ** young survivors old and let the collector rest in the propagate
+ ** phase (so that the barriers keep its invariant)
+ */
+static void atomic2gen (lua_State *L, global_State *g) {
+	setphase(g, GCSswpallgc);
+	sweepgen(L, &g->allgc);
+	sweepgen(L, &g->finobj);
+	blacklist(g->weak);
+	blacklist(g->allweak);
+	blacklist(g->ephemeron);
+	g->weak = g->allweak = g->ephemeron = NULL;
+	checkSizes(L, g);
+	setphase(g, GCSpropagate);  /* skip restart */
+}
+
+
+/*
+ ** Does a minor collection: 'atomic' marks the young objects reachable
+ ** from the gray ones, and then only young objects are swept.
+ */
+static void youngcollection (lua_State *L, global_State *g) {
+	lua_assert(g->gcstate == GCSpropagate);
+	runatomic(L, g);
+	atomic2gen(L, g);
+	g->gcstats.minors++;
+}
+
+
+/*
+ ** Enter generational mode: finish any pending incremental cycle and run
+ ** a full one, which makes all surviving objects old.
+ */
+static void entergen (lua_State *L, global_State *g) {
+	luaC_runtilstate(L, bitmask(GCSpause));  /* prepare to start a new cycle */
+	luaC_runtilstate(L, bitmask(GCSpropagate));  /* start new cycle */
+	runatomic(L, g);
+	atomic2gen(L, g);
+	g->gcstats.cycles++;
+	g->GCestimate = gettotalbytes(g);  /* base for major collections */
+}
+
+
+static void whitelist (global_State *g, GCObject *p) {
+	for (; p != NULL; p = p->next)
+		makewhite(g, p);
+}
+
+
+/*
+ ** Enter incremental mode: turn all objects white and young, and clear
+ ** the gray lists (they will be rebuilt by the next cycle).
+ */
+static void enterinc (global_State *g) {
+	whitelist(g, g->allgc);
+	whitelist(g, g->finobj);
+	whitelist(g, g->tobefnz);
+	makewhite(g, g->mainthread);
+	g->gray = g->grayagain = NULL;
+	setphase(g, GCSpause);
+}
+
+
+/*
+ ** Does a major collection in generational mode
+ */
+static void fullgen (lua_State *L, global_State *g) {
+	enterinc(g);
+	entergen(L, g);
+}
+
+
+/*
+ ** Does a generational step: a minor collection or, if memory grew more
+ ** than 'genmajormul'% since the last major collection, a major one.
+ ** 'GCestimate' keeps the memory in use after the last major collection.
+ */
+static void genstep (lua_State *L, global_State *g) {
+	lu_mem majorbase = g->GCestimate;
+	lu_mem majorinc = (majorbase / 100) * g->genmajormul;
+	if (gettotalbytes(g) > majorbase + majorinc)
+		fullgen(L, g);  /* do a major collection */
+	else {
+		youngcollection(L, g);
+		g->GCestimate = majorbase;  /* preserve base value */
+	}
+	setminordebt(g);
+	runallfinalizers(L);
+}
+
+
+/*
+ ** Change the collector mode ('KGC_NORMAL' for incremental or 'KGC_GEN'
+ ** for generational)
+ */
+void luaC_changemode (lua_State *L, int newmode) {
+	global_State *g = G(L);
+	lua_assert(newmode == KGC_NORMAL || newmode == KGC_GEN);
+	starttime(g);
+	if (newmode != g->gckind) {
+		if (newmode == KGC_GEN) {
+			entergen(L, g);
+			g->gckind = KGC_GEN;
+			setminordebt(g);
+		}
+		else {
+			enterinc(g);
+			g->gckind = KGC_NORMAL;
+			setpause(g);
+		}
+	}
+	chargetime(g);
+}
+
+/* }====================================================== */
+
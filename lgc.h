@@ -34,7 +34,48 @@
 
 
 /*
-** Possible states of the Garbage Collector
+** The collector can run threads of its own (to mark in parallel and to
+** free dead objects in the background) with POSIX threads and the GCC
+** atomic builtins.
+*/
+#if !defined(LUAI_GCPTHREADS)
+#if defined(LUA_USE_POSIX) && defined(__GNUC__)
+#define LUAI_GCPTHREADS	1
+#else
+#define LUAI_GCPTHREADS	0
+#endif
+#endif
+
+/*
+** Maximum number of threads (counting the one running the collector)
+** that propagate marks in parallel during the atomic phase and full
+** collections; 1 compiles parallel marking out.
+*/
+#if !defined(LUAI_GCMAXTHREADS)
+#if LUAI_GCPTHREADS
+#define LUAI_GCMAXTHREADS	4
+#else
+#define LUAI_GCMAXTHREADS	1
+#endif
+#endif
+
+/*
+** Number of those threads a new state uses (LUA_GCPARALLEL in 'lua_gc'
+** changes it); by default the collector marks alone.
+*/
+#if !defined(LUAI_GCTHREADS)
+#define LUAI_GCTHREADS	1
+#endif
+
+/* smallest heap (in bytes) worth marking in parallel */
+#if !defined(LUAI_GCPARMIN)
+#define LUAI_GCPARMIN	(4 * 1024 * 1024)
+#endif
+
+
+/*
+** Possible states of the Garbage Collector (they are also the phases
+** seen by 'lua_GCPhaseF' and 'lua_GCStats', numbered as in lua.h)
 */
 
 /**
@@ -140,24 +181,46 @@
  * 由于它是用户传人的数据，它的回收可能会调用用户注册的GC函数，所以统一来处理
 */
 #define FINALIZEDBIT	3
+#define OLDBIT		4  /* object is old (generational mode) */
 /* bit 7 is currently used by tests (luaL_checkmemory) */
 
 #define WHITEBITS	bit2mask(WHITE0BIT, WHITE1BIT)
 
 
-#define iswhite(x)      testbits((x)->marked, WHITEBITS)
-#define isblack(x)      testbit((x)->marked, BLACKBIT)
+/*
+** Markers running in parallel read the 'marked' field of any object
+** with atomic loads (see 'casmark' in lgc.c). The one marker that won
+** an object is the only one to change that field, but with atomic
+** accesses too, and so are the color tests below.
+*/
+#if LUAI_GCPTHREADS && LUAI_GCMAXTHREADS > 1
+#define getmarked(x)	__atomic_load_n(&(x)->marked, __ATOMIC_RELAXED)
+#define setmarked(x,m)	__atomic_store_n(&(x)->marked, cast_byte(m), \
+                                         __ATOMIC_RELAXED)
+#else
+#define getmarked(x)	((x)->marked)
+#define setmarked(x,m)	((x)->marked = cast_byte(m))
+#endif
+
+#define iswhite(x)      testbits(getmarked(x), WHITEBITS)
+#define isblack(x)      testbit(getmarked(x), BLACKBIT)
 #define isgray(x)  /* neither white nor black */  \
-	(!testbits((x)->marked, WHITEBITS | bitmask(BLACKBIT)))
+	(!testbits(getmarked(x), WHITEBITS | bitmask(BLACKBIT)))
 
 #define tofinalize(x)	testbit((x)->marked, FINALIZEDBIT)
 
+#define isold(x)	testbit((x)->marked, OLDBIT)
+#define resetoldbit(o)	resetbit((o)->marked, OLDBIT)
+
+#define isgenerational(g)	((g)->gckind == KGC_GEN)
+
 #define otherwhite(g)	((g)->currentwhite ^ WHITEBITS)
 #define isdeadm(ow,m)	(!(((m) ^ WHITEBITS) & (ow)))
 #define isdead(g,v)	isdeadm(otherwhite(g), (v)->marked)
 
 #define changewhite(x)	((x)->marked ^= WHITEBITS)
-#define gray2black(x)	l_setbit((x)->marked, BLACKBIT)
+
+#define gray2black(x)	setmarked(x, getmarked(x) | bitmask(BLACKBIT))
 
 #define luaC_white(g)	cast(lu_byte, (g)->currentwhite & WHITEBITS)
 
@@ -209,13 +272,24 @@
 	(iscollectable((uv)->v) && !upisopen(uv)) ? \
          luaC_upvalbarrier_(L,uv) : cast_void(0))
 
+/* forget the snapshot id of an object that is going away (see 'snapid') */
+#define luaC_dropid(g,o) \
+	(((g)->snapids != NULL) ? luaC_dropid_(g, obj2gco(o)) : cast_void(0))
+
 LUAI_FUNC void luaC_fix (lua_State *L, GCObject *o);
 LUAI_FUNC void luaC_freeallobjects (lua_State *L);
 LUAI_FUNC void luaC_step (lua_State *L);
 LUAI_FUNC void luaC_runtilstate (lua_State *L, int statesmask);
 LUAI_FUNC void luaC_fullgc (lua_State *L, int isemergency);
+LUAI_FUNC void luaC_changemode (lua_State *L, int newmode);
+LUAI_FUNC int luaC_bgfree (lua_State *L, int on);
+LUAI_FUNC void luaC_memusage (global_State *g, lu_mem *count, lu_mem *bytes);
+LUAI_FUNC lu_mem luaC_poolusage (global_State *g);
+LUAI_FUNC int luaC_snapshot (lua_State *L, lua_Writer writer, void *data);
+LUAI_FUNC void luaC_deferfree (global_State *g, void *block, size_t size);
 LUAI_FUNC GCObject *luaC_newobj (lua_State *L, int tt, size_t sz);
 LUAI_FUNC void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v);
+LUAI_FUNC void luaC_dropid_ (global_State *g, GCObject *o);
 LUAI_FUNC void luaC_barrierback_ (lua_State *L, Table *o);
 LUAI_FUNC void luaC_upvalbarrier_ (lua_State *L, UpVal *uv);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
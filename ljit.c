@@ -0,0 +1,1008 @@
+/*
+** $Id: ljit.c $
+** Baseline compiler from Lua bytecode to machine code
+** See Copyright Notice in lua.h
+*/
+
+#define ljit_c
+#define LUA_CORE
+
+/* 'MAP_ANONYMOUS' is not POSIX */
+#if !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "lprefix.h"
+
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "ldebug.h"
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "ljit.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lstate.h"
+#include "ltable.h"
+#include "ltm.h"
+#include "lvm.h"
+
+
+#if LUA_USE_JIT
+
+#include <sys/mman.h>
+
+
+/*
+** A hot function is translated, instruction by instruction, into a
+** block of x86-64 code. Moves, loads, jumps, tests, numeric 'for'
+** loops, integer and float additions, subtractions and
+** multiplications, integer comparisons, and accesses to the array part
+** of tables run inline; everything else
+** (including the slow paths of the former) calls 'execop', which runs
+** the instruction with the same 'luaV_*' and 'luaT_*' functions that
+** the interpreter uses, so metamethods and errors behave the same.
+**
+** Compiled code keeps no state of its own: all values live in the Lua
+** stack, and 'savedpc' is set before any call to 'execop'. So, the
+** interpreter can take over at any instruction. Compiled code returns
+** to 'luaV_execute' on instructions it does not handle (OP_CLOSURE,
+** OP_TAILCALL, and OP_RETURN), when it calls a Lua function, and when
+** a hook gets set; errors and yields simply unwind through it. Every
+** instruction is also an entry point, so a function can go back to
+** compiled code wherever it stopped (e.g., after a call returns).
+*/
+
+
+typedef struct JitCode {
+  size_t size;  /* size of the whole block */
+  unsigned char *code;  /* machine code (inside this same block) */
+  unsigned int entry[1];  /* offset in 'code' of each instruction */
+} JitCode;
+
+
+/* signature of the compiled code (see 'prologue') */
+typedef int (*JitFunc) (lua_State *L, CallInfo *ci, StkId base,
+                        const TValue *k, LClosure *cl,
+                        const unsigned char *entry);
+
+
+/* x86-64 registers */
+enum { rAX, rCX, rDX, rBX, rSP, rBP, rSI, rDI,
+       r8, r9, r10, r11, r12, r13, r14, r15 };
+
+/* registers with fixed roles in compiled code (all callee-saved) */
+#define REG_BASE	rBX	/* 'base' of the running function */
+#define REG_K		r12	/* its constants */
+#define REG_CI		r13	/* its CallInfo */
+#define REG_L		r14	/* the running thread */
+#define REG_CL		r15	/* its closure */
+
+/* condition codes (for 'jcc') */
+#define CC_AE	0x3
+#define CC_E	0x4
+#define CC_NE	0x5
+#define CC_L	0xC
+#define CC_GE	0xD
+#define CC_LE	0xE
+#define CC_G	0xF
+#define CC_JMP	(-1)	/* unconditional jump */
+
+
+/* offsets of the parts of stack slot or constant 'x' */
+#define VAL(x)	(cast_int(sizeof(TValue)) * (x) + \
+                 cast_int(offsetof(TValue, value_)))
+#define TAG(x)	(cast_int(sizeof(TValue)) * (x) + cast_int(offsetof(TValue, tt_)))
+
+#define HOOKMASK	cast_int(offsetof(lua_State, hookmask))
+#define SAVEDPC		cast_int(offsetof(CallInfo, u.l.savedpc))
+#define CIBASE		cast_int(offsetof(CallInfo, u.l.base))
+
+
+/* maximum size of the code for one instruction (but OP_LOADNIL) */
+#define MAXINSTSIZE	320
+
+/* maximum number of jumps to other instructions in one instruction */
+#define MAXINSTJUMPS	6
+
+
+/* a jump to the code of an instruction, to be patched at the end */
+typedef struct Fixup {
+  size_t pos;  /* position of the jump offset */
+  int target;  /* instruction it jumps to */
+} Fixup;
+
+
+typedef struct JitState {
+  Proto *p;  /* function being compiled */
+  unsigned char *code;  /* code being generated */
+  size_t n;  /* number of bytes in 'code' */
+  unsigned int *label;  /* offset in 'code' of each instruction */
+  Fixup *fix;
+  int nfix;  /* number of elements in 'fix' */
+  size_t exit;  /* offset of the exit that returns LUAJ_EXIT */
+  size_t epilogue;  /* offset of the exit that returns register eax */
+} JitState;
+
+
+
+/*
+** {======================================================
+** Running instructions from compiled code
+** =======================================================
+*/
+
+#define RA(i)	(base + GETARG_A(i))
+#define RB(i)	check_exp(getBMode(GET_OPCODE(i)) == OpArgR, base+GETARG_B(i))
+#define RKB(i)	check_exp(getBMode(GET_OPCODE(i)) == OpArgK, \
+	ISK(GETARG_B(i)) ? k+INDEXK(GETARG_B(i)) : base+GETARG_B(i))
+#define RKC(i)	check_exp(getCMode(GET_OPCODE(i)) == OpArgK, \
+	ISK(GETARG_C(i)) ? k+INDEXK(GETARG_C(i)) : base+GETARG_C(i))
+
+
+#define checkGC(L,c)  \
+	{ luaC_condGC(L, L->top = (c), L->top = ci->top); \
+	  luai_threadyield(L); }
+
+
+/*
+** Run instruction 'pc' of the function running in 'ci' as the
+** interpreter does (see 'luaV_execute'), leaving 'savedpc' pointing to
+** the next instruction to be run. For tests and loops, return whether
+** the instruction skips or jumps; for calls, return whether it started
+** a Lua function (LUAJ_CALL) or the C function it called yielded
+** (LUAJ_YIELD).
+*/
+static int execop (lua_State *L, CallInfo *ci, const Instruction *pc) {
+  Instruction i = *pc;
+  LClosure *cl = clLvalue(ci->func);
+  TValue *k = cl->p->k;
+  StkId base = ci->u.l.base;
+  StkId ra = RA(i);
+  OpCode op = genericop(GET_OPCODE(i));
+  ci->u.l.savedpc = pc + 1;
+  switch (op) {
+    case OP_GETTABUP: {
+      TValue *upval = cl->upvals[GETARG_B(i)]->v;
+      luaV_gettable(L, upval, RKC(i), ra);
+      return 0;
+    }
+    case OP_GETTABLE: {
+      luaV_gettable(L, RB(i), RKC(i), ra);
+      return 0;
+    }
+    case OP_SETTABUP: {
+      TValue *upval = cl->upvals[GETARG_A(i)]->v;
+      luaV_settable(L, upval, RKB(i), RKC(i));
+      return 0;
+    }
+    case OP_SETUPVAL: {
+      UpVal *uv = cl->upvals[GETARG_B(i)];
+      setobj(L, uv->v, ra);
+      luaC_upvalbarrier(L, uv);
+      return 0;
+    }
+    case OP_SETTABLE: {
+      luaV_settable(L, ra, RKB(i), RKC(i));
+      return 0;
+    }
+    case OP_NEWTABLE: {
+      int b = GETARG_B(i);
+      int c = GETARG_C(i);
+      Table *t = luaH_new(L);
+      sethvalue(L, ra, t);
+      if (b == 0 && c != 0 && luaO_fb2int(c) <= LUAI_MAXSHAPEKEYS)
+        luaH_useshape(L, t);  /* a record */
+      else if (b != 0 || c != 0)
+        luaH_resize(L, t, luaO_fb2int(b), luaO_fb2int(c));
+      checkGC(L, ra + 1);
+      return 0;
+    }
+    case OP_SELF: {
+      StkId rb = RB(i);
+      TValue *rc = RKC(i);
+      setobjs2s(L, ra + 1, rb);
+      luaV_gettable(L, rb, rc, ra);
+      return 0;
+    }
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND:
+    case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR: {  /* ORDER OP */
+      luaO_arith(L, LUA_OPADD + cast_int(op - OP_ADD), RKB(i), RKC(i), ra);
+      return 0;
+    }
+    case OP_UNM: case OP_BNOT: {
+      TValue *rb = RB(i);
+      luaO_arith(L, LUA_OPADD + cast_int(op - OP_ADD), rb, rb, ra);
+      return 0;
+    }
+    case OP_NOT: {
+      int res = l_isfalse(RB(i));  /* next assignment may change this value */
+      setbvalue(ra, res);
+      return 0;
+    }
+    case OP_LEN: {
+      luaV_objlen(L, ra, RB(i));
+      return 0;
+    }
+    case OP_CONCAT: {
+      int b = GETARG_B(i);
+      int c = GETARG_C(i);
+      StkId rb;
+      L->top = base + c + 1;  /* mark the end of concat operands */
+      luaV_concat(L, c - b + 1);
+      base = ci->u.l.base;  /* 'luaV_concat' may invoke TMs and move the stack */
+      ra = RA(i);
+      rb = base + b;
+      setobjs2s(L, ra, rb);
+      checkGC(L, (ra >= rb ? ra + 1 : rb));
+      L->top = ci->top;  /* restore top */
+      return 0;
+    }
+    case OP_JMP: {  /* (only when it closes upvalues) */
+      luaF_close(L, ra - 1);
+      return 0;
+    }
+    case OP_EQ: case OP_LT: case OP_LE: {
+      TValue *rb = RKB(i);
+      TValue *rc = RKC(i);
+      int res = (op == OP_EQ) ? luaV_equalobj(L, rb, rc)
+              : (op == OP_LT) ? luaV_lessthan(L, rb, rc)
+              : luaV_lessequal(L, rb, rc);
+      if (res != GETARG_A(i)) {
+        ci->u.l.savedpc++;  /* skip the jump */
+        return 1;
+      }
+      return 0;
+    }
+    case OP_TESTSET: {
+      TValue *rb = RB(i);
+      if (GETARG_C(i) ? l_isfalse(rb) : !l_isfalse(rb)) {
+        ci->u.l.savedpc++;  /* skip the jump */
+        return 1;
+      }
+      setobjs2s(L, ra, rb);
+      return 0;
+    }
+    case OP_CALL: {
+      int b = GETARG_B(i);
+      int nresults = GETARG_C(i) - 1;
+      if (b != 0) {
+        L->top = ra+b;  /* else previous instruction set top */
+        if (ttisLclosure(ra) && luaD_canfastcall(L, clLvalue(ra)->p, b - 1)) {
+          luaD_fastcall(L, ra, nresults, clLvalue(ra)->p);
+          return LUAJ_CALL;
+        }
+      }
+      if (luaD_precall(L, ra, nresults)) {  /* C function? */
+        if (luaD_yielded(L))
+          return LUAJ_YIELD;
+        if (nresults >= 0)
+          L->top = ci->top;  /* adjust results */
+        return 0;
+      }
+      return LUAJ_CALL;
+    }
+    case OP_FORLOOP: {
+      if (ttisinteger(ra)) {  /* integer loop? */
+        lua_Integer step = ivalue(ra + 2);
+        lua_Integer idx = intop(+, ivalue(ra), step);  /* increment index */
+        lua_Integer limit = ivalue(ra + 1);
+        if ((0 < step) ? (idx <= limit) : (limit <= idx)) {
+          ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+          chgivalue(ra, idx);  /* update internal index... */
+          setivalue(ra + 3, idx);  /* ...and external index */
+          return 1;
+        }
+      }
+      else {  /* floating loop */
+        lua_Number step = fltvalue(ra + 2);
+        lua_Number idx = luai_numadd(L, fltvalue(ra), step);  /* inc. index */
+        lua_Number limit = fltvalue(ra + 1);
+        if (luai_numlt(0, step) ? luai_numle(idx, limit)
+                                : luai_numle(limit, idx)) {
+          ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+          chgfltvalue(ra, idx);  /* update internal index... */
+          setfltvalue(ra + 3, idx);  /* ...and external index */
+          return 1;
+        }
+      }
+      return 0;
+    }
+    case OP_FORPREP: {
+      luaV_forprep(L, ra);
+      ci->u.l.savedpc += GETARG_sBx(i);
+      return 0;
+    }
+    case OP_TFORCALL: {
+      StkId cb = ra + 3;  /* call base */
+      setobjs2s(L, cb+2, ra+2);
+      setobjs2s(L, cb+1, ra+1);
+      setobjs2s(L, cb, ra);
+      L->top = cb + 3;  /* func. + 2 args (state and index) */
+      luaD_call(L, cb, GETARG_C(i));
+      L->top = ci->top;
+      return 0;
+    }
+    case OP_TFORLOOP: {
+      if (!ttisnil(ra + 1)) {  /* continue loop? */
+        setobjs2s(L, ra, ra + 1);  /* save control variable */
+        ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+        return 1;
+      }
+      return 0;
+    }
+    case OP_SETLIST: {
+      int n = GETARG_B(i);
+      int c = GETARG_C(i);
+      unsigned int last;
+      Table *h;
+      if (n == 0) n = cast_int(L->top - ra) - 1;
+      if (c == 0) {
+        lua_assert(GET_OPCODE(*ci->u.l.savedpc) == OP_EXTRAARG);
+        c = GETARG_Ax(*ci->u.l.savedpc++);
+      }
+      h = hvalue(ra);
+      last = ((c-1)*LFIELDS_PER_FLUSH) + n;
+      if (last > h->sizearray)  /* needs more space? */
+        luaH_resizearray(L, h, last);  /* preallocate it at once */
+      for (; n > 0; n--) {
+        TValue *val = ra+n;
+        luaH_setint(L, h, last--, val);
+        luaC_barrierback(L, h, val);
+      }
+      L->top = ci->top;  /* correct top (in case of previous open call) */
+      return 0;
+    }
+    case OP_VARARG: {
+      int b = GETARG_B(i) - 1;  /* required results */
+      int j;
+      int n = cast_int(base - ci->func) - cl->p->numparams - 1;
+      if (n < 0)  /* less arguments than parameters? */
+        n = 0;  /* no vararg arguments */
+      if (b < 0) {  /* B == 0? */
+        b = n;  /* get all var. arguments */
+        luaD_checkstack(L, n);
+        base = ci->u.l.base;  /* previous call may change the stack */
+        ra = RA(i);
+        L->top = ra + n;
+      }
+      for (j = 0; j < b && j < n; j++)
+        setobjs2s(L, ra + j, base - n + j);
+      for (; j < b; j++)  /* complete required results with nil */
+        setnilvalue(ra + j);
+      return 0;
+    }
+    default: lua_assert(0); return 0;
+  }
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Code emission
+** =======================================================
+*/
+
+static void emit1 (JitState *J, int b) {
+  J->code[J->n++] = cast(unsigned char, b);
+}
+
+
+static void emit4 (JitState *J, unsigned int v) {
+  int i;
+  for (i = 0; i < 4; i++, v >>= 8)
+    emit1(J, v & 0xFF);
+}
+
+
+static void emit8 (JitState *J, size_t v) {
+  int i;
+  for (i = 0; i < 8; i++, v >>= 8)
+    emit1(J, cast_int(v & 0xFF));
+}
+
+
+static void rex (JitState *J, int w, int reg, int rm) {
+  int r = (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+  if (r != 0)
+    emit1(J, 0x40 | r);
+}
+
+
+static void opcode (JitState *J, int op) {
+  if (op > 0xFF)  /* two-byte opcode? */
+    emit1(J, op >> 8);
+  emit1(J, op & 0xFF);
+}
+
+
+/* instruction 'op' over register 'reg' and memory at 'base' + 'disp' */
+static void opmem (JitState *J, int prefix, int w, int op, int reg,
+                                int base, int disp) {
+  int small = (-128 <= disp && disp <= 127);
+  if (prefix) emit1(J, prefix);
+  rex(J, w, reg, base);
+  opcode(J, op);
+  emit1(J, (small ? 0x40 : 0x80) | ((reg & 7) << 3) | (base & 7));
+  if ((base & 7) == rSP)  /* rsp and r12 need a SIB byte */
+    emit1(J, 0x24);
+  if (small) emit1(J, disp & 0xFF);
+  else emit4(J, cast(unsigned int, disp));
+}
+
+
+/* instruction 'op' over registers 'reg' and 'rm' */
+static void opreg (JitState *J, int w, int op, int reg, int rm) {
+  rex(J, w, reg, rm);
+  opcode(J, op);
+  emit1(J, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+
+/* 32-bit instruction 'op' ('ext' in its reg field) over memory and an
+   immediate value */
+static void opimm (JitState *J, int op, int ext, int base, int disp,
+                                int imm) {
+  opmem(J, 0, 0, op, ext, base, disp);
+  emit4(J, cast(unsigned int, imm));
+}
+
+
+#define load64(J,r,b,d)		opmem(J, 0, 1, 0x8B, r, b, d)
+#define store64(J,r,b,d)	opmem(J, 0, 1, 0x89, r, b, d)
+#define load32(J,r,b,d)		opmem(J, 0, 0, 0x8B, r, b, d)
+#define store32(J,r,b,d)	opmem(J, 0, 0, 0x89, r, b, d)
+#define cmpimm(J,b,d,v)		opimm(J, 0x81, 7, b, d, v)
+#define movimm(J,b,d,v)		opimm(J, 0xC7, 0, b, d, v)
+#define loadsd(J,x,b,d)		opmem(J, 0xF2, 0, 0x0F10, x, b, d)
+#define storesd(J,x,b,d)	opmem(J, 0xF2, 0, 0x0F11, x, b, d)
+#define setreg(J,d,s)		opreg(J, 1, 0x89, s, d)
+
+
+/* mov 'reg', imm64 */
+static void loadimm (JitState *J, int reg, size_t v) {
+  rex(J, 1, 0, reg);
+  emit1(J, 0xB8 + (reg & 7));
+  emit8(J, v);
+}
+
+
+/* jump with condition 'cc'; returns the position of its offset */
+static size_t jcc (JitState *J, int cc) {
+  if (cc == CC_JMP)
+    emit1(J, 0xE9);
+  else {
+    emit1(J, 0x0F);
+    emit1(J, 0x80 | cc);
+  }
+  emit4(J, 0);
+  return J->n - 4;
+}
+
+
+/* make the jump whose offset is at 'pos' go to offset 'dest' */
+static void patch (JitState *J, size_t pos, size_t dest) {
+  unsigned int v = cast(unsigned int, dest - (pos + 4));  /* (wraps) */
+  int i;
+  for (i = 0; i < 4; i++, v >>= 8)
+    J->code[pos + i] = cast(unsigned char, v & 0xFF);
+}
+
+
+#define patchhere(J,pos)	patch(J, pos, (J)->n)
+
+
+/* jump with condition 'cc' to the code of instruction 'target' */
+static void jumpto (JitState *J, int cc, int target) {
+  Fixup *f = &J->fix[J->nfix++];
+  f->pos = jcc(J, cc);
+  f->target = target;
+}
+
+
+/* return to the interpreter, which goes on at instruction 'pc' */
+static void exitat (JitState *J, int pc) {
+  loadimm(J, rAX, cast(size_t, J->p->code + pc));
+  store64(J, rAX, REG_CI, SAVEDPC);
+  patch(J, jcc(J, CC_JMP), J->exit);
+}
+
+
+/* leave (with 'savedpc' already set) if some hook was set */
+static void checkhook (JitState *J) {
+  cmpimm(J, REG_L, HOOKMASK, 0);
+  patch(J, jcc(J, CC_NE), J->exit);
+}
+
+
+/*
+** Jump to instruction 'target' from instruction 'pc'. A backward jump
+** also checks for hooks, so that loops running only inline code still
+** see them (e.g., the interruption set by 'lua.c').
+*/
+static void gotopc (JitState *J, int pc, int target) {
+  if (target <= pc) {
+    cmpimm(J, REG_L, HOOKMASK, 0);
+    jumpto(J, CC_E, target);
+    exitat(J, target);
+  }
+  else
+    jumpto(J, CC_JMP, target);
+}
+
+
+/* call 'execop' for instruction 'pc'; result goes to eax */
+static void callexec (JitState *J, int pc) {
+  setreg(J, rDI, REG_L);
+  setreg(J, rSI, REG_CI);
+  loadimm(J, rDX, cast(size_t, J->p->code + pc));
+  loadimm(J, rAX, cast(size_t, execop));
+  emit1(J, 0xFF); emit1(J, 0xD0);  /* call rax */
+  load64(J, REG_BASE, REG_CI, CIBASE);  /* stack may have moved */
+}
+
+
+/* register and index of a RK operand */
+static void rkoperand (int x, int *reg, int *idx) {
+  if (ISK(x)) { *reg = REG_K; *idx = INDEXK(x); }
+  else { *reg = REG_BASE; *idx = x; }
+}
+
+
+/* copy value 'sidx' from 'sreg' to stack slot 'a' */
+static void copyvalue (JitState *J, int a, int sreg, int sidx) {
+  load64(J, rCX, sreg, VAL(sidx));
+  load32(J, rDX, sreg, TAG(sidx));
+  store64(J, rCX, REG_BASE, VAL(a));
+  store32(J, rDX, REG_BASE, TAG(a));
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Code generation for each instruction
+** =======================================================
+*/
+
+/*
+** OP_ADD, OP_SUB, and OP_MUL: inline for two integers and for two
+** floats ('iop'/'fop' are the x86 instructions for each case)
+*/
+static void codearith (JitState *J, int pc, Instruction i, int iop, int fop) {
+  int a = GETARG_A(i);
+  int rb, b, rc, c;
+  size_t ni1, ni2, nf1, nf2, done1, done2;
+  rkoperand(GETARG_B(i), &rb, &b);
+  rkoperand(GETARG_C(i), &rc, &c);
+  cmpimm(J, rb, TAG(b), LUA_TNUMINT);
+  ni1 = jcc(J, CC_NE);
+  cmpimm(J, rc, TAG(c), LUA_TNUMINT);
+  ni2 = jcc(J, CC_NE);
+  load64(J, rAX, rb, VAL(b));
+  opmem(J, 0, 1, iop, rAX, rc, VAL(c));
+  store64(J, rAX, REG_BASE, VAL(a));
+  movimm(J, REG_BASE, TAG(a), LUA_TNUMINT);
+  done1 = jcc(J, CC_JMP);
+  patchhere(J, ni1); patchhere(J, ni2);
+  cmpimm(J, rb, TAG(b), LUA_TNUMFLT);
+  nf1 = jcc(J, CC_NE);
+  cmpimm(J, rc, TAG(c), LUA_TNUMFLT);
+  nf2 = jcc(J, CC_NE);
+  loadsd(J, 0, rb, VAL(b));
+  opmem(J, 0xF2, 0, fop, 0, rc, VAL(c));
+  storesd(J, 0, REG_BASE, VAL(a));
+  movimm(J, REG_BASE, TAG(a), LUA_TNUMFLT);
+  done2 = jcc(J, CC_JMP);
+  patchhere(J, nf1); patchhere(J, nf2);
+  callexec(J, pc);  /* other cases */
+  checkhook(J);
+  patchhere(J, done1); patchhere(J, done2);
+}
+
+
+/*
+** Find the array slot for integer key 'kidx' (from 'kreg') in the
+** table at stack slot 'tidx', leaving its address in rdx. Fill 'slow'
+** with the jumps taken when there is no such slot.
+*/
+static void arrayslot (JitState *J, int tidx, int kreg, int kidx,
+                                    size_t slow[3]) {
+  cmpimm(J, REG_BASE, TAG(tidx), ctb(LUA_TTABLE));
+  slow[0] = jcc(J, CC_NE);
+  cmpimm(J, kreg, TAG(kidx), LUA_TNUMINT);
+  slow[1] = jcc(J, CC_NE);
+  load64(J, rAX, REG_BASE, VAL(tidx));  /* table */
+  load64(J, rCX, kreg, VAL(kidx));  /* key */
+  opreg(J, 1, 0xFF, 1, rCX);  /* dec rcx */
+  load32(J, rDX, rAX, cast_int(offsetof(Table, sizearray)));
+  opreg(J, 1, 0x39, rDX, rCX);  /* cmp rcx, rdx (unsigned) */
+  slow[2] = jcc(J, CC_AE);
+  lua_assert(sizeof(TValue) == 16);
+  opreg(J, 1, 0xC1, 4, rCX); emit1(J, 4);  /* shl rcx, 4 */
+  load64(J, rDX, rAX, cast_int(offsetof(Table, array)));
+  opreg(J, 1, 0x01, rCX, rDX);  /* add rdx, rcx */
+}
+
+
+/*
+** OP_GETTABLE and OP_SETTABLE: inline for an integer key with a
+** non-nil value in the array part (and, for OP_SETTABLE, a new value
+** that needs no barrier)
+*/
+static void codeindex (JitState *J, int pc, Instruction i) {
+  size_t slow[5], done;
+  int k, nslow;
+  int rc, c;
+  rkoperand(GETARG_C(i), &rc, &c);
+  if (GET_OPCODE(i) == OP_GETTABLE) {
+    arrayslot(J, GETARG_B(i), rc, c, slow);
+    cmpimm(J, rDX, TAG(0), LUA_TNIL);
+    slow[3] = jcc(J, CC_E);  /* may have an '__index' metamethod */
+    copyvalue(J, GETARG_A(i), rDX, 0);
+    nslow = 4;
+  }
+  else {
+    int rb, b;
+    rkoperand(GETARG_B(i), &rb, &b);
+    arrayslot(J, GETARG_A(i), rb, b, slow);
+    cmpimm(J, rDX, TAG(0), LUA_TNIL);
+    slow[3] = jcc(J, CC_E);  /* may have a '__newindex' metamethod */
+    load32(J, rCX, rc, TAG(c));
+    emit1(J, 0xF7); emit1(J, 0xC1);  /* test ecx, BIT_ISCOLLECTABLE */
+    emit4(J, BIT_ISCOLLECTABLE);
+    slow[4] = jcc(J, CC_NE);  /* may need a barrier */
+    load64(J, rAX, rc, VAL(c));
+    store64(J, rAX, rDX, VAL(0));
+    store32(J, rCX, rDX, TAG(0));
+    nslow = 5;
+  }
+  done = jcc(J, CC_JMP);
+  for (k = 0; k < nslow; k++)
+    patchhere(J, slow[k]);
+  callexec(J, pc);
+  checkhook(J);
+  patchhere(J, done);
+}
+
+
+/*
+** OP_EQ, OP_LT, and OP_LE: inline for two integers. 'cc' is the
+** condition for the comparison to be true; it skips the following jump
+** when the result is different from A.
+*/
+static void codecompare (JitState *J, int pc, Instruction i, int cc) {
+  int rb, b, rc, c;
+  size_t n1, n2;
+  rkoperand(GETARG_B(i), &rb, &b);
+  rkoperand(GETARG_C(i), &rc, &c);
+  cmpimm(J, rb, TAG(b), LUA_TNUMINT);
+  n1 = jcc(J, CC_NE);
+  cmpimm(J, rc, TAG(c), LUA_TNUMINT);
+  n2 = jcc(J, CC_NE);
+  load64(J, rAX, rb, VAL(b));
+  opmem(J, 0, 1, 0x3B, rAX, rc, VAL(c));  /* cmp rax, [rc] */
+  jumpto(J, GETARG_A(i) ? cc ^ 1 : cc, pc + 2);  /* (cc^1 negates cc) */
+  jumpto(J, CC_JMP, pc + 1);
+  patchhere(J, n1); patchhere(J, n2);
+  callexec(J, pc);  /* other cases */
+  checkhook(J);
+  opreg(J, 0, 0x85, rAX, rAX);  /* test eax, eax */
+  jumpto(J, CC_NE, pc + 2);
+}
+
+
+/* OP_TEST: skip the following jump when R(A) is false (C) or true (!C) */
+static void codetest (JitState *J, int pc, Instruction i) {
+  int a = GETARG_A(i);
+  int skipfalse = (GETARG_C(i) != 0);
+  int onfalse = skipfalse ? pc + 2 : pc + 1;
+  int ontrue = skipfalse ? pc + 1 : pc + 2;
+  load32(J, rAX, REG_BASE, TAG(a));
+  opreg(J, 0, 0x85, rAX, rAX);  /* nil? */
+  jumpto(J, CC_E, onfalse);
+  emit1(J, 0x3D); emit4(J, LUA_TBOOLEAN);  /* cmp eax, LUA_TBOOLEAN */
+  jumpto(J, CC_NE, ontrue);
+  cmpimm(J, REG_BASE, VAL(a), 0);  /* false? */
+  jumpto(J, CC_E, onfalse);
+  jumpto(J, CC_JMP, ontrue);
+}
+
+
+/* OP_FORLOOP: inline for integer loops */
+static void codeforloop (JitState *J, int pc, Instruction i) {
+  int a = GETARG_A(i);
+  int target = pc + 1 + GETARG_sBx(i);
+  size_t notint, neg, done1, done2, cont, done3;
+  cmpimm(J, REG_BASE, TAG(a), LUA_TNUMINT);
+  notint = jcc(J, CC_NE);
+  load64(J, rAX, REG_BASE, VAL(a));  /* index */
+  load64(J, rCX, REG_BASE, VAL(a + 2));  /* step */
+  opreg(J, 1, 0x01, rCX, rAX);  /* add rax, rcx */
+  load64(J, rDX, REG_BASE, VAL(a + 1));  /* limit */
+  opreg(J, 1, 0x85, rCX, rCX);  /* test rcx, rcx */
+  neg = jcc(J, CC_LE);
+  opreg(J, 1, 0x39, rDX, rAX);  /* cmp rax, rdx */
+  done1 = jcc(J, CC_G);
+  cont = jcc(J, CC_JMP);
+  patchhere(J, neg);
+  opreg(J, 1, 0x39, rAX, rDX);  /* cmp rdx, rax */
+  done2 = jcc(J, CC_G);
+  patchhere(J, cont);
+  store64(J, rAX, REG_BASE, VAL(a));
+  store64(J, rAX, REG_BASE, VAL(a + 3));
+  movimm(J, REG_BASE, TAG(a + 3), LUA_TNUMINT);
+  gotopc(J, pc, target);
+  patchhere(J, notint);
+  callexec(J, pc);  /* float loop */
+  checkhook(J);
+  opreg(J, 0, 0x85, rAX, rAX);  /* test eax, eax */
+  done3 = jcc(J, CC_E);
+  jumpto(J, CC_JMP, target);
+  patchhere(J, done1); patchhere(J, done2); patchhere(J, done3);
+}
+
+
+static void codeinstruction (JitState *J, int pc) {
+  Proto *p = J->p;
+  Instruction i = p->code[pc];
+  int a = GETARG_A(i);
+  switch (genericop(GET_OPCODE(i))) {
+    case OP_MOVE: {
+      copyvalue(J, a, REG_BASE, GETARG_B(i));
+      break;
+    }
+    case OP_LOADK: {
+      copyvalue(J, a, REG_K, GETARG_Bx(i));
+      break;
+    }
+    case OP_LOADKX: {
+      copyvalue(J, a, REG_K, GETARG_Ax(p->code[pc + 1]));
+      break;  /* (OP_EXTRAARG generates no code) */
+    }
+    case OP_LOADBOOL: {
+      movimm(J, REG_BASE, VAL(a), GETARG_B(i));
+      movimm(J, REG_BASE, TAG(a), LUA_TBOOLEAN);
+      if (GETARG_C(i))
+        jumpto(J, CC_JMP, pc + 2);  /* skip next instruction */
+      break;
+    }
+    case OP_LOADNIL: {
+      int b = GETARG_B(i);
+      do {
+        movimm(J, REG_BASE, TAG(a++), LUA_TNIL);
+      } while (b--);
+      break;
+    }
+    case OP_GETUPVAL: {
+      int b = GETARG_B(i);
+      load64(J, rAX, REG_CL, cast_int(offsetof(LClosure, upvals)) +
+                             b * cast_int(sizeof(UpVal *)));
+      load64(J, rAX, rAX, cast_int(offsetof(UpVal, v)));
+      copyvalue(J, a, rAX, 0);
+      break;
+    }
+    case OP_GETTABLE: case OP_SETTABLE: {
+      codeindex(J, pc, i);
+      break;
+    }
+    case OP_ADD: {
+      codearith(J, pc, i, 0x03, 0x0F58);  /* add / addsd */
+      break;
+    }
+    case OP_SUB: {
+      codearith(J, pc, i, 0x2B, 0x0F5C);  /* sub / subsd */
+      break;
+    }
+    case OP_MUL: {
+      codearith(J, pc, i, 0x0FAF, 0x0F59);  /* imul / mulsd */
+      break;
+    }
+    case OP_JMP: {
+      if (a != 0)
+        callexec(J, pc);  /* close upvalues */
+      gotopc(J, pc, pc + 1 + GETARG_sBx(i));
+      break;
+    }
+    case OP_EQ: {
+      codecompare(J, pc, i, CC_E);
+      break;
+    }
+    case OP_LT: {
+      codecompare(J, pc, i, CC_L);
+      break;
+    }
+    case OP_LE: {
+      codecompare(J, pc, i, CC_LE);
+      break;
+    }
+    case OP_TEST: {
+      codetest(J, pc, i);
+      break;
+    }
+    case OP_TESTSET: {
+      callexec(J, pc);
+      opreg(J, 0, 0x85, rAX, rAX);  /* test eax, eax */
+      jumpto(J, CC_NE, pc + 2);
+      break;
+    }
+    case OP_CALL: {
+      callexec(J, pc);
+      opreg(J, 0, 0x85, rAX, rAX);  /* called a Lua function or yielded? */
+      patch(J, jcc(J, CC_NE), J->epilogue);  /* return LUAJ_CALL/LUAJ_YIELD */
+      checkhook(J);
+      break;
+    }
+    case OP_FORLOOP: {
+      codeforloop(J, pc, i);
+      break;
+    }
+    case OP_FORPREP: {
+      callexec(J, pc);
+      checkhook(J);
+      jumpto(J, CC_JMP, pc + 1 + GETARG_sBx(i));
+      break;
+    }
+    case OP_TFORLOOP: {
+      size_t done;
+      callexec(J, pc);
+      opreg(J, 0, 0x85, rAX, rAX);  /* test eax, eax */
+      done = jcc(J, CC_E);
+      gotopc(J, pc, pc + 1 + GETARG_sBx(i));
+      patchhere(J, done);
+      break;
+    }
+    case OP_EXTRAARG: {
+      break;  /* handled by the previous instruction */
+    }
+    case OP_CLOSURE: case OP_TAILCALL: case OP_RETURN: {
+      exitat(J, pc);  /* let the interpreter do it */
+      break;
+    }
+    default: {  /* all other instructions go through 'execop' */
+      callexec(J, pc);
+      checkhook(J);
+      break;
+    }
+  }
+}
+
+
+/*
+** Entry code: save callee-saved registers, load the fixed registers
+** from the arguments, and jump to the entry point (see 'JitFunc').
+** It is followed by the common exit code.
+*/
+static void prologue (JitState *J) {
+  static const unsigned char pro[] = {
+    0x55, 0x53, 0x41, 0x54, 0x41, 0x55,  /* push rbp/rbx/r12/r13 */
+    0x41, 0x56, 0x41, 0x57,  /* push r14/r15 */
+    0x48, 0x83, 0xEC, 0x08  /* sub rsp, 8 (keep stack aligned) */
+  };
+  static const unsigned char epi[] = {
+    0x48, 0x83, 0xC4, 0x08,  /* add rsp, 8 */
+    0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D,  /* pop r15/r14/r13 */
+    0x41, 0x5C, 0x5B, 0x5D, 0xC3  /* pop r12/rbx/rbp; ret */
+  };
+  memcpy(J->code + J->n, pro, sizeof(pro));
+  J->n += sizeof(pro);
+  setreg(J, REG_L, rDI);
+  setreg(J, REG_CI, rSI);
+  setreg(J, REG_BASE, rDX);
+  setreg(J, REG_K, rCX);
+  setreg(J, REG_CL, r8);
+  opreg(J, 0, 0xFF, 4, r9);  /* jmp r9 */
+  J->exit = J->n;
+  opreg(J, 0, 0x31, rAX, rAX);  /* xor eax, eax */
+  J->epilogue = J->n;
+  memcpy(J->code + J->n, epi, sizeof(epi));
+  J->n += sizeof(epi);
+}
+
+
+static size_t maxcodesize (Proto *p) {
+  size_t size = 2 * MAXINSTSIZE;  /* prologue and epilogue */
+  int pc;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction i = p->code[pc];
+    if (GET_OPCODE(i) == OP_LOADNIL)
+      size += 16 * cast(size_t, GETARG_B(i) + 1);
+    else
+      size += MAXINSTSIZE;
+  }
+  return size;
+}
+
+
+/*
+** Compile function 'p'. Code is generated into a temporary buffer
+** (with space for labels and fixups too) and then copied to its own
+** block of executable memory. Returns 0 if that memory is not
+** available.
+*/
+int luaJ_compile (lua_State *L, Proto *p) {
+  JitState J;
+  JitCode *jc;
+  int pc;
+  size_t maxcode = maxcodesize(p);
+  size_t nfix = cast(size_t, p->sizecode) * MAXINSTJUMPS;
+  size_t tsize = nfix * sizeof(Fixup) +
+                 cast(size_t, p->sizecode) * sizeof(unsigned int) + maxcode;
+  size_t hsize, size;
+  void *buff;
+  if (p->sizecode > LUAI_JITMAXCODE)
+    return 0;  /* too large */
+  buff = luaM_malloc(L, tsize);
+  J.p = p;
+  J.fix = cast(Fixup *, buff);
+  J.nfix = 0;
+  J.label = cast(unsigned int *, J.fix + nfix);
+  J.code = cast(unsigned char *, J.label + p->sizecode);
+  J.n = 0;
+  prologue(&J);
+  for (pc = 0; pc < p->sizecode; pc++) {
+    J.label[pc] = cast(unsigned int, J.n);
+    codeinstruction(&J, pc);
+    lua_assert(J.n <= maxcode && cast(size_t, J.nfix) <= nfix);
+  }
+  for (pc = 0; pc < J.nfix; pc++) {  /* patch jumps to instructions */
+    lua_assert(J.fix[pc].target < p->sizecode);
+    patch(&J, J.fix[pc].pos, J.label[J.fix[pc].target]);
+  }
+  hsize = offsetof(JitCode, entry) + cast(size_t, p->sizecode) * sizeof(unsigned int);
+  hsize = (hsize + 15) & ~cast(size_t, 15);  /* align code */
+  size = hsize + J.n;
+  jc = cast(JitCode *, mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (jc != cast(JitCode *, MAP_FAILED)) {
+    jc->size = size;
+    jc->code = cast(unsigned char *, jc) + hsize;
+    memcpy(jc->entry, J.label, cast(size_t, p->sizecode) * sizeof(unsigned int));
+    memcpy(jc->code, J.code, J.n);
+    if (mprotect(jc, size, PROT_READ | PROT_EXEC) == 0)
+      p->jit = jc;
+    else
+      munmap(jc, size);
+  }
+  luaM_freemem(L, buff, tsize);
+  return (p->jit != NULL);
+}
+
+
+/*
+** Run the compiled code of the function running in 'ci', starting at
+** its 'savedpc'.
+*/
+int luaJ_execute (lua_State *L, CallInfo *ci) {
+  LClosure *cl = clLvalue(ci->func);
+  Proto *p = cl->p;
+  JitCode *jc = p->jit;
+  union { unsigned char *code; JitFunc f; } u;  /* (ISO C does not
+                              allow casts from data to function pointers) */
+  u.code = jc->code;
+  return u.f(L, ci, ci->u.l.base, p->k, cl,
+             jc->code + jc->entry[ci->u.l.savedpc - p->code]);
+}
+
+
+void luaJ_free (Proto *p) {
+  JitCode *jc = p->jit;
+  munmap(jc, jc->size);
+  p->jit = NULL;
+}
+
+/* }====================================================== */
+
+#endif
@@ -0,0 +1,75 @@
+/*
+** $Id: ljit.h $
+** Baseline compiler from Lua bytecode to machine code
+** See Copyright Notice in lua.h
+*/
+
+#ifndef ljit_h
+#define ljit_h
+
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** The compiler generates x86-64 code for the System V ABI and gets
+** executable memory through 'mmap'; elsewhere (or with LUA_USE_JIT
+** defined as 0) all functions are only interpreted.
+*/
+#if !defined(LUA_USE_JIT)
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && \
+    !defined(__cplusplus)
+#define LUA_USE_JIT	1
+#else
+#define LUA_USE_JIT	0
+#endif
+#endif
+
+
+/* number of calls (plus loop iterations) before a function is compiled */
+#if !defined(LUAI_JITHOT)
+#define LUAI_JITHOT	64
+#endif
+
+
+/* functions larger than this (in instructions) are not compiled */
+#if !defined(LUAI_JITMAXCODE)
+#define LUAI_JITMAXCODE	20000
+#endif
+
+
+/* results of 'luaJ_execute' */
+#define LUAJ_EXIT	0	/* go on interpreting from 'savedpc' */
+#define LUAJ_CALL	1	/* compiled code called Lua function 'L->ci' */
+#define LUAJ_YIELD	2	/* a C function it called yielded (see 'lua_yieldk') */
+
+
+/*
+** Count one more call or loop iteration of 'p', compiling it when it
+** gets hot. A function that fails to compile keeps a zero count and
+** is not tried again.
+*/
+#define luaJ_hot(L,p)  \
+  ((p)->jitcount > 0 && --(p)->jitcount == 0 && luaJ_compile(L, p))
+
+/*
+** Should the function running in 'ci' (whose prototype is 'p') run
+** compiled code? Only when there are no hooks, and only if it has been
+** compiled already or this call (a fresh one, at its first
+** instruction) makes it hot.
+*/
+#define luaJ_wanted(L,ci,p)  ((L)->hookmask == 0 && ((p)->jit != NULL || \
+  ((ci)->u.l.savedpc == (p)->code && luaJ_hot(L, p))))
+
+/* same, at the backward jump of a loop */
+#define luaJ_loopwanted(L,p)  ((L)->hookmask == 0 && \
+  ((p)->jit != NULL || luaJ_hot(L, p)))
+
+
+LUAI_FUNC int luaJ_compile (lua_State *L, Proto *p);
+LUAI_FUNC int luaJ_execute (lua_State *L, CallInfo *ci);
+LUAI_FUNC void luaJ_free (Proto *p);
+
+
+#endif
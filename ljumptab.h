@@ -0,0 +1,104 @@
+/*
+** $Id: ljumptab.h $
+** Jump Table
+** See Copyright Notice in lua.h
+*/
+
+/*
+** Included only by 'luaV_execute' when LUA_USE_JUMPTABLE is on. It
+** replaces the 'switch' of the interpreter loop with "labels as
+** values" (a GCC extension): each handler ends by fetching the next
+** instruction and jumping directly to its handler, so that every
+** opcode has its own indirect branch (and its own prediction slot).
+*/
+
+#undef vmdispatch
+#undef vmcase
+#undef vmbreak
+
+/* 'goto *' is not ISO C either; silence '-pedantic' only around it */
+#define vmdispatch(x)  \
+	_Pragma("GCC diagnostic push")  \
+	_Pragma("GCC diagnostic ignored \"-Wpedantic\"")  \
+	goto *disptab[x];  \
+	_Pragma("GCC diagnostic pop")
+
+#define vmcase(l)     L_##l:
+
+#define vmbreak		vmfetch(); vmdispatch(GET_OPCODE(i));
+
+
+/* ORDER OP */
+
+/* label addresses are not ISO C; keep '-pedantic' builds quiet here */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+static const void *const disptab[NUM_OPCODES] = {
+
+&&L_OP_MOVE,
+&&L_OP_LOADK,
+&&L_OP_LOADKX,
+&&L_OP_LOADBOOL,
+&&L_OP_LOADNIL,
+&&L_OP_GETUPVAL,
+&&L_OP_GETTABUP,
+&&L_OP_GETTABLE,
+&&L_OP_SETTABUP,
+&&L_OP_SETUPVAL,
+&&L_OP_SETTABLE,
+&&L_OP_NEWTABLE,
+&&L_OP_SELF,
+&&L_OP_ADD,
+&&L_OP_SUB,
+&&L_OP_MUL,
+&&L_OP_MOD,
+&&L_OP_POW,
+&&L_OP_DIV,
+&&L_OP_IDIV,
+&&L_OP_BAND,
+&&L_OP_BOR,
+&&L_OP_BXOR,
+&&L_OP_SHL,
+&&L_OP_SHR,
+&&L_OP_UNM,
+&&L_OP_BNOT,
+&&L_OP_NOT,
+&&L_OP_LEN,
+&&L_OP_CONCAT,
+&&L_OP_JMP,
+&&L_OP_EQ,
+&&L_OP_LT,
+&&L_OP_LE,
+&&L_OP_TEST,
+&&L_OP_TESTSET,
+&&L_OP_CALL,
+&&L_OP_TAILCALL,
+&&L_OP_RETURN,
+&&L_OP_FORLOOP,
+&&L_OP_FORPREP,
+&&L_OP_TFORCALL,
+&&L_OP_TFORLOOP,
+&&L_OP_SETLIST,
+&&L_OP_CLOSURE,
+&&L_OP_VARARG,
+&&L_OP_EXTRAARG,
+&&L_OP_ADDII,
+&&L_OP_ADDFF,
+&&L_OP_SUBII,
+&&L_OP_SUBFF,
+&&L_OP_MULII,
+&&L_OP_MULFF,
+&&L_OP_LTII,
+&&L_OP_LTFF,
+&&L_OP_LEII,
+&&L_OP_LEFF,
+&&L_OP_FORLOOPI,
+&&L_OP_FORLOOPF,
+&&L_OP_GETTABUPCALL,
+&&L_OP_LOADKCALL,
+&&L_OP_LOADKRETURN
+
+};
+
+#pragma GCC diagnostic pop
@@ -193,11 +193,12 @@ typedef unsigned long Instruction;
 /*
 ** Size of cache for strings in the API. 'N' is the number of
 ** sets (better be a prime) and "M" is the size of each set (M == 1
-** makes a direct cache.)
+** makes a direct cache.) Each set keeps its strings from the most to
+** the least recently used.
 */
 #if !defined(STRCACHE_N)
-#define STRCACHE_N		53
-#define STRCACHE_M		2
+#define STRCACHE_N		127
+#define STRCACHE_M		4
 #endif
 
 
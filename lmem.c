@@ -11,6 +11,8 @@
 
 
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -20,6 +22,8 @@
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
+#include "lstring.h"
+#include "ltm.h"
 
 
 
@@ -76,6 +80,218 @@ l_noret luaM_toobig (lua_State *L) {
 
 
 
+/*
+** {======================================================
+** Allocation sampling: once every 'memrate' bytes allocated, the
+** allocation crossing the mark is charged to the line running in the
+** innermost Lua function, in a fixed table of sites (with one more
+** entry for all sites that do not fit).
+** =======================================================
+*/
+
+/* number of sites (a power of 2) */
+#if !defined(LUAI_MEMSITES)
+#define LUAI_MEMSITES	1024
+#endif
+
+typedef struct MemSite {
+  char source[LUA_IDSIZE];
+  int line;
+  lu_mem samples;  /* 0 for a free entry */
+} MemSite;
+
+
+static void samplealloc (lua_State *L, global_State *g) {
+  char source[LUA_IDSIZE];
+  int line = -1;
+  CallInfo *ci = L->ci;
+  lu_mem rate = cast(lu_mem, g->memrate);
+  lu_mem n = cast(lu_mem, -g->memsample) / rate + 1;  /* marks crossed */
+  unsigned int h, i;
+  MemSite *site;
+  g->memsample += cast(l_mem, n * rate);
+  while (ci != &L->base_ci && !isLua(ci))  /* find a Lua function */
+    ci = ci->previous;
+  if (isLua(ci)) {
+    Proto *p = clLvalue(ci->func)->p;
+    int pc = pcRel(ci->u.l.savedpc, p);
+    if (p->source)
+      luaO_chunkid(source, getstr(p->source), LUA_IDSIZE);
+    else
+      strcpy(source, "?");
+    line = (0 <= pc && pc < p->sizelineinfo) ? getfuncline(p, pc)
+                                             : p->linedefined;
+  }
+  else
+    strcpy(source, "[C]");
+  h = luaS_hash(source, strlen(source), cast(unsigned int, line));
+  for (i = 0; i < LUAI_MEMSITES; i++) {  /* linear probing */
+    site = &g->memsites[(h + i) & (LUAI_MEMSITES - 1)];
+    if (site->samples == 0) {  /* free entry? */
+      strcpy(site->source, source);
+      site->line = line;
+      break;
+    }
+    else if (site->line == line && strcmp(site->source, source) == 0)
+      break;
+  }
+  if (i == LUAI_MEMSITES)  /* table is full? */
+    site = &g->memsites[LUAI_MEMSITES];  /* other sites */
+  site->samples += n;
+}
+
+
+/*
+** Sets the number of bytes between samples (0 turns sampling off and
+** clears the sites). Returns the previous value.
+*/
+int luaM_setmemrate (lua_State *L, int rate) {
+  global_State *g = G(L);
+  int res = g->memrate;
+  if (rate > 0 && g->memsites == NULL) {
+    MemSite *sites = luaM_newvector(L, LUAI_MEMSITES + 1, MemSite);
+    int i;
+    for (i = 0; i <= LUAI_MEMSITES; i++)
+      sites[i].samples = 0;
+    strcpy(sites[LUAI_MEMSITES].source, "?");
+    sites[LUAI_MEMSITES].line = -1;
+    g->memsites = sites;
+  }
+  else if (rate <= 0 && g->memsites != NULL) {
+    luaM_freearray(L, g->memsites, LUAI_MEMSITES + 1);
+    g->memsites = NULL;
+  }
+  g->memrate = (rate > 0) ? rate : 0;
+  g->memsample = g->memrate;
+  return res;
+}
+
+
+static int dumpline (lua_State *L, lua_Writer writer, void *data,
+                     const char *kind, const char *name, int line,
+                     lu_mem n1, lu_mem n2) {
+  char buff[LUA_IDSIZE + 80];
+  size_t l = strlen(kind);
+  int status;
+  memcpy(buff, kind, l);
+  buff[l++] = '\t';
+  l += strlen(strcpy(buff + l, name));
+  if (line >= 0) {
+    buff[l++] = ':';
+    l += lua_integer2str(buff + l, 20, line);
+  }
+  buff[l++] = '\t';
+  l += lua_integer2str(buff + l, 30, n1);
+  buff[l++] = '\t';
+  l += lua_integer2str(buff + l, 30, n2);
+  buff[l++] = '\n';
+  lua_unlock(L);
+  status = (*writer)(L, buff, l, data);
+  lua_lock(L);
+  return status;
+}
+
+
+/*
+** Writes, one per line and with tab-separated fields, the number of
+** objects of each type and the memory they use ("type", name, count,
+** bytes), the same for the pool of dead threads ("pool", "thread",
+** count, bytes) and, when sampling is on, the sampling rate ("rate",
+** bytes) and the samples of each site ("site", source:line, samples,
+** estimated bytes allocated). Returns the first non-zero status from
+** the writer, or 0.
+*/
+int luaM_memdump (lua_State *L, lua_Writer writer, void *data) {
+  static const int types[] = {LUA_TSTRING, LUA_TTABLE, LUA_TFUNCTION,
+    LUA_TUSERDATA, LUA_TTHREAD, LUA_TPROTO};
+  global_State *g = G(L);
+  lu_mem count[LUA_TOTALTAGS], bytes[LUA_TOTALTAGS];
+  int status = 0;
+  int i;
+  luaC_memusage(g, count, bytes);
+  for (i = 0; status == 0 && i < (int)(sizeof(types)/sizeof(types[0])); i++)
+    status = dumpline(L, writer, data, "type", ttypename(types[i]), -1,
+                      count[types[i]], bytes[types[i]]);
+  if (status == 0)  /* dead threads kept for reuse */
+    status = dumpline(L, writer, data, "pool", "thread", -1,
+                      g->nthreadpool, luaC_poolusage(g));
+  if (status == 0 && g->memsites != NULL) {
+    char buff[30];
+    size_t l = lua_integer2str(buff, sizeof(buff) - 1, g->memrate);
+    buff[l++] = '\n';
+    lua_unlock(L);
+    status = (*writer)(L, "rate\t", 5, data);
+    if (status == 0) status = (*writer)(L, buff, l, data);
+    lua_lock(L);
+    for (i = 0; status == 0 && i <= LUAI_MEMSITES; i++) {
+      /* sites may be added (or turned off) by the writer */
+      MemSite *site = (g->memsites != NULL) ? &g->memsites[i] : NULL;
+      if (site != NULL && site->samples > 0)
+        status = dumpline(L, writer, data, "site", site->source, site->line,
+                          site->samples, site->samples * g->memrate);
+    }
+  }
+  return status;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Memory limits
+** =======================================================
+*/
+
+static void calllimitf (lua_State *L, global_State *g, int what,
+                        lu_mem total) {
+  if (g->memlimitf != NULL) {
+    lua_unlock(L);
+    (*g->memlimitf)(g->memlimitud, L, what, cast(size_t, total));
+    lua_lock(L);
+  }
+}
+
+
+/*
+** Called when an allocation of 'delta' more bytes would take memory
+** use above 'memcheck'. Crossing the soft limit makes the collector
+** start (or advance) a cycle right away and work faster until memory
+** use gets back below the limit at the end of a cycle (see 'lgc.c').
+** Crossing the hard limit runs an emergency collection; if that does
+** not free enough memory, and neither does the limit function (which
+** can, for instance, raise the limit), the allocation fails.
+*/
+static void checklimits (lua_State *L, global_State *g, size_t delta) {
+  lu_mem total = gettotalbytes(g) + delta;
+  if (g->memsoft > 0 && !g->memover && total > g->memsoft) {
+    g->memover = 1;
+    if (g->GCdebt < 0)
+      luaE_setdebt(g, 0);  /* collector should run at the next check */
+    calllimitf(L, g, LUA_GCSETSOFTLIMIT, total);
+  }
+  if (g->memhard > 0 && total > g->memhard) {
+    if (g->version && g->gckind != KGC_EMERGENCY && !g->gcstopem) {
+      luaC_fullgc(L, 1);
+      total = gettotalbytes(g) + delta;
+    }
+    if (total > g->memhard) {
+      calllimitf(L, g, LUA_GCSETHARDLIMIT, total);
+      total = gettotalbytes(g) + delta;
+    }
+    if (g->memhard > 0 && total > g->memhard) {
+      luaE_setmemcheck(g);
+      luaD_throw(L, LUA_ERRMEM);
+    }
+  }
+  luaE_setmemcheck(g);
+}
+
+/* }====================================================== */
+
+
+
 /**
  * generic allocation routine.
  * 内存分配函数
@@ -97,10 +313,17 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   if (nsize > realosize && g->gcrunning)
     luaC_fullgc(L, 1);  /* force a GC whenever possible */
 #endif
-  newblock = (*g->frealloc)(g->ud, block, osize, nsize);
+  if (nsize > realosize && gettotalbytes(g) + (nsize - realosize) > g->memcheck)
+    checklimits(L, g, nsize - realosize);  /* may raise a memory error */
+  if (nsize == 0 && g->deferfree && block != NULL) {  /* a dead block? */
+    luaC_deferfree(g, block, osize);  /* background thread will free it */
+    newblock = NULL;
+  }
+  else
+    newblock = (*g->frealloc)(g->ud, block, osize, nsize);
   if (newblock == NULL && nsize > 0) {
     lua_assert(nsize > realosize);  /* cannot fail when shrinking a block */
-    if (g->version) {  /* is state fully built? */
+    if (g->version && !g->gcstopem) {  /* can collect? */
       luaC_fullgc(L, 1);  /* try to free some memory... */
       newblock = (*g->frealloc)(g->ud, block, osize, nsize);  /* try again */
     }
@@ -109,6 +332,11 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   }
   lua_assert((nsize == 0) == (newblock == NULL));
   g->GCdebt = (g->GCdebt + nsize) - realosize;
+  if (g->memsites != NULL && nsize > realosize) {  /* sampling? */
+    g->memsample -= cast(l_mem, nsize - realosize);
+    if (g->memsample < 0)  /* crossed a sampling mark? */
+      samplealloc(L, g);
+  }
   return newblock;
 }
 
@@ -129,6 +129,8 @@ LUAI_FUNC void *luaM_realloc_ (lua_State *L, void *block, size_t oldsize,
 LUAI_FUNC void *luaM_growaux_ (lua_State *L, void *block, int *size,
 		size_t size_elem, int limit,
 		const char *what);
+LUAI_FUNC int luaM_setmemrate (lua_State *L, int rate);
+LUAI_FUNC int luaM_memdump (lua_State *L, lua_Writer writer, void *data);
 
 #endif
 
@@ -342,7 +342,7 @@ typedef struct TString {
    * , reserved words for short strings; "has hash" for longs */
   lu_byte extra;  
   
-  lu_byte shrlen;  /* 由于Lua并不以'\0'字符结尾来识别字符串的长度,因此需要一个len域来记录其长度 length for short strings */
+  lu_byte shrlen;  /* 由于Lua并不以'\0'字符结尾来识别字符串的长度,因此需要一个len域来记录其长度 length for short strings; for long strings, non-zero with a 'StrBuff' */
   unsigned int hash; /*记录字符串的hash值,可以用来加快字符串的匹配和查找*/
   union {
     size_t lnglen;  /* 长字符串存储形式 length for long strings */
@@ -365,12 +365,47 @@ typedef union UTString {
 } UTString;
 
 
+/*
+** Buffer shared by long strings built by repeated concatenation (see
+** 'luaS_extend'). Each of these strings has a pointer to the buffer
+** after its header (instead of its bytes) and a non-zero 'shrlen', and
+** its bytes are a prefix of 'data'. Only the longest string in the
+** buffer (length 'used') is followed by a '\0'; it can grow in place,
+** unless the buffer is 'sealed'. The buffer is freed with the last
+** string using it. External strings ('lua_pushexternalstring') also
+** use a 'StrBuff', which points to memory of the host and calls
+** 'freef' to release it.
+*/
+typedef struct StrBuff {
+  size_t refs;  /* number of strings using this buffer */
+  size_t used;  /* length of the longest string in 'data' */
+  size_t size;  /* size of 'data' (0 if not owned by Lua) */
+  char *data;  /* bytes (following the structure, if owned by Lua) */
+  lua_FreeF freef;  /* function to release external 'data' (or NULL) */
+  void *ud;  /* auxiliary data to 'freef' */
+  lu_byte sealed;  /* true if strings cannot grow in place anymore */
+} StrBuff;
+
+#define buffdata(b)	((b)->data)
+
+
+/* test whether a string keeps its bytes in a 'StrBuff' */
+#define isbuffstr(ts)	((ts)->tt == LUA_TLNGSTR && (ts)->shrlen != 0)
+
+/* the 'StrBuff' of a string (only for those keeping their bytes there) */
+#define getbuff(ts)  \
+  (*check_exp(isbuffstr(ts), cast(StrBuff **, rawgetstr(ts))))
+
+/* the address after the header of a 'TString' */
+#define rawgetstr(ts)	(cast(char *, (ts)) + sizeof(UTString))
+
 /*
 ** Get the actual string (array of bytes) from a 'TString'.
 ** (Access to 'extra' ensures that value is really a 'TString'.)
 */
 #define getstr(ts)  \
-  check_exp(sizeof((ts)->extra), cast(char *, (ts)) + sizeof(UTString))
+  check_exp(sizeof((ts)->extra), \
+            isbuffstr(ts) ? buffdata(getbuff(ts)) : rawgetstr(ts))
 
 
 /* get the actual string (array of bytes) from a Lua value */
@@ -460,6 +495,7 @@ typedef struct Proto {
   int sizeupvalues;  /* 闭包变量数组长度 size of 'upvalues' */
   int sizek;  /* 常量数组长度 size of 'k' */
   int sizecode;/*指令数组的长度*/
+  int sizeicache;  /* size of 'icache' */
   int sizelineinfo;/*行信息数组长度*/
   int sizep;  /* 嵌套的Proto数组长度 size of 'p' */
   int sizelocvars;/*局部变量数组长度*/
@@ -467,6 +503,7 @@ typedef struct Proto {
   int lastlinedefined;  /* 函数的起始定义行号 debug information  */
   TValue *k;  /* 常量数组 constants used by the function */
   Instruction *code;  /* 三地址指令数组 opcodes */
+  unsigned int *icache;  /* inline caches for field accesses (one per opcode) */
   struct Proto **p;  /* 嵌套的Proto数组 functions defined inside the function */
   int *lineinfo;  /* 行信息数组 map from opcodes to source lines (debug information) */
   LocVar *locvars;  /* 局部变量数组 information about local variables (debug information) */
@@ -474,6 +511,8 @@ typedef struct Proto {
   struct LClosure *cache;  /* 缓存嵌套的Proto的闭包 last-created closure with this prototype */
   TString  *source;  /* 源码字符串 used for debug information */
   GCObject *gclist;/*垃圾回收专用*/
+  struct JitCode *jit;  /* machine code for the function (see 'ljit.c') */
+  int jitcount;  /* calls left before compiling it */
 } Proto;
 
 
@@ -551,6 +590,33 @@ typedef struct Node {
   TKey i_key;
 } Node;
 
+/*
+** Key layout shared by record tables (see 'ltable.c'): a table with
+** shape 's' keeps the value for key 's->keys[i]' in its slot 'i'.
+** Shapes form a tree rooted at the shape with no keys; each child adds
+** one key to the keys of its parent.
+*/
+typedef struct Shape {
+  struct Shape *parent;
+  struct Shape *children;  /* list of shapes extending this one */
+  struct Shape *sibling;  /* next shape in the parent's 'children' */
+  int refcount;  /* number of tables and children using this shape */
+  int nkeys;  /* number of keys */
+  TString *keys[1];  /* the keys, in slot order */
+} Shape;
+
+
+/*
+** Hash part being replaced by a larger one, which takes its entries a
+** few at a time (see 'ltable.c')
+*/
+typedef struct OldHash {
+  Node *node;
+  lu_byte lsizenode;  /* log2 of its number of nodes */
+  unsigned int pos;  /* nodes before this one were moved already */
+} OldHash;
+
+
 /**
  * Table数据结构,分两种存储类型:数组节点和hash节点
  * 数组节点:sizearray为数字长度,一般存储key值在长度范围内的结果集
@@ -571,6 +637,9 @@ typedef struct Table {
   Node *lastfree;  /* hash节点,最后一个空闲节点 any free position is before this position */
   struct Table *metatable;  //元表,重载操作需要用
   GCObject *gclist;//用以垃圾回收的
+  Shape *shape;  /* key layout, when values are in 'slots' (or NULL) */
+  TValue *slots;  /* values for the keys in 'shape' */
+  OldHash *oldhash;  /* hash part still being moved to 'node' (or NULL) */
 } Table;
 
 
@@ -65,6 +65,21 @@ LUAI_DDEF const char *const luaP_opnames[NUM_OPCODES+1] = {
   "CLOSURE",
   "VARARG",
   "EXTRAARG",
+  "ADDII",
+  "ADDFF",
+  "SUBII",
+  "SUBFF",
+  "MULII",
+  "MULFF",
+  "LTII",
+  "LTFF",
+  "LEII",
+  "LEFF",
+  "FORLOOPI",
+  "FORLOOPF",
+  "GETTABUPCALL",
+  "LOADKCALL",
+  "LOADKRETURN",
   NULL
 };
 
@@ -124,6 +139,41 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, OpArgU, OpArgN, iABx)		/* OP_CLOSURE */
  ,opmode(0, 1, OpArgU, OpArgN, iABC)		/* OP_VARARG */
  ,opmode(0, 0, OpArgU, OpArgU, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDFF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUBII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUBFF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_MULII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_MULFF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTII */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTFF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LEII */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LEFF */
+ ,opmode(0, 1, OpArgR, OpArgN, iAsBx)		/* OP_FORLOOPI */
+ ,opmode(0, 1, OpArgR, OpArgN, iAsBx)		/* OP_FORLOOPF */
+ ,opmode(0, 1, OpArgU, OpArgK, iABC)		/* OP_GETTABUPCALL */
+ ,opmode(0, 1, OpArgK, OpArgN, iABx)		/* OP_LOADKCALL */
+ ,opmode(0, 1, OpArgK, OpArgN, iABx)		/* OP_LOADKRETURN */
+};
+
+
+LUAI_DDEF const lu_byte luaP_genericop[NUM_OPCODES] = {
+  OP_MOVE, OP_LOADK, OP_LOADKX, OP_LOADBOOL, OP_LOADNIL, OP_GETUPVAL,
+  OP_GETTABUP, OP_GETTABLE, OP_SETTABUP, OP_SETUPVAL, OP_SETTABLE,
+  OP_NEWTABLE, OP_SELF, OP_ADD, OP_SUB, OP_MUL, OP_MOD, OP_POW, OP_DIV,
+  OP_IDIV, OP_BAND, OP_BOR, OP_BXOR, OP_SHL, OP_SHR, OP_UNM, OP_BNOT,
+  OP_NOT, OP_LEN, OP_CONCAT, OP_JMP, OP_EQ, OP_LT, OP_LE, OP_TEST,
+  OP_TESTSET, OP_CALL, OP_TAILCALL, OP_RETURN, OP_FORLOOP, OP_FORPREP,
+  OP_TFORCALL, OP_TFORLOOP, OP_SETLIST, OP_CLOSURE, OP_VARARG,
+  OP_EXTRAARG,
+  OP_ADD, OP_ADD,		/* OP_ADDII, OP_ADDFF */
+  OP_SUB, OP_SUB,		/* OP_SUBII, OP_SUBFF */
+  OP_MUL, OP_MUL,		/* OP_MULII, OP_MULFF */
+  OP_LT, OP_LT,			/* OP_LTII, OP_LTFF */
+  OP_LE, OP_LE,			/* OP_LEII, OP_LEFF */
+  OP_FORLOOP, OP_FORLOOP,	/* OP_FORLOOPI, OP_FORLOOPF */
+  OP_GETTABUP,			/* OP_GETTABUPCALL */
+  OP_LOADK, OP_LOADK		/* OP_LOADKCALL, OP_LOADKRETURN */
 };
 
 /**
@@ -325,11 +325,42 @@ OP_CLOSURE,
 
 OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-2) = vararg		可变参数赋值操作 */
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/*
+** Quickened opcodes: type-specialized forms of generic opcodes. The
+** code generator never emits them; 'luaV_execute' rewrites a generic
+** instruction into one of them after running it with operands of the
+** given types, and back into the generic form when the types change.
+*/
+OP_ADDII,/*	A B C	R(A) := RK(B) + RK(C)	(integers)		*/
+OP_ADDFF,/*	A B C	R(A) := RK(B) + RK(C)	(floats)		*/
+OP_SUBII,/*	A B C	R(A) := RK(B) - RK(C)	(integers)		*/
+OP_SUBFF,/*	A B C	R(A) := RK(B) - RK(C)	(floats)		*/
+OP_MULII,/*	A B C	R(A) := RK(B) * RK(C)	(integers)		*/
+OP_MULFF,/*	A B C	R(A) := RK(B) * RK(C)	(floats)		*/
+OP_LTII,/*	A B C	if ((RK(B) <  RK(C)) ~= A) then pc++	(integers)	*/
+OP_LTFF,/*	A B C	if ((RK(B) <  RK(C)) ~= A) then pc++	(floats)	*/
+OP_LEII,/*	A B C	if ((RK(B) <= RK(C)) ~= A) then pc++	(integers)	*/
+OP_LEFF,/*	A B C	if ((RK(B) <= RK(C)) ~= A) then pc++	(floats)	*/
+OP_FORLOOPI,/*	A sBx	OP_FORLOOP over an integer loop			*/
+OP_FORLOOPF,/*	A sBx	OP_FORLOOP over a float loop			*/
+
+/*
+** Superinstructions: like quickened opcodes, but for a pair of adjacent
+** instructions. 'luaV_execute' rewrites the first instruction of the
+** pair into one of them; it then runs both in a single dispatch and
+** skips the second one, which stays in place (so jumps into it and
+** debug information still work). There are no fused forms for the
+** comparisons and OP_TEST: they already run their following OP_JMP.
+*/
+OP_GETTABUPCALL,/*	OP_GETTABUP followed by OP_CALL		*/
+OP_LOADKCALL,/*	OP_LOADK followed by OP_CALL			*/
+OP_LOADKRETURN/*	OP_LOADK followed by OP_RETURN			*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_EXTRAARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_LOADKRETURN) + 1)
 
 
 
@@ -385,6 +416,17 @@ LUAI_DDEC const lu_byte luaP_opmodes[NUM_OPCODES];
 LUAI_DDEC const char *const luaP_opnames[NUM_OPCODES+1];  /* opcode names */
 
 
+/*
+** generic opcode of a quickened one (or of the first instruction of
+** a superinstruction); other opcodes map to themselves.
+** Code that inspects instructions outside 'luaV_execute' (debug info,
+** 'luaV_finishOp', 'lua_dump') must look through this mapping.
+*/
+LUAI_DDEC const lu_byte luaP_genericop[NUM_OPCODES];
+
+#define genericop(o)	(cast(OpCode, luaP_genericop[o]))
+
+
 /**
  * number of list items to accumulate before a SETLIST instruction
  * 当前构造表时内部的数组部分的数据如果超过这个值,就首先调用一次OP_SETLIST函数写入寄存器中
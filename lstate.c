@@ -36,6 +36,14 @@
 #define LUAI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 #endif
 
+#if !defined(LUAI_GENMINORMUL)
+#define LUAI_GENMINORMUL	20  /* minor collection after allocating 20% */
+#endif
+
+#if !defined(LUAI_GENMAJORMUL)
+#define LUAI_GENMAJORMUL	100  /* major collection when memory doubles */
+#endif
+
 
 /*
 ** a macro to help the creation of a unique random seed when a state is
@@ -108,6 +116,23 @@ void luaE_setdebt (global_State *g, l_mem debt) {
 }
 
 
+/*
+** set the memory use above which 'luaM_realloc_' calls 'checklimits':
+** the soft limit, if not crossed since the end of the last cycle, or
+** the hard limit
+*/
+void luaE_setmemcheck (global_State *g) {
+  lu_mem check = MAX_LUMEM;
+  if (g->memover && gettotalbytes(g) <= g->memsoft)
+    g->memover = 0;  /* back below the soft limit */
+  if (g->memsoft > 0 && !g->memover)
+    check = g->memsoft;
+  if (g->memhard > 0 && g->memhard < check)
+    check = g->memhard;
+  g->memcheck = check;
+}
+
+
 CallInfo *luaE_extendCI (lua_State *L) {
   CallInfo *ci = luaM_new(L, CallInfo);
   lua_assert(L->ci->next == NULL);
@@ -150,21 +175,18 @@ void luaE_shrinkCI (lua_State *L) {
   }
 }
 
-/**
- * 栈初始化(栈分为数据栈 + 调用栈)
- */
-static void stack_init (lua_State *L1, lua_State *L) {
+/*
+** erase the whole stack of a thread and set its first 'ci' (keeping
+** the rest of the 'ci' list, if any)
+*/
+static void stack_reset (lua_State *L1) {
   int i; CallInfo *ci;
-  /* initialize stack array */
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);// lua的调用栈 默认40个
-  L1->stacksize = BASIC_STACK_SIZE;
-  for (i = 0; i < BASIC_STACK_SIZE; i++)
-    setnilvalue(L1->stack + i);  /* erase new stack */
+  for (i = 0; i < L1->stacksize; i++)
+    setnilvalue(L1->stack + i);  /* erase stack */
   L1->top = L1->stack;
-  L1->stack_last = L1->stack + L1->stacksize - EXTRA_STACK;//lua的数据栈 栈顶默认到35,空出5个做buf？
   /* initialize first ci */
   ci = &L1->base_ci;
-  ci->next = ci->previous = NULL;
+  ci->previous = NULL;
   ci->callstatus = 0;
   ci->func = L1->top;//指向当前栈顶
   setnilvalue(L1->top++);  /* 'function' entry for this 'ci' */
@@ -173,6 +195,19 @@ static void stack_init (lua_State *L1, lua_State *L) {
 }
 
 
+/**
+ * 栈初始化(栈分为数据栈 + 调用栈)
+ */
+static void stack_init (lua_State *L1, lua_State *L) {
+  /* initialize stack array */
+  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);// lua的调用栈 默认40个
+  L1->stacksize = BASIC_STACK_SIZE;
+  L1->stack_last = L1->stack + L1->stacksize - EXTRA_STACK;//lua的数据栈 栈顶默认到35,空出5个做buf？
+  L1->base_ci.next = NULL;
+  stack_reset(L1);
+}
+
+
 static void freestack (lua_State *L) {
   if (L->stack == NULL)
     return;  /* stack not completely built yet */
@@ -223,18 +258,14 @@ static void f_luaopen (lua_State *L, void *ud) {
 
 
 /*
-** preinitialize a thread with consistent values without allocating
-** any memory (to avoid errors)
+** set the fields of a thread not related to its stack to their
+** initial values
 */
-static void preinit_thread (lua_State *L, global_State *g) {
-  G(L) = g;
-  L->stack = NULL;
-  L->ci = NULL;
-  L->nci = 0;
-  L->stacksize = 0;
+static void resetstate (lua_State *L) {
   L->twups = L;  /* thread has no upvalues */
   L->errorJmp = NULL;
   L->nCcalls = 0;
+  L->nCbase = 0;
   L->hook = NULL;
   L->hookmask = 0;
   L->basehookcount = 0;
@@ -247,6 +278,20 @@ static void preinit_thread (lua_State *L, global_State *g) {
 }
 
 
+/*
+** preinitialize a thread with consistent values without allocating
+** any memory (to avoid errors)
+*/
+static void preinit_thread (lua_State *L, global_State *g) {
+  G(L) = g;
+  L->stack = NULL;
+  L->ci = NULL;
+  L->nci = 0;
+  L->stacksize = 0;
+  resetstate(L);
+}
+
+
 /**
  * 释放Lua栈结构
  */
@@ -254,9 +299,13 @@ static void close_state (lua_State *L) {
   global_State *g = G(L);
   luaF_close(L, L->stack);  /*释放Lua栈的upvalues close all upvalues for this thread */
   luaC_freeallobjects(L);  /*释放全部对象 collect all objects */
+  luaE_freethreadpool(L);
+  luaH_freeshapes(L);
   if (g->version)  /* closing a fully built state? */
     luai_userstateclose(L);
+  luaM_setmemrate(L, 0);  /* free allocation sites */
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+  luaM_freearray(L, G(L)->strt.oldhash, G(L)->strt.oldsize);
   freestack(L);
   lua_assert(gettotalbytes(g) == sizeof(LG));
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
@@ -272,8 +321,17 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   lua_State *L1;
   lua_lock(L);
   luaC_checkGC(L);
-  /* create new thread */
-  L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
+  if (g->threadpool != NULL) {  /* reuse a thread freed by the collector */
+    L1 = gco2th(g->threadpool);
+    g->threadpool = L1->next;
+    g->nthreadpool--;
+    luaC_dropid(g, L1);  /* a new thread for heap snapshots */
+    resetstate(L1);  /* its stack is reset below */
+  }
+  else {  /* create new thread */
+    L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
+    preinit_thread(L1, g);
+  }
   L1->marked = luaC_white(g);
   L1->tt = LUA_TTHREAD;
   /* link it on list 'allgc' */
@@ -282,7 +340,6 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   /* anchor it on L stack */
   setthvalue(L, L->top, L1);//栈顶上 设置一个新的L1对象
   api_incr_top(L);
-  preinit_thread(L1, g);
   L1->hookmask = L->hookmask;
   L1->basehookcount = L->basehookcount;
   L1->hook = L->hook;
@@ -291,19 +348,75 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   memcpy(lua_getextraspace(L1), lua_getextraspace(g->mainthread),
          LUA_EXTRASPACE);
   luai_userstatethread(L, L1);
-  stack_init(L1, L);  /* init stack */
+  if (L1->stack == NULL)
+    stack_init(L1, L);  /* init stack */
+  else
+    stack_reset(L1);  /* erase stack kept from the pool */
   lua_unlock(L);
   return L1;
 }
 
 
+/*
+** Reset a thread that is not running (dead, suspended, or not started)
+** to the state of a new thread, closing its upvalues; returns the
+** status it had. The stack keeps its size: shrinking it could raise a
+** memory error, and this function must not raise (the thread may have
+** no error handler); the collector shrinks it later, as for any thread.
+*/
+LUA_API int lua_resetthread (lua_State *L) {
+  int status;
+  lua_lock(L);
+  status = L->status;
+  api_check(L, status != LUA_OK || L->ci == &L->base_ci,
+               "cannot reset a running thread");
+  luaF_close(L, L->stack);  /* close all upvalues for this thread */
+  L->status = LUA_OK;
+  L->errfunc = 0;
+  L->allowhook = 1;
+  stack_reset(L);
+  lua_unlock(L);
+  return status;
+}
+
+
+/*
+** Free a dead thread; while the pool has room, keep it (and its stack,
+** if not too large) for 'lua_newthread' to reuse instead.
+*/
 void luaE_freethread (lua_State *L, lua_State *L1) {
-  LX *l = fromstate(L1);
+  global_State *g = G(L);
   luaF_close(L1, L1->stack);  /* close all upvalues for this thread */
   lua_assert(L1->openupval == NULL);
   luai_userstatefree(L, L1);
-  freestack(L1);
-  luaM_free(L, l);
+  if (g->nthreadpool < LUAI_THREADPOOL && L1->stack != NULL &&
+      L1->stacksize <= LUAI_POOLSTACK) {
+    L1->ci = &L1->base_ci;
+    luaE_shrinkCI(L1);  /* keep only some of its 'ci's */
+    L1->next = g->threadpool;
+    g->threadpool = obj2gco(L1);
+    g->nthreadpool++;
+  }
+  else {
+    freestack(L1);
+    luaM_free(L, fromstate(L1));
+  }
+}
+
+
+/*
+** Free all threads kept for reuse
+*/
+void luaE_freethreadpool (lua_State *L) {
+  global_State *g = G(L);
+  while (g->threadpool != NULL) {
+    lua_State *L1 = gco2th(g->threadpool);
+    g->threadpool = L1->next;
+    luaC_dropid(g, L1);
+    freestack(L1);
+    luaM_free(L, fromstate(L1));
+  }
+  g->nthreadpool = 0;
 }
 
 /**
@@ -335,9 +448,16 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->mainthread = L;
   g->seed = makeseed(L);
   g->gcrunning = 0;  /* no GC while building state */
+  g->gcstopem = 0;
   g->GCestimate = 0;
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
+  g->strt.oldhash = NULL;
+  g->strt.oldsize = g->strt.oldpos = 0;
+  g->strcachehits = g->strcachemisses = 0;
+  g->pinned = NULL;
+  g->snapids = NULL;
+  g->snapserial = 0;
   setnilvalue(&g->l_registry);
   g->panic = NULL;
   g->version = NULL;
@@ -348,12 +468,38 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gray = g->grayagain = NULL;
   g->weak = g->ephemeron = g->allweak = NULL;
   g->twups = NULL;
+  g->threadpool = NULL;
+  g->nthreadpool = 0;
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
   g->gcfinnum = 0;
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
+  g->genminormul = LUAI_GENMINORMUL;
+  g->genmajormul = LUAI_GENMAJORMUL;
+  g->gcsteptime = 0;
+  g->gcmaxpause = 0;
+  g->gcatomictime = 0;
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
+  g->gcclock = 0;
+  g->gcphasef = NULL;
+  g->gcphaseud = NULL;
+  g->memsites = NULL;
+  g->memsample = 0;
+  g->memrate = 0;
+  g->memsoft = g->memhard = 0;
+  g->memcheck = MAX_LUMEM;
+  g->memover = 0;
+  g->memlimitf = NULL;
+  g->memlimitud = NULL;
+  g->gcmarkers = NULL;
+  g->gcthreads = LUAI_GCTHREADS;
+  g->gcfreer = NULL;
+  g->deferfree = 0;
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
+  g->shaperoot.parent = g->shaperoot.children = g->shaperoot.sibling = NULL;
+  g->shaperoot.refcount = 1;  /* never released */
+  g->shaperoot.nkeys = 0;
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {//f_luaopen函数中调用了 stack_init 函数
     /* memory allocation error: free partial state */
     close_state(L);
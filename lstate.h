@@ -68,9 +68,24 @@ struct lua_longjmp;  /* defined in ldo.c */
 #define BASIC_STACK_SIZE        (2*LUA_MINSTACK)
 
 
+/*
+** Up to LUAI_THREADPOOL threads freed by the collector are kept, with
+** their stacks, for 'lua_newthread' to reuse; threads whose stacks
+** grew larger than LUAI_POOLSTACK slots are freed as usual.
+*/
+#if !defined(LUAI_THREADPOOL)
+#define LUAI_THREADPOOL		128
+#endif
+
+#if !defined(LUAI_POOLSTACK)
+#define LUAI_POOLSTACK		(8*BASIC_STACK_SIZE)
+#endif
+
+
 /* kinds of Garbage Collection */
 #define KGC_NORMAL	0
 #define KGC_EMERGENCY	1	/* gc was forced by an allocation failure */
+#define KGC_GEN		2	/* generational collection */
 
 
 typedef struct stringtable {
@@ -83,6 +98,13 @@ typedef struct stringtable {
 	TString **hash;
 	int nuse;  /* 字符串表当前字符串数量 number of elements */
 	int size;/*字符串表最大字符串数量*/
+	/**
+	 * 增量调整大小时的旧数组（没有调整时为 NULL）
+	 * old array while resizing incrementally (NULL otherwise)
+	 */
+	TString **oldhash;
+	int oldsize;  /* size of 'oldhash' */
+	int oldpos;  /* buckets before this one were moved already */
 } stringtable;
 
 
@@ -277,6 +299,11 @@ typedef struct global_State {
 	 * true if GC is running
 	 */
 	lu_byte gcrunning;
+	/**
+	 * true while emergency collections must not run (objects are being
+	 * walked, see 'luaC_snapshot')
+	 */
+	lu_byte gcstopem;
 	/**
 	 * list of all collectable objects
 	 * 存放待GC对象的链表，所有对象创建之后都会放入该链表中
@@ -329,6 +356,11 @@ typedef struct global_State {
 	 * list of threads with open upvalues
 	 */
 	struct lua_State *twups;
+	/**
+	 * dead threads kept for reuse, and how many (see 'luaE_freethread')
+	 */
+	GCObject *threadpool;
+	int nthreadpool;
 	/**
 	 * number of finalizers to call in each GC step
 	 */
@@ -343,6 +375,75 @@ typedef struct global_State {
 	 * 将影响每次手动GC时调用singlestep函数的次数，从而影响到GC回收的速度
 	 */
 	int gcstepmul;
+	/**
+	 * 分代模式下，每次回收后再分配其内存的 genminormul% 即进行一次小回收
+	 * control frequency of minor collections (generational mode)
+	 */
+	int genminormul;
+	/**
+	 * 内存超过上次主回收后的 (100 + genmajormul)% 时进行主回收
+	 * control frequency of major collections (generational mode)
+	 */
+	int genmajormul;
+	/**
+	 * 每步增量回收的时间预算（微秒）；0 表示按内存债务控制步长
+	 * time budget (in microseconds) for each step; 0 paces by debt
+	 */
+	int gcsteptime;
+	/**
+	 * target maximum pause (in microseconds) of a timed step (0: none)
+	 */
+	int gcmaxpause;
+	/**
+	 * how long (in microseconds) the last atomic phase took
+	 */
+	lu_mem gcatomictime;
+	/**
+	 * 回收器统计数据
+	 * collector statistics (see 'lua_gcstats')
+	 */
+	lua_GCStats gcstats;
+	/**
+	 * clock reading when time was last charged to a phase
+	 */
+	lu_mem gcclock;
+	/**
+	 * function called when the collector changes phase (or NULL)
+	 */
+	lua_GCPhaseF gcphasef;
+	void *gcphaseud;  /* auxiliary data to 'gcphasef' */
+	/**
+	 * 内存分配采样点（关闭采样时为 NULL）
+	 * sites of sampled allocations (NULL when sampling is off)
+	 */
+	struct MemSite *memsites;
+	l_mem memsample;  /* bytes to allocate before the next sample */
+	int memrate;  /* bytes between samples */
+	/**
+	 * 内存软限制与硬限制（0 表示没有限制）
+	 * soft and hard limits for memory in use (0: no limit)
+	 */
+	lu_mem memsoft;
+	lu_mem memhard;
+	lu_mem memcheck;  /* memory use above which 'luaM_realloc_' checks limits */
+	lu_byte memover;  /* above soft limit since the end of the last cycle? */
+	lua_MemLimitF memlimitf;  /* function called when crossing a limit */
+	void *memlimitud;  /* auxiliary data to 'memlimitf' */
+	/**
+	 * 并行标记所用的线程（只在原子阶段中存在）
+	 * threads for parallel marking (only during an atomic phase)
+	 */
+	struct GCMarkers *gcmarkers;
+	int gcthreads;  /* number of threads marking in parallel */
+	/**
+	 * 在后台释放死对象内存的线程
+	 * thread freeing dead blocks in the background (or NULL)
+	 */
+	struct GCFreer *gcfreer;
+	/**
+	 * true while sweeping with 'gcfreer' (frees go to it)
+	 */
+	lu_byte deferfree;
 	/**
 	 * to be called in unprotected errors
 	 */
@@ -375,6 +476,24 @@ typedef struct global_State {
 	 * 字符串缓存 cache for strings in API
 	 */
 	TString *strcache[STRCACHE_N][STRCACHE_M];
+	/**
+	 * lookups in 'strcache' that found and did not find their strings
+	 */
+	size_t strcachehits, strcachemisses;
+	/**
+	 * strings pinned after they were created, as keys (see 'luaS_pin')
+	 */
+	struct Table *pinned;
+	/**
+	 * ids of objects in heap snapshots, keyed by their addresses
+	 * (created by the first snapshot; see 'snapid')
+	 */
+	struct Table *snapids;
+	lua_Integer snapserial;  /* last id given to an object */
+	/**
+	 * root of the tree of table shapes (the shape with no keys)
+	 */
+	Shape shaperoot;
 } global_State;
 
 
@@ -414,6 +533,7 @@ struct lua_State {
 	int hookcount;
 	unsigned short nny;  /* non-yieldable 的调用个数 number of non-yieldable calls in stack */
 	unsigned short nCcalls;  /* 记录CallStack动态增减过程中调用的C函数的个数 number of nested C calls */
+	unsigned short nCbase;  /* 'nCcalls' of the running 'lua_resume' */
 	l_signalT hookmask;
 	lu_byte allowhook;
 };
@@ -460,7 +580,9 @@ union GCUnion {
 #define gettotalbytes(g)	cast(lu_mem, (g)->totalbytes + (g)->GCdebt)
 
 LUAI_FUNC void luaE_setdebt (global_State *g, l_mem debt);
+LUAI_FUNC void luaE_setmemcheck (global_State *g);
 LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
+LUAI_FUNC void luaE_freethreadpool (lua_State *L);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L);
 LUAI_FUNC void luaE_freeCI (lua_State *L);
 LUAI_FUNC void luaE_shrinkCI (lua_State *L);
@@ -20,6 +20,7 @@
 #include "lobject.h"
 #include "lstate.h"
 #include "lstring.h"
+#include "ltable.h"
 
 
 #define MEMERRMSG       "not enough memory"
@@ -42,10 +43,33 @@ int luaS_eqlngstr (TString *a, TString *b) {
   lua_assert(a->tt == LUA_TLNGSTR && b->tt == LUA_TLNGSTR);
   return (a == b) ||  /* same instance or... */
     ((len == b->u.lnglen) &&  /* equal length and ... */
-     (memcmp(getstr(a), getstr(b), len) == 0));  /* equal contents */
+     (getstr(a) == getstr(b) ||  /* same bytes (in a 'StrBuff') or... */
+      memcmp(getstr(a), getstr(b), len) == 0));  /* equal contents */
 }
 
 
+/*
+** {======================================================
+** String hash
+** LUAI_STRHASH selects the hash function: 0 is the classic byte-at-a-time
+** hash, which samples at most ~(2^LUAI_HASHLIMIT) bytes of the string;
+** 1 reads the string 8 bytes at a time, mixing each word with a 64-bit
+** multiply, and uses all its bytes. (The word hash needs a 64-bit
+** integer type, so it is the default only when <stdint.h> gives one.)
+** =======================================================
+*/
+
+#if !defined(LUAI_STRHASH)
+#if defined(UINT64_MAX)
+#define LUAI_STRHASH	1
+#else
+#define LUAI_STRHASH	0
+#endif
+#endif
+
+
+#if LUAI_STRHASH == 0	/* { */
+
 unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   unsigned int h = seed ^ cast(unsigned int, l);
   size_t step = (l >> LUAI_HASHLIMIT) + 1;
@@ -54,6 +78,47 @@ unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   return h;
 }
 
+#else	/* }{ */
+
+#define HASHK1		UINT64_C(0x9e3779b97f4a7c15)
+#define HASHK2		UINT64_C(0xbf58476d1ce4e5b9)
+
+/* add word 'w' to hash 'h' */
+#define hashword(h,w)	((h) = ((h) ^ (w)) * HASHK2, (h) ^= (h) >> 32)
+
+
+/*
+** Words are read with 'memcpy', so 'str' needs no alignment; their
+** values depend on the machine byte order, and so do the hashes (which
+** are never saved). The last partial word is padded with zeros; the
+** length in the initial value tells apart strings that differ only by
+** trailing zeros. The final mix (from MurmurHash3) spreads all bits of
+** 'h' into the 32 bits that are kept.
+*/
+unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
+  uint64_t h = cast(uint64_t, seed) ^ (cast(uint64_t, l) * HASHK1);
+  uint64_t w;
+  for (; l >= sizeof(w); l -= sizeof(w), str += sizeof(w)) {
+    memcpy(&w, str, sizeof(w));
+    hashword(h, w);
+  }
+  if (l > 0) {
+    w = 0;
+    memcpy(&w, str, l);
+    hashword(h, w);
+  }
+  h ^= h >> 33;
+  h *= UINT64_C(0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= UINT64_C(0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+  return cast(unsigned int, h);
+}
+
+#endif	/* } */
+
+/* }====================================================== */
+
 
 unsigned int luaS_hashlongstr (TString *ts) {
   lua_assert(ts->tt == LUA_TLNGSTR);
@@ -66,7 +131,7 @@ unsigned int luaS_hashlongstr (TString *ts) {
 
 
 /**
- * resizes the string table
+ * rehashes the whole string table at once
  * 当stringtable中的字符串数量(stringtable.muse域)
  * 超过预定容量(stringtable.size域)时
  * 说明stringtable太拥挤,许多字符串可能都哈希到同一个维度中去
@@ -74,9 +139,8 @@ unsigned int luaS_hashlongstr (TString *ts) {
  * 这个时候需要调用luaS_resize方法将stringtable的哈希链表数组扩大
  * 重新排列所有字符串的位置
  */
-void luaS_resize (lua_State *L, int newsize) {
+static void rehash (lua_State *L, stringtable *tb, int newsize) {
   int i;
-  stringtable *tb = &G(L)->strt;// 取得全局stringtable
   if (newsize > tb->size) {  /* grow table if needed */ // 如果stringtable的新容量大于旧容量,重新分配
     luaM_reallocvector(L, tb->hash, tb->size, newsize, TString *);
     for (i = tb->size; i < newsize; i++)
@@ -105,6 +169,90 @@ void luaS_resize (lua_State *L, int newsize) {
 }
 
 
+/*
+** {======================================================
+** Incremental resizing
+** =======================================================
+*/
+
+/*
+** Rehashing a large string table in one go is a long pause in the
+** middle of some string creation, so 'luaS_resize' grows it by giving
+** it a new array of buckets and keeping the old one in 'oldhash'. Each
+** lookup of a short string moves the next LUAI_STRREHASHSTEP old
+** buckets to the new array. Until its bucket moves, a string (even a
+** new one) lives in the old array, so lookups and removals still look
+** into a single bucket. Sizes are powers of 2, so old bucket 'i' goes
+** to new buckets 'i', 'i + oldsize', ..., which are cleared only then
+** (clearing the whole new array at once would be a pause by itself).
+** Shrinking, done by the collector, is still a single rehash: kept
+** incrementally, the old array would stay alive until enough strings
+** were looked up.
+*/
+
+/* the bucket for hash 'h' */
+static TString **bucket (stringtable *tb, unsigned int h) {
+  if (tb->oldhash != NULL) {
+    int b = lmod(h, tb->oldsize);
+    if (b >= tb->oldpos)  /* not moved yet? */
+      return &tb->oldhash[b];
+  }
+  return &tb->hash[lmod(h, tb->size)];
+}
+
+
+/*
+** moves the next 'n' old buckets of 'tb' to its new array, freeing the
+** old array after its last bucket
+*/
+static void movebuckets (lua_State *L, stringtable *tb, int n) {
+  for (; n > 0 && tb->oldpos < tb->oldsize; n--) {
+    TString *p = tb->oldhash[tb->oldpos];
+    int i;
+    for (i = tb->oldpos; i < tb->size; i += tb->oldsize)
+      tb->hash[i] = NULL;  /* clear the new buckets for this old one */
+    tb->oldhash[tb->oldpos++] = NULL;
+    while (p) {  /* for each string in the bucket */
+      TString *hnext = p->u.hnext;  /* save next */
+      unsigned int h = lmod(p->hash, tb->size);  /* new position */
+      p->u.hnext = tb->hash[h];  /* chain it */
+      tb->hash[h] = p;
+      p = hnext;
+    }
+  }
+  if (tb->oldpos == tb->oldsize) {  /* all moved? */
+    luaM_freearray(L, tb->oldhash, tb->oldsize);
+    tb->oldhash = NULL;
+    tb->oldsize = tb->oldpos = 0;
+  }
+}
+
+
+/**
+ * resizes the string table (finishing any previous resize first):
+ * large tables grow incrementally; small, empty (not created yet), and
+ * shrinking tables are rehashed at once
+ */
+void luaS_resize (lua_State *L, int newsize) {
+  stringtable *tb = &G(L)->strt;// 取得全局stringtable
+  TString **newhash;
+  if (tb->oldhash != NULL)  /* still moving to the current size? */
+    movebuckets(L, tb, MAX_INT);  /* finish it */
+  if (newsize <= tb->size || newsize < LUAI_INCRESTRT || tb->size == 0) {
+    rehash(L, tb, newsize);
+    return;
+  }
+  newhash = luaM_newvector(L, newsize, TString *);  /* cleared when used */
+  tb->oldhash = tb->hash;
+  tb->oldsize = tb->size;
+  tb->oldpos = 0;
+  tb->hash = newhash;
+  tb->size = newsize;
+}
+
+/* }====================================================== */
+
+
 /**
  * Clear API string cache. (Entries cannot be empty, so fill them with
  * a non-collectable string.)
@@ -150,6 +298,7 @@ static TString *createstrobj (lua_State *L, size_t l, int tag, unsigned int h) {
   ts = gco2ts(o);
   ts->hash = h;
   ts->extra = 0;
+  ts->shrlen = 0;
   getstr(ts)[l] = '\0';  /* ending 0 */
   return ts;
 }
@@ -162,9 +311,181 @@ TString *luaS_createlngstrobj (lua_State *L, size_t l) {
 }
 
 
+/*
+** {======================================================
+** String buffers
+** =======================================================
+*/
+
+static StrBuff *newbuff (lua_State *L, size_t size) {
+  StrBuff *b = cast(StrBuff *, luaM_malloc(L, sizeof(StrBuff) + size));
+  b->refs = 0;
+  b->used = 0;
+  b->size = size;
+  b->data = cast(char *, b) + sizeof(StrBuff);
+  b->freef = NULL;
+  b->ud = NULL;
+  b->sealed = 0;
+  return b;
+}
+
+
+static void freebuff (lua_State *L, StrBuff *b) {
+  if (b->freef)  /* external bytes? */
+    (*b->freef)(b->ud, b->data, b->used);
+  luaM_freemem(L, b, sizeof(StrBuff) + b->size);
+}
+
+
+static void unrefbuff (lua_State *L, StrBuff *b) {
+  if (--b->refs == 0)
+    freebuff(L, b);
+}
+
+
+static void createbuffstr (lua_State *L, void *ud) {
+  GCObject *o = luaC_newobj(L, LUA_TLNGSTR, sizebuffstr);
+  *cast(TString **, ud) = gco2ts(o);
+}
+
+
+/*
+** Create a string with length 'l' and its bytes in buffer 'b'. When no
+** string uses 'b' yet, 'b' is freed if the string cannot be created.
+*/
+static TString *newbuffstr (lua_State *L, StrBuff *b, size_t l) {
+  TString *ts;
+  if (b->refs > 0)
+    createbuffstr(L, &ts);
+  else if (luaD_rawrunprotected(L, createbuffstr, &ts) != LUA_OK) {
+    freebuff(L, b);
+    luaD_throw(L, LUA_ERRMEM);  /* rethrow memory error */
+  }
+  ts->hash = G(L)->seed;
+  ts->extra = 0;
+  ts->shrlen = 1;
+  ts->u.lnglen = l;
+  getbuff(ts) = b;
+  b->refs++;
+  return ts;
+}
+
+
+/*
+** Create a long string with length 'l' whose first bytes are those of
+** long string 'ts'; the caller fills in the other ones. When 'ts' is
+** the longest string in its buffer (or the only one using it) and
+** there is room, the new string just uses more of that buffer;
+** otherwise, it gets a new buffer. That buffer has room to double its
+** length only when 'ts' also was in a buffer, so that strings built by
+** a single concatenation do not waste memory.
+*/
+TString *luaS_extend (lua_State *L, TString *ts, size_t l) {
+  size_t tl = ts->u.lnglen;
+  StrBuff *b;
+  TString *res;
+  lua_assert(ts->tt == LUA_TLNGSTR && l > tl);
+  if (isbuffstr(ts) && (b = getbuff(ts), !b->sealed) &&
+      (b->used == tl || b->refs == 1) && l < b->size)
+    res = newbuffstr(L, b, l);  /* bytes after 'tl' are free */
+  else {
+    size_t size = (isbuffstr(ts) && l < MAX_SIZE / 2) ? 2 * l : l + 1;
+    b = newbuff(L, size);
+    memcpy(buffdata(b), getstr(ts), tl * sizeof(char));
+    res = newbuffstr(L, b, l);
+  }
+  b->used = l;
+  buffdata(b)[l] = '\0';
+  return res;
+}
+
+
+/*
+** Seal string 'ts' (see 'luaS_seal'). A string shorter than its buffer
+** may be followed by the bytes of longer strings; unless it is alone
+** in the buffer, it moves to a buffer of its own.
+*/
+void luaS_sealbuff (lua_State *L, TString *ts) {
+  StrBuff *b = getbuff(ts);
+  size_t l = ts->u.lnglen;
+  if (b->used != l) {  /* not the longest string in 'b'? */
+    if (b->refs > 1) {
+      StrBuff *nb = newbuff(L, l + 1);
+      memcpy(buffdata(nb), buffdata(b), l * sizeof(char));
+      nb->refs = 1;
+      getbuff(ts) = nb;
+      unrefbuff(L, b);
+      b = nb;
+    }
+    b->used = l;
+    buffdata(b)[l] = '\0';
+  }
+  b->sealed = 1;
+}
+
+
+typedef struct ExtStr {
+  const char *s;
+  size_t l;
+  TString *ts;  /* copy of a short string */
+  StrBuff *b;  /* buffer for a long string */
+} ExtStr;
+
+
+static void allocextstr (lua_State *L, void *ud) {
+  ExtStr *e = cast(ExtStr *, ud);
+  if (e->l <= LUAI_MAXSHORTLEN)
+    e->ts = luaS_newlstr(L, e->s, e->l);
+  else
+    e->b = newbuff(L, 0);
+}
+
+
+/*
+** Create a string with the 'l' bytes at 's' (followed by a '\0'),
+** which stay in memory of the host until 'freef' releases them. Short
+** strings must be internalized, so they are copied and released at
+** once. 'freef' is also called when the string cannot be created.
+*/
+TString *luaS_newextstr (lua_State *L, const char *s, size_t l,
+                         lua_FreeF freef, void *ud) {
+  ExtStr e;
+  e.s = s;
+  e.l = l;
+  if (luaD_rawrunprotected(L, allocextstr, &e) != LUA_OK) {
+    if (freef)
+      (*freef)(ud, s, l);
+    luaD_throw(L, LUA_ERRMEM);  /* rethrow memory error */
+  }
+  if (l <= LUAI_MAXSHORTLEN) {
+    if (freef)
+      (*freef)(ud, s, l);
+    return e.ts;
+  }
+  e.b->used = l;
+  e.b->data = cast(char *, s);
+  e.b->freef = freef;
+  e.b->ud = ud;
+  e.b->sealed = 1;  /* Lua never writes to it */
+  return newbuffstr(L, e.b, l);
+}
+
+
+void luaS_freelngstr (lua_State *L, TString *ts) {
+  if (isbuffstr(ts)) {
+    unrefbuff(L, getbuff(ts));
+    luaM_freemem(L, ts, sizebuffstr);
+  }
+  else
+    luaM_freemem(L, ts, sizelstring(ts->u.lnglen));
+}
+
+/* }====================================================== */
+
+
 void luaS_remove (lua_State *L, TString *ts) {
   stringtable *tb = &G(L)->strt;
-  TString **p = &tb->hash[lmod(ts->hash, tb->size)];
+  TString **p = bucket(tb, ts->hash);
   while (*p != ts)  /* find previous element */
     p = &(*p)->u.hnext;
   *p = (*p)->u.hnext;  /* remove element from its list */
@@ -180,8 +501,11 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   global_State *g = G(L);
   // 计算传入字符串哈希值
   unsigned int h = luaS_hash(str, l, g->seed);
+  TString **list;
+  if (g->strt.oldhash != NULL)  /* resizing? */
+    movebuckets(L, &g->strt, LUAI_STRREHASHSTEP);
   // 找到目标位置字符串链表
-  TString **list = &g->strt.hash[lmod(h, g->strt.size)];
+  list = bucket(&g->strt, h);
   // 在字符串链表搜索传入字符串
   lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
   for (ts = *list; ts != NULL; ts = ts->u.hnext) {
@@ -195,7 +519,7 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   }
   if (g->strt.nuse >= g->strt.size && g->strt.size <= MAX_INT/2) {
     luaS_resize(L, g->strt.size * 2);
-    list = &g->strt.hash[lmod(h, g->strt.size)];  /* recompute with new size */
+    list = bucket(&g->strt, h);  /* recompute with new size */
   }
   // 没有找到创建新的字符串
   ts = createstrobj(L, l, LUA_TSHRSTR, h);
@@ -244,14 +568,21 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
  * 同时每次都会将最早的元素element淘汰出去
  */
 TString *luaS_new (lua_State *L, const char *str) {
+  global_State *g = G(L);
   unsigned int i = point2uint(str) % STRCACHE_N;  /* hash */
   int j;
-  TString **p = G(L)->strcache[i];
+  TString **p = g->strcache[i];
   for (j = 0; j < STRCACHE_M; j++) {
-    if (strcmp(str, getstr(p[j])) == 0)  /* hit? */
-      return p[j];  /* that is it */
+    if (strcmp(str, getstr(p[j])) == 0) {  /* hit? */
+      TString *ts = p[j];
+      for (; j > 0; j--)
+        p[j] = p[j - 1];  /* move it to the front of its set */
+      g->strcachehits++;
+      return p[0] = ts;
+    }
   }
   /* normal route */
+  g->strcachemisses++;
   for (j = STRCACHE_M - 1; j > 0; j--)
     p[j] = p[j - 1];  /* move out last element */
   /* new element is first in the list */
@@ -260,6 +591,37 @@ TString *luaS_new (lua_State *L, const char *str) {
 }
 
 
+/*
+** Create or reuse string 'str' (as 'luaS_new') and make sure it is
+** never collected. A string created here is fixed ('luaC_fix'); one
+** that already existed cannot leave its list, so it becomes a key in
+** table 'g->pinned', which is a root for the collector. (Until then it
+** stays on the stack, as creating or growing that table may run an
+** emergency collection.)
+*/
+TString *luaS_pin (lua_State *L, const char *str) {
+  global_State *g = G(L);
+  GCObject *last = g->allgc;
+  TString *ts;
+  luaD_checkstack(L, 1);  /* room to anchor 'ts' */
+  ts = luaS_new(L, str);
+  if (isgray(ts))  /* already fixed? */
+    return ts;
+  else if (g->allgc != last && g->allgc == obj2gco(ts))  /* new string? */
+    luaC_fix(L, obj2gco(ts));
+  else {
+    setsvalue2s(L, L->top, ts);  /* anchor it */
+    L->top++;
+    if (g->pinned == NULL)
+      g->pinned = luaH_new(L);
+    setbvalue(luaH_set(L, g->pinned, L->top - 1), 1);
+    luaC_barrierback(L, g->pinned, L->top - 1);
+    L->top--;  /* remove it */
+  }
+  return ts;
+}
+
+
 /**
  * 任何时候创建的udata，在GC链表中都会放在mainthread之后。
  * 除此之外，这类型的数据与其他数据并无差别
@@ -14,6 +14,13 @@
 
 #define sizelstring(l)  (sizeof(union UTString) + ((l) + 1) * sizeof(char))
 
+/* size of a long string keeping its bytes in a 'StrBuff' */
+#define sizebuffstr	(sizeof(union UTString) + sizeof(StrBuff *))
+
+/* size of a long string object (without its 'StrBuff') */
+#define sizelngstr(ts)  \
+	(isbuffstr(ts) ? sizebuffstr : sizelstring((ts)->u.lnglen))
+
 #define sizeludata(l)	(sizeof(union UUdata) + (l))
 #define sizeudata(u)	sizeludata((u)->len)
 
@@ -21,6 +28,40 @@
                                  (sizeof(s)/sizeof(char))-1))
 
 
+/*
+** A string table growing to LUAI_INCRESTRT buckets or more grows
+** incrementally (see 'lstring.c'): each lookup of a short string moves
+** LUAI_STRREHASHSTEP more of its old buckets to the new array.
+*/
+#if !defined(LUAI_INCRESTRT)
+#define LUAI_INCRESTRT	(1 << 12)
+#endif
+
+#if !defined(LUAI_STRREHASHSTEP)
+#define LUAI_STRREHASHSTEP	8
+#endif
+
+
+/*
+** Concatenations that append to a long string and result in at least
+** LUAI_MINBUFFSTR bytes build their results in a 'StrBuff', so that
+** repeated appends to the same string take linear time.
+*/
+#if !defined(LUAI_MINBUFFSTR)
+#define LUAI_MINBUFFSTR	1024
+#endif
+
+
+/*
+** Make sure that string 'ts' ends with a '\0' and that it will not
+** change, so that its bytes can be used as a C string.
+*/
+#define luaS_seal(L,ts)	(isbuffstr(ts) ? luaS_sealbuff(L, ts) : cast_void(0))
+
+/* test whether a string may not be followed by a '\0' */
+#define isopenstr(ts)	(isbuffstr(ts) && getbuff(ts)->used != (ts)->u.lnglen)
+
+
 /*
 ** test whether a string is a reserved word
 */
@@ -72,7 +113,13 @@ LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
  * 同时每次都会将最早的元素element淘汰出去
  */
 LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
+LUAI_FUNC TString *luaS_pin (lua_State *L, const char *str);
 LUAI_FUNC TString *luaS_createlngstrobj (lua_State *L, size_t l);
+LUAI_FUNC TString *luaS_extend (lua_State *L, TString *ts, size_t l);
+LUAI_FUNC void luaS_sealbuff (lua_State *L, TString *ts);
+LUAI_FUNC TString *luaS_newextstr (lua_State *L, const char *s, size_t l,
+                                   lua_FreeF freef, void *ud);
+LUAI_FUNC void luaS_freelngstr (lua_State *L, TString *ts);
 
 
 #endif
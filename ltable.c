@@ -20,10 +20,21 @@
 ** in its main position (i.e. the 'original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+**
+** With LUAI_SWISSHASH (see 'ltable.h'), the hash part uses open
+** addressing instead: a control byte per node, kept after the nodes,
+** holds 7 bits of the hash of its key (or marks the node as empty), and
+** a lookup compares a whole group of control bytes at once, touching
+** only the nodes whose byte matches.
+**
+** Record tables (built by constructors with only named fields) may
+** instead keep their string keys in a shape shared with other tables;
+** see "Shapes" below.
 */
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -37,6 +48,10 @@
 #include "ltable.h"
 #include "lvm.h"
 
+#if LUAI_SWISSHASH && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
 ** Maximum size of array part (MAXASIZE) is 2^MAXABITS. MAXABITS is
 ** the largest integer such that MAXASIZE fits in an unsigned int.
@@ -66,6 +81,8 @@
 
 #define hashpointer(t, p) hashmod(t, point2uint(p))
 
+#if !LUAI_SWISSHASH
+
 #define dummynode (&dummynode_)
 
 static const Node dummynode_ = {
@@ -73,6 +90,186 @@ static const Node dummynode_ = {
     {{NILCONSTANT, 0}} /* key */
 };
 
+/* size of the block for a hash part with 'size' nodes */
+#define hashpartsize(size) (sizeof(Node) * cast(size_t, size))
+
+#else
+
+/*
+** {=============================================================
+** Open addressing with control bytes
+** ==============================================================
+*/
+
+/*
+** A hash part with 'size' nodes is a single block: the nodes, followed
+** by 'size' control bytes (at least GROUPSIZE of them; the extra ones
+** stay empty). Control bytes go in groups of GROUPSIZE; the hash of a
+** key picks its first group, and the following groups in its probe
+** sequence come by triangular steps, which visit every group of a
+** power-of-2 count. A key goes into the first empty node it finds, and
+** stays there until the next rehash (Lua never removes keys, it just
+** sets their values to nil), so a lookup can stop at the first group
+** with an empty node. To keep enough empty nodes, a table takes only
+** 'maxload' keys before a rehash; 'lastfree - node' counts the keys it
+** can still take.
+*/
+
+#define GROUPSIZE 16
+#define CTRL_EMPTY 0x80 /* empty node (other values are hash bits) */
+
+#define ctrlsize(size) ((size) < GROUPSIZE ? GROUPSIZE : (size))
+
+#define hashpartsize(size) \
+  (sizeof(Node) * cast(size_t, size) + cast(size_t, ctrlsize(size)))
+
+#define maxload(size) ((size) < GROUPSIZE ? (size) : (size) - (size) / 8)
+
+/* control bytes of table 't' */
+#define gctrl(t) (cast(lu_byte *, gnode(t, sizenode(t))))
+
+#define ngroups(t) ((sizenode(t) + GROUPSIZE - 1) / GROUPSIZE)
+
+/* parts of a (mixed) hash: bits for the control byte, and the rest */
+#define hashctrl(h) cast_byte((h) & 0x7F)
+#define hashgroup(h) ((h) >> 7)
+
+#define E4 CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY
+
+/* the dummy node needs its (empty) control bytes too */
+static const struct
+{
+  Node n;
+  lu_byte ctrl[GROUPSIZE];
+} dummy_ = {
+    {{NILCONSTANT}, {{NILCONSTANT, 0}}},
+    {E4, E4, E4, E4}};
+
+#define dummynode (&dummy_.n)
+
+/* spread the bits of hash 'h' (the control byte uses its lowest ones) */
+static unsigned int mixhash(unsigned int h)
+{
+  h ^= h >> 16;
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35U;
+  h ^= h >> 16;
+  return h;
+}
+
+#define inthash(i) \
+  mixhash(cast(unsigned int, l_castS2U(i) ^ (l_castS2U(i) >> 31 >> 1)))
+
+/*
+** bit masks of the nodes in the group at 'c' whose control bytes are
+** equal to 'b' and of the empty ones
+*/
+#if defined(__SSE2__)
+
+static unsigned int matchbyte(const lu_byte *c, lu_byte b)
+{
+  __m128i g = _mm_loadu_si128(cast(const __m128i *, c));
+  return cast(unsigned int,
+              _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(cast(char, b)))));
+}
+
+static unsigned int matchempty(const lu_byte *c)
+{ /* empty bytes are the only ones with the high bit set */
+  return cast(unsigned int,
+              _mm_movemask_epi8(_mm_loadu_si128(cast(const __m128i *, c))));
+}
+
+#else
+
+static unsigned int matchbyte(const lu_byte *c, lu_byte b)
+{
+  unsigned int m = 0;
+  int i;
+  for (i = 0; i < GROUPSIZE; i++)
+  {
+    if (c[i] == b)
+      m |= 1u << i;
+  }
+  return m;
+}
+
+#define matchempty(c) matchbyte(c, CTRL_EMPTY)
+
+#endif
+
+/* index of the lowest bit set in 'm' (not 0) */
+#if defined(__GNUC__)
+#define lowbit(m) __builtin_ctz(m)
+#else
+static int lowbit(unsigned int m)
+{
+  int i = 0;
+  while ((m & 1) == 0)
+  {
+    m >>= 1;
+    i++;
+  }
+  return i;
+}
+#endif
+
+/*
+** Probe table 't' for hash 'h': run 'body' with 'n' bound to each node
+** whose control byte matches, in probe order, until a group with an
+** empty node ends the search.
+*/
+#define probe(t, h, n, body)                                            \
+  {                                                                     \
+    unsigned int gmask_ = cast(unsigned int, ngroups(t)) - 1;           \
+    unsigned int g_ = hashgroup(h) & gmask_;                            \
+    unsigned int step_ = 0;                                             \
+    for (;;)                                                            \
+    {                                                                   \
+      const lu_byte *c_ = gctrl(t) + g_ * GROUPSIZE;                    \
+      unsigned int m_ = matchbyte(c_, hashctrl(h));                     \
+      for (; m_ != 0; m_ &= m_ - 1)                                     \
+      {                                                                 \
+        Node *n = gnode(t, g_ * GROUPSIZE + cast(unsigned int, lowbit(m_))); \
+        body;                                                           \
+      }                                                                 \
+      if (matchempty(c_) != 0)                                          \
+        break;                                                          \
+      g_ = (g_ + ++step_) & gmask_;                                     \
+    }                                                                   \
+  }
+
+/*
+** take the first empty node in the probe sequence of hash 'h' (there
+** must be one)
+*/
+static Node *takefree(Table *t, unsigned int h)
+{
+  unsigned int gmask = cast(unsigned int, ngroups(t)) - 1;
+  unsigned int g = hashgroup(h) & gmask;
+  unsigned int step = 0;
+  for (;;)
+  {
+    lu_byte *c = gctrl(t) + g * GROUPSIZE;
+    unsigned int m = matchempty(c);
+    if (sizenode(t) < GROUPSIZE) /* ignore extra control bytes */
+      m &= (1u << sizenode(t)) - 1;
+    if (m != 0)
+    {
+      int i = lowbit(m);
+      c[i] = hashctrl(h);
+      return gnode(t, g * GROUPSIZE + cast(unsigned int, i));
+    }
+    g = (g + ++step) & gmask;
+  }
+}
+
+/*
+** }=============================================================
+*/
+
+#endif
+
 /*
 ** Hash for floating-point numbers.
 ** The main computation should be just
@@ -105,6 +302,45 @@ static int l_hashfloat(lua_Number n)
 }
 #endif
 
+#if LUAI_SWISSHASH
+
+/*
+** returns the hash of a key; string hashes are spread enough already,
+** the others get mixed
+*/
+static unsigned int hashkey(const TValue *key)
+{
+  unsigned int h;
+  switch (ttype(key))
+  {
+  case LUA_TNUMINT:
+    return inthash(ivalue(key));
+  case LUA_TNUMFLT:
+    h = cast(unsigned int, l_hashfloat(fltvalue(key)));
+    break;
+  case LUA_TSHRSTR:
+    return tsvalue(key)->hash;
+  case LUA_TLNGSTR:
+    return luaS_hashlongstr(tsvalue(key));
+  case LUA_TBOOLEAN:
+    h = cast(unsigned int, bvalue(key));
+    break;
+  case LUA_TLIGHTUSERDATA:
+    h = point2uint(pvalue(key));
+    break;
+  case LUA_TLCF:
+    h = point2uint(fvalue(key));
+    break;
+  default:
+    lua_assert(!ttisdeadkey(key));
+    h = point2uint(gcvalue(key));
+    break;
+  }
+  return mixhash(h);
+}
+
+#else
+
 /*
 ** returns the 'main' position of an element in a table (that is, the index
 ** of its hash value)
@@ -133,6 +369,38 @@ static Node *mainposition(const Table *t, const TValue *key)
   }
 }
 
+#endif
+
+/*
+** fills 'o' as a table whose hash part is the old part of 't', which is
+** still growing (see "Incremental growth" below)
+*/
+static Table *oldpart(Table *t, Table *o)
+{
+  o->node = t->oldhash->node;
+  o->lsizenode = t->oldhash->lsizenode;
+  o->lastfree = o->node; /* (not a dummy) */
+  o->sizearray = 0;
+  o->shape = NULL;
+  o->oldhash = NULL;
+  return o;
+}
+
+/*
+** returns the slot of short string 'key' in shape 's', or -1 if it is
+** not there
+*/
+static int findslot(const Shape *s, const TString *key)
+{
+  int i;
+  for (i = 0; i < s->nkeys; i++)
+  {
+    if (s->keys[i] == key)
+      return i;
+  }
+  return -1;
+}
+
 /*
 ** returns the index for 'key' if 'key' is an appropriate key to live in
 ** the array part of the table, 0 otherwise.
@@ -148,41 +416,76 @@ static unsigned int arrayindex(const TValue *key)
   return 0; /* 'key' did not match some condition */
 }
 
+/*
+** returns the index of 'key' in the hash part of 't', or -1 if it is
+** not there
+*/
+static int nodeindex(Table *t, const TValue *key)
+{
+#if LUAI_SWISSHASH
+  unsigned int h = hashkey(key);
+  Node *dead = NULL;
+  probe(t, h, n, {
+    if (luaV_rawequalobj(gkey(n), key))
+      return cast_int(n - gnode(t, 0));
+    /* key may be dead already, but it is ok to use it in 'next';
+       as keys are never moved, a dead copy of an object can precede
+       the object itself (inserted again), so the live one wins */
+    else if (dead == NULL && ttisdeadkey(gkey(n)) && iscollectable(key) &&
+             deadvalue(gkey(n)) == gcvalue(key))
+      dead = n;
+  });
+  return (dead == NULL) ? -1 : cast_int(dead - gnode(t, 0));
+#else
+  Node *n = mainposition(t, key);
+  for (;;)
+  { /* check whether 'key' is somewhere in the chain */
+    /* key may be dead already, but it is ok to use it in 'next' */
+    if (luaV_rawequalobj(gkey(n), key) ||
+        (ttisdeadkey(gkey(n)) && iscollectable(key) &&
+         deadvalue(gkey(n)) == gcvalue(key)))
+      return cast_int(n - gnode(t, 0));
+    else if (gnext(n) == 0)
+      return -1;
+    n += gnext(n);
+  }
+#endif
+}
+
 /*
 ** returns the index of a 'key' for table traversals. First goes all
-** elements in the array part, then elements in the hash part. The
-** beginning of a traversal is signaled by 0.
+** elements in the array part, then elements in the hash part (and then
+** those in its old part, while it grows). The beginning of a traversal
+** is signaled by 0.
 */
 static unsigned int findindex(lua_State *L, Table *t, StkId key)
 {
   unsigned int i;
+  int n;
   if (ttisnil(key))
     return 0; /* first iteration */
   i = arrayindex(key);
   if (i != 0 && i <= t->sizearray) /* is 'key' inside array part? */
     return i;                      /* yes; that's the index */
-  else
-  {
-    int nx;
-    Node *n = mainposition(t, key);
-    for (;;)
-    { /* check whether 'key' is somewhere in the chain */
-      /* key may be dead already, but it is ok to use it in 'next' */
-      if (luaV_rawequalobj(gkey(n), key) ||
-          (ttisdeadkey(gkey(n)) && iscollectable(key) &&
-           deadvalue(gkey(n)) == gcvalue(key)))
-      {
-        i = cast_int(n - gnode(t, 0)); /* key index in hash table */
-        /* hash elements are numbered after array ones */
-        return (i + 1) + t->sizearray;
-      }
-      nx = gnext(n);
-      if (nx == 0)
-        luaG_runerror(L, "invalid key to 'next'"); /* key not found */
-      else
-        n += nx;
-    }
+  else if (t->shape != NULL)
+  { /* slots are numbered after array elements */
+    int s = ttisshrstring(key) ? findslot(t->shape, tsvalue(key)) : -1;
+    if (s < 0)
+      luaG_runerror(L, "invalid key to 'next'"); /* key not found */
+    return (s + 1) + t->sizearray;
+  }
+  n = nodeindex(t, key);
+  if (n < 0 && t->oldhash != NULL)
+  { /* not moved yet? */
+    Table o;
+    n = nodeindex(oldpart(t, &o), key);
+    if (n >= 0)
+      n += sizenode(t); /* old nodes are numbered after new ones */
   }
+  if (n < 0)
+    luaG_runerror(L, "invalid key to 'next'"); /* key not found */
+  /* hash elements are numbered after array ones */
+  return (n + 1) + t->sizearray;
 }
 
 int luaH_next(lua_State *L, Table *t, StkId key)
@@ -197,6 +500,19 @@ int luaH_next(lua_State *L, Table *t, StkId key)
       return 1;
     }
   }
+  if (t->shape != NULL)
+  { /* slots */
+    for (i -= t->sizearray; cast_int(i) < t->shape->nkeys; i++)
+    {
+      if (!ttisnil(&t->slots[i]))
+      { /* a non-nil value? */
+        setsvalue2s(L, key, t->shape->keys[i]);
+        setobj2s(L, key + 1, &t->slots[i]);
+        return 1;
+      }
+    }
+    return 0; /* no more elements */
+  }
   for (i -= t->sizearray; cast_int(i) < sizenode(t); i++)
   { /* hash part */
     if (!ttisnil(gval(gnode(t, i))))
@@ -206,6 +522,19 @@ int luaH_next(lua_State *L, Table *t, StkId key)
       return 1;
     }
   }
+  if (t->oldhash != NULL)
+  { /* entries not moved yet (moved ones are nil there) */
+    Node *old = t->oldhash->node;
+    for (i -= sizenode(t); cast_int(i) < twoto(t->oldhash->lsizenode); i++)
+    {
+      if (!ttisnil(gval(old + i)))
+      {
+        setobj2s(L, key, gkey(old + i));
+        setobj2s(L, key + 1, gval(old + i));
+        return 1;
+      }
+    }
+  }
   return 0; /* no more elements */
 }
 
@@ -322,6 +651,19 @@ static void setarrayvector(lua_State *L, Table *t, unsigned int size)
   t->sizearray = size;
 }
 
+/*
+** log2 of the number of nodes of a hash part for 'size' keys
+*/
+static int hashlsize(unsigned int size)
+{
+  int lsize = luaO_ceillog2(size);
+#if LUAI_SWISSHASH
+  if (size > cast(unsigned int, maxload(twoto(lsize))))
+    lsize++; /* keep enough empty nodes */
+#endif
+  return lsize;
+}
+
 static void setnodevector(lua_State *L, Table *t, unsigned int size)
 {
   if (size == 0)
@@ -333,11 +675,11 @@ static void setnodevector(lua_State *L, Table *t, unsigned int size)
   else
   {
     int i;
-    int lsize = luaO_ceillog2(size);
+    int lsize = hashlsize(size);
     if (lsize > MAXHBITS)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
-    t->node = luaM_newvector(L, size, Node);
+    t->node = cast(Node *, luaM_malloc(L, hashpartsize(size)));
     for (i = 0; i < (int)size; i++)
     {
       Node *n = gnode(t, i);
@@ -346,7 +688,12 @@ static void setnodevector(lua_State *L, Table *t, unsigned int size)
       setnilvalue(gval(n));
     }
     t->lsizenode = cast_byte(lsize);
+#if LUAI_SWISSHASH
+    memset(gctrl(t), CTRL_EMPTY, ctrlsize(size));
+    t->lastfree = gnode(t, maxload(size)); /* number of keys it can take */
+#else
     t->lastfree = gnode(t, size); /* all positions are free */
+#endif
   }
 }
 
@@ -362,6 +709,164 @@ static void auxsetnode(lua_State *L, void *ud)
   setnodevector(L, asn->t, asn->nhsize);
 }
 
+/*
+** {=============================================================
+** Shapes
+** ==============================================================
+*/
+
+/*
+** A table created by a constructor with only named fields starts with
+** the empty shape (see 'luaH_useshape'). While it gets only short-string
+** keys, and no more than LUAI_MAXSHAPEKEYS of them, it keeps their
+** values in the dense vector 'slots', while the keys themselves live in
+** a shape shared by all tables that got the same keys in the same
+** order. Any other key, a resize, or too many keys move the fields to
+** the usual hash part ('unshape'), for good. Assigning nil to a field
+** keeps its slot, as it would keep its node.
+**
+** Shapes are not collectable: each one counts the tables and children
+** using it, and goes away with the last one. Its keys are marked by
+** the tables using it. A new child starts with no users, so that a
+** memory error while the table grows does not leak it: it stays in the
+** tree, ready for the next table, and 'luaH_freeshapes' frees any such
+** shape when the state closes.
+*/
+
+/* maximum number of children of a shape */
+#define MAXSHAPECHILDREN 32
+
+#define shapesize(n) (sizeof(Shape) + sizeof(TString *) * ((n) - 1))
+
+/* allocated size of 'slots' for a shape with 'n' keys */
+#define slotsize(n) ((n) == 0 ? 0 : (n) <= 4 ? 4 : twoto(luaO_ceillog2(n)))
+
+/*
+** returns the child of shape 's' that adds 'key', creating it if needed;
+** returns NULL if 's' already has too many children (e.g., tables used
+** as dictionaries)
+*/
+static Shape *getchild(lua_State *L, Shape *s, TString *key)
+{
+  int n = s->nkeys;
+  int nchildren = 0;
+  Shape *c;
+  for (c = s->children; c != NULL; c = c->sibling, nchildren++)
+  {
+    if (c->keys[n] == key)
+      return c;
+  }
+  if (nchildren >= MAXSHAPECHILDREN)
+    return NULL;
+  c = cast(Shape *, luaM_malloc(L, shapesize(n + 1)));
+  c->parent = s;
+  c->children = NULL;
+  c->sibling = s->children;
+  s->children = c;
+  s->refcount++; /* child uses its parent */
+  c->refcount = 0;
+  c->nkeys = n + 1;
+  memcpy(c->keys, s->keys, n * sizeof(TString *));
+  c->keys[n] = key;
+  return c;
+}
+
+/* a user of shape 's' is gone; free the shapes nobody uses now */
+static void releaseshape(lua_State *L, Shape *s)
+{
+  while (--s->refcount == 0)
+  {
+    Shape *p = s->parent;
+    Shape **c;
+    lua_assert(p != NULL && s->children == NULL);
+    for (c = &p->children; *c != s; c = &(*c)->sibling)
+      ; /* find 's' in its parent's list */
+    *c = s->sibling;
+    luaM_freemem(L, s, shapesize(s->nkeys));
+    s = p;
+  }
+}
+
+/*
+** add short-string 'key' to table 't', which has a shape; returns the
+** new (empty) slot, or NULL if the table should not have a shape anymore
+*/
+static TValue *addfield(lua_State *L, Table *t, const TValue *key)
+{
+  Shape *old = t->shape;
+  int n = old->nkeys;
+  Shape *s;
+  if (n >= LUAI_MAXSHAPEKEYS ||
+      (s = getchild(L, old, tsvalue(key))) == NULL)
+    return NULL;
+  if (slotsize(n + 1) != slotsize(n))
+    luaM_reallocvector(L, t->slots, slotsize(n), slotsize(n + 1), TValue);
+  s->refcount++;
+  t->shape = s;
+  releaseshape(L, old); /* (cannot free it, as 's' uses it) */
+  setnilvalue(&t->slots[n]);
+  luaC_barrierback(L, t, key);
+  return &t->slots[n];
+}
+
+/* move the fields of table 't' from its slots to its hash part */
+static void unshape(lua_State *L, Table *t)
+{
+  Shape *s = t->shape;
+  TValue *slots = t->slots;
+  int n = s->nkeys;
+  int i;
+  lua_assert(isdummy(t) && t->sizearray == 0);
+  setnodevector(L, t, n + 1); /* room for all fields and one more */
+  t->shape = NULL;
+  t->slots = NULL;
+  for (i = 0; i < n; i++)
+  {
+    if (!ttisnil(&slots[i]))
+    {
+      TValue k;
+      setsvalue(L, &k, s->keys[i]);
+      /* doesn't need barrier/invalidate cache, as entry was
+         already present in the table */
+      setobjt2t(L, luaH_set(L, t, &k), &slots[i]);
+    }
+  }
+  luaM_freearray(L, slots, slotsize(n));
+  releaseshape(L, s);
+}
+
+/*
+** make the new, empty table 't' keep its fields in a shape
+*/
+void luaH_useshape(lua_State *L, Table *t)
+{
+  lua_assert(t->shape == NULL && t->sizearray == 0 && isdummy(t));
+  t->shape = &G(L)->shaperoot;
+  t->shape->refcount++;
+}
+
+/*
+** free the shapes left without users (see above); all tables must be
+** gone already
+*/
+void luaH_freeshapes(lua_State *L)
+{
+  Shape *root = &G(L)->shaperoot;
+  while (root->children != NULL)
+  {
+    Shape *s = root->children;
+    while (s->children != NULL) /* go down to a leaf */
+      s = s->children;
+    lua_assert(s->refcount == 0);
+    s->parent->children = s->sibling;
+    luaM_freemem(L, s, shapesize(s->nkeys));
+  }
+}
+
+/*
+** }=============================================================
+*/
+
 /**
  * 重新设置Table的大小
  * 说明:luaH_new方法仅仅是初始化了一个Table,真正Table容器大小,需要调用此方法实现
@@ -375,9 +880,15 @@ void luaH_resize(lua_State *L, Table *t, unsigned int nasize,
   unsigned int i;
   int j;
   AuxsetnodeT asn;
-  unsigned int oldasize = t->sizearray;
-  int oldhsize = allocsizenode(t);
-  Node *nold = t->node;  /* save old hash ... */
+  unsigned int oldasize;
+  int oldhsize;
+  Node *nold;
+  OldHash *oh = t->oldhash; /* part still growing, if any */
+  if (t->shape != NULL)
+    unshape(L, t); /* move slots to the hash part */
+  oldasize = t->sizearray;
+  oldhsize = allocsizenode(t);
+  nold = t->node; /* save old hash ... */
   if (nasize > oldasize) /* array part must grow? */
     setarrayvector(L, t, nasize);
   /* create new hash part with appropriate size */
@@ -388,6 +899,7 @@ void luaH_resize(lua_State *L, Table *t, unsigned int nasize,
     setarrayvector(L, t, oldasize); /* array back to its original size */
     luaD_throw(L, LUA_ERRMEM);      /* rethrow memory error */
   }
+  t->oldhash = NULL; /* its entries are re-inserted below */
   if (nasize < oldasize)
   { /* array part must shrink? */
     t->sizearray = nasize;
@@ -411,8 +923,20 @@ void luaH_resize(lua_State *L, Table *t, unsigned int nasize,
       setobjt2t(L, luaH_set(L, t, gkey(old)), gval(old));
     }
   }
-  if (oldhsize > 0)                                  /* not the dummy node? */
-    luaM_freearray(L, nold, cast(size_t, oldhsize)); /* free old hash */
+  if (oldhsize > 0)                               /* not the dummy node? */
+    luaM_freemem(L, nold, hashpartsize(oldhsize)); /* free old hash */
+  if (oh != NULL)
+  { /* also re-insert entries not moved yet from the growing part */
+    unsigned int size = twoto(oh->lsizenode);
+    for (i = oh->pos; i < size; i++)
+    {
+      Node *old = oh->node + i;
+      if (!ttisnil(gval(old)))
+        setobjt2t(L, luaH_set(L, t, gkey(old)), gval(old));
+    }
+    luaM_freemem(L, oh->node, hashpartsize(size));
+    luaM_free(L, oh);
+  }
 }
 
 void luaH_resizearray(lua_State *L, Table *t, unsigned int nasize)
@@ -421,30 +945,6 @@ void luaH_resizearray(lua_State *L, Table *t, unsigned int nasize)
   luaH_resize(L, t, nasize, nsize);
 }
 
-/*
-** nums[i] = number of keys 'k' where 2^(i - 1) < k <= 2^i
-*/
-static void rehash(lua_State *L, Table *t, const TValue *ek)
-{
-  unsigned int asize; /* optimal size for array part */
-  unsigned int na;    /* number of keys in the array part */
-  unsigned int nums[MAXABITS + 1];
-  int i;
-  int totaluse;
-  for (i = 0; i <= MAXABITS; i++)
-    nums[i] = 0;                        /* reset counts */
-  na = numusearray(t, nums);            /* count keys in array part */
-  totaluse = na;                        /* all those keys are integer keys */
-  totaluse += numusehash(t, nums, &na); /* count keys in hash part */
-  /* count extra key */
-  na += countint(ek, nums);
-  totaluse++;
-  /* compute new size for array part */
-  asize = computesizes(nums, &na);
-  /* resize the table to new computed sizes */
-  luaH_resize(L, t, asize, totaluse - na);
-}
-
 /*
 ** }=============================================================
 */
@@ -466,6 +966,9 @@ Table *luaH_new(lua_State *L)
   t->flags = cast_byte(~0);
   t->array = NULL;
   t->sizearray = 0;
+  t->shape = NULL;
+  t->slots = NULL;
+  t->oldhash = NULL;
   setnodevector(L, t, 0);//设置节点空间
   return t;
 }
@@ -479,11 +982,24 @@ Table *luaH_new(lua_State *L)
 void luaH_free(lua_State *L, Table *t)
 {
   if (!isdummy(t))
-    luaM_freearray(L, t->node, cast(size_t, sizenode(t)));
+    luaM_freemem(L, t->node, hashpartsize(sizenode(t)));
   luaM_freearray(L, t->array, t->sizearray);
+  if (t->oldhash != NULL)
+  {
+    luaM_freemem(L, t->oldhash->node,
+                 hashpartsize(twoto(t->oldhash->lsizenode)));
+    luaM_free(L, t->oldhash);
+  }
+  if (t->shape != NULL)
+  {
+    luaM_freearray(L, t->slots, slotsize(t->shape->nkeys));
+    releaseshape(L, t->shape);
+  }
   luaM_free(L, t);
 }
 
+#if !LUAI_SWISSHASH
+
 static Node *getfreepos(Table *t)
 {
   if (!isdummy(t))
@@ -498,45 +1014,38 @@ static Node *getfreepos(Table *t)
   return NULL; /* could not find a free place */
 }
 
+#endif
+
 /*
-** inserts a new key into a hash table; first, check whether key's main
-** position is free. If not, check whether colliding node is in its main
-** position or not: if it is not, move colliding node to an empty place and
-** put new key in its main position; otherwise (colliding node is in its main
-** position), new key goes to an empty position.
+** returns a node for a new key (not in the table) in the hash part of
+** 't', or NULL if there is no room for it. With chaining: first, check
+** whether key's main position is free. If not, check whether colliding
+** node is in its main position or not: if it is not, move colliding
+** node to an empty place and put new key in its main position;
+** otherwise (colliding node is in its main position), new key goes to
+** an empty position.
 ** 插入一个新key到hash 表中,首先,检查key对应的main position是否是空的,如果不是,
 ** 则检查冲突的node是不是main position,如果不是,就应该将冲突的node移到一个新的空位置,
 ** 将新key放到main position。如果冲突的点就已经是main position,则将新key放到一个空白点
 */
-TValue *luaH_newkey(lua_State *L, Table *t, const TValue *key)
+static Node *freenode(Table *t, const TValue *key)
 {
   Node *mp;
-  TValue aux;
-  if (ttisnil(key))
-    luaG_runerror(L, "table index is nil");
-  else if (ttisfloat(key))//浮点类型,如果可以转int的话,强制转成int
-  {
-    lua_Integer k;
-    if (luaV_tointeger(key, &k, 0))
-    { /* does index fit in an integer? */
-      setivalue(&aux, k);
-      key = &aux; /* insert it as an integer */
-    }
-    else if (luai_numisnan(fltvalue(key)))
-      luaG_runerror(L, "table index is NaN");
-  }
+#if LUAI_SWISSHASH
+  if (isdummy(t) || t->lastfree == t->node)
+    return NULL; /* no room for another key */
+  mp = takefree(t, hashkey(key));
+  t->lastfree--;
+  return mp;
+#else
   mp = mainposition(t, key);//拿到key 可以存放的的node
   /* 如果存在 */
   if (!ttisnil(gval(mp)) || isdummy(t))
   { /* main position is taken? */
     Node *othern;
     Node *f = getfreepos(t); /* 扩容 get a free place */
-    if (f == NULL)
-    {                    /* cannot find a free place? */
-      rehash(L, t, key); /* 扩容 grow table */
-      /* whatever called 'newkey' takes care of TM cache */
-      return luaH_set(L, t, key); /* insert key into grown table */
-    }
+    if (f == NULL) /* cannot find a free place? */
+      return NULL;
     lua_assert(!isdummy(t));
     othern = mainposition(t, gkey(mp));
     if (othern != mp)
@@ -564,12 +1073,193 @@ TValue *luaH_newkey(lua_State *L, Table *t, const TValue *key)
       mp = f;
     }
   }
+  return mp;
+#endif
+}
+
+/*
+** {=============================================================
+** Incremental growth
+** ==============================================================
+*/
+
+/*
+** A full hash part with at least LUAI_INCREHASH nodes is not rehashed
+** in one go: 'growhash' gives the table a new part twice as large and
+** keeps the old one in 't->oldhash'. New keys go to the new part, and
+** each insertion also moves the next LUAI_REHASHSTEP old nodes there.
+** A moved entry is left with a nil value (and a dead key) in the old
+** part, so a lookup that misses the new part goes on in the old one,
+** where nil values mean absent keys; 'next' visits the old nodes after
+** the new ones. Entries move only on insertions of new keys, which are
+** not allowed during a traversal, so it sees each entry once. The new
+** part has room for all old entries plus those inserted until they all
+** move. 'rehash' still counts the keys first: a table grows this way
+** only when its live keys need a larger hash part and its array part
+** keeps its size; when most nodes are dead, or integer keys should go
+** to the array part, it is rebuilt in one go.
+*/
+
+/*
+** moves the next 'n' nodes of the old part of 't' to its hash part,
+** freeing the old part after its last node
+*/
+static void movenodes(lua_State *L, Table *t, unsigned int n)
+{
+  OldHash *oh = t->oldhash;
+  unsigned int size = twoto(oh->lsizenode);
+  for (; n > 0 && oh->pos < size; n--)
+  {
+    Node *old = oh->node + oh->pos++;
+    if (!ttisnil(gval(old)))
+    {
+      Node *mp = freenode(t, gkey(old));
+      lua_assert(mp != NULL);
+      setnodekey(L, &mp->i_key, gkey(old));
+      setobj2t(L, gval(mp), gval(old));
+      setnilvalue(gval(old)); /* entry moved */
+    }
+    if (iscollectable(gkey(old)))
+      setdeadvalue(wgkey(old)); /* the GC skips nodes before 'pos' */
+  }
+  if (oh->pos == size)
+  { /* all moved? */
+    t->oldhash = NULL;
+    luaM_freemem(L, oh->node, hashpartsize(size));
+    luaM_free(L, oh);
+  }
+}
+
+/*
+** gives 't' a new hash part twice as large as its current one, which
+** moves there incrementally
+*/
+static void growhash(lua_State *L, Table *t)
+{
+  AuxsetnodeT asn;
+  OldHash *oh = luaM_new(L, OldHash);
+  oh->node = t->node;
+  oh->lsizenode = t->lsizenode;
+  oh->pos = 0;
+  asn.t = t;
+  asn.nhsize = sizenode(t) + 1; /* (twice the size) */
+  if (luaD_rawrunprotected(L, auxsetnode, &asn) != LUA_OK)
+  { /* mem. error? */
+    luaM_free(L, oh);
+    luaD_throw(L, LUA_ERRMEM); /* rethrow memory error */
+  }
+  t->oldhash = oh;
+}
+
+/*
+** nums[i] = number of keys 'k' where 2^(i - 1) < k <= 2^i
+*/
+static void rehash(lua_State *L, Table *t, const TValue *ek)
+{
+  unsigned int asize; /* optimal size for array part */
+  unsigned int na;    /* number of keys in the array part */
+  unsigned int nums[MAXABITS + 1];
+  int i;
+  int totaluse;
+  for (i = 0; i <= MAXABITS; i++)
+    nums[i] = 0;                        /* reset counts */
+  na = numusearray(t, nums);            /* count keys in array part */
+  totaluse = na;                        /* all those keys are integer keys */
+  totaluse += numusehash(t, nums, &na); /* count keys in hash part */
+  /* count extra key */
+  na += countint(ek, nums);
+  totaluse++;
+  /* compute new size for array part */
+  asize = computesizes(nums, &na);
+  if (allocsizenode(t) >= LUAI_INCREHASH && asize == t->sizearray &&
+      hashlsize(totaluse - na) > t->lsizenode)
+    growhash(L, t); /* keys need a larger hash part: grow it incrementally */
+  else /* resize the table to new computed sizes */
+    luaH_resize(L, t, asize, totaluse - na);
+}
+
+/*
+** }=============================================================
+*/
+
+/*
+** inserts a new key into a hash table, growing it when there is no room
+** for the key
+*/
+TValue *luaH_newkey(lua_State *L, Table *t, const TValue *key)
+{
+  Node *mp;
+  TValue aux;
+  if (ttisnil(key))
+    luaG_runerror(L, "table index is nil");
+  else if (ttisfloat(key))//浮点类型,如果可以转int的话,强制转成int
+  {
+    lua_Integer k;
+    if (luaV_tointeger(key, &k, 0))
+    { /* does index fit in an integer? */
+      setivalue(&aux, k);
+      key = &aux; /* insert it as an integer */
+    }
+    else if (luai_numisnan(fltvalue(key)))
+      luaG_runerror(L, "table index is NaN");
+  }
+  if (t->shape != NULL)
+  { /* table keeps its fields in slots? */
+    if (ttisshrstring(key))
+    {
+      TValue *slot = addfield(L, t, key);
+      if (slot != NULL)
+        return slot;
+    }
+    unshape(L, t); /* go on with the hash part */
+  }
+  if (t->oldhash != NULL) /* hash part growing? */
+    movenodes(L, t, LUAI_REHASHSTEP);
+  mp = freenode(t, key);
+  if (mp == NULL)
+  { /* no room for another key? */
+    if (t->oldhash != NULL)
+      movenodes(L, t, MAX_INT); /* (should not happen) finish growing */
+    else
+      rehash(L, t, key); /* 扩容 grow table (maybe incrementally) */
+    /* whatever called 'newkey' takes care of TM cache */
+    return luaH_set(L, t, key); /* insert key into grown table */
+  }
   setnodekey(L, &mp->i_key, key);
   luaC_barrierback(L, t, key);
   lua_assert(ttisnil(gval(mp)));
   return gval(mp);
 }
 
+/*
+** searches for keys not in the hash part of a table in its old part,
+** while it grows (see "Incremental growth"); there, nil values (of
+** moved entries, too) mean absent keys
+*/
+static const TValue *oldint(Table *t, lua_Integer key)
+{
+  Table o;
+  const TValue *v = luaH_getint(oldpart(t, &o), key);
+  return ttisnil(v) ? luaO_nilobject : v;
+}
+
+static const TValue *oldshortstr(Table *t, TString *key)
+{
+  Table o;
+  const TValue *v = luaH_getshortstr(oldpart(t, &o), key);
+  return ttisnil(v) ? luaO_nilobject : v;
+}
+
+static const TValue *oldgeneric(Table *t, const TValue *key)
+{
+  Table o;
+  const TValue *v = luaH_get(oldpart(t, &o), key);
+  return ttisnil(v) ? luaO_nilobject : v;
+}
+
+/* result of a search for a key not in the hash part of 't' */
+#define notfound(t, old) ((t)->oldhash == NULL ? luaO_nilobject : (old))
+
 /*
 ** search function for integers
 */
@@ -580,6 +1270,14 @@ const TValue *luaH_getint(Table *t, lua_Integer key)
     return &t->array[key - 1];
   else
   {
+#if LUAI_SWISSHASH
+    unsigned int h = inthash(key);
+    probe(t, h, n, {
+      if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
+        return gval(n); /* that's it */
+    });
+    return notfound(t, oldint(t, key));
+#else
     Node *n = hashint(t, key);
     for (;;)
     { /* check whether 'key' is somewhere in the chain */
@@ -593,7 +1291,8 @@ const TValue *luaH_getint(Table *t, lua_Integer key)
         n += nx;
       }
     }
-    return luaO_nilobject;
+    return notfound(t, oldint(t, key));
+#endif
   }
 }
 
@@ -602,8 +1301,27 @@ const TValue *luaH_getint(Table *t, lua_Integer key)
 */
 const TValue *luaH_getshortstr(Table *t, TString *key)
 {
-  Node *n = hashstr(t, key);
+#if LUAI_SWISSHASH
+  unsigned int h;
+#else
+  Node *n;
+#endif
   lua_assert(key->tt == LUA_TSHRSTR);
+  if (t->shape != NULL)
+  {
+    int s = findslot(t->shape, key);
+    return (s >= 0) ? &t->slots[s] : luaO_nilobject;
+  }
+#if LUAI_SWISSHASH
+  h = key->hash;
+  probe(t, h, n, {
+    const TValue *k = gkey(n);
+    if (ttisshrstring(k) && eqshrstr(tsvalue(k), key))
+      return gval(n); /* that's it */
+  });
+  return notfound(t, oldshortstr(t, key));
+#else
+  n = hashstr(t, key);
   for (;;)
   { /* check whether 'key' is somewhere in the chain */
     const TValue *k = gkey(n);
@@ -613,10 +1331,66 @@ const TValue *luaH_getshortstr(Table *t, TString *key)
     {
       int nx = gnext(n);
       if (nx == 0)
-        return luaO_nilobject; /* not found */
+        return notfound(t, oldshortstr(t, key));
+      n += nx;
+    }
+  }
+#endif
+}
+
+/*
+** search function for short strings with an inline cache: same as
+** 'luaH_getshortstr', but stores in '*hint' the index of the node
+** where 'key' was found, so that the next search from the same site
+** can check that node first (see 'luaH_getshortstrIC').
+*/
+const TValue *luaH_getshortstrcached(Table *t, TString *key,
+                                     unsigned int *hint)
+{
+#if LUAI_SWISSHASH
+  unsigned int h;
+#else
+  Node *n;
+#endif
+  lua_assert(key->tt == LUA_TSHRSTR);
+  if (t->shape != NULL)
+  {
+    int s = findslot(t->shape, key);
+    if (s < 0)
+      return luaO_nilobject; /* not found */
+    *hint = cast(unsigned int, s); /* remember slot */
+    return &t->slots[s];
+  }
+#if LUAI_SWISSHASH
+  h = key->hash;
+  probe(t, h, n, {
+    const TValue *k = gkey(n);
+    if (ttisshrstring(k) && eqshrstr(tsvalue(k), key))
+    {
+      *hint = cast(unsigned int, n - gnode(t, 0)); /* remember slot */
+      return gval(n);
+    }
+  });
+  return notfound(t, oldshortstr(t, key));
+#else
+  n = hashstr(t, key);
+  for (;;)
+  { /* check whether 'key' is somewhere in the chain */
+    const TValue *k = gkey(n);
+    if (ttisshrstring(k) && eqshrstr(tsvalue(k), key))
+    {
+      *hint = cast(unsigned int, n - gnode(t, 0)); /* remember slot */
+      return gval(n);
+    }
+    else
+    {
+      int nx = gnext(n);
+      if (nx == 0)
+        return notfound(t, oldshortstr(t, key));
       n += nx;
     }
   }
+#endif
 }
 
 /*
@@ -625,6 +1399,14 @@ const TValue *luaH_getshortstr(Table *t, TString *key)
 */
 static const TValue *getgeneric(Table *t, const TValue *key)
 {
+#if LUAI_SWISSHASH
+  unsigned int h = hashkey(key);
+  probe(t, h, n, {
+    if (luaV_rawequalobj(gkey(n), key))
+      return gval(n); /* that's it */
+  });
+  return notfound(t, oldgeneric(t, key));
+#else
   Node *n = mainposition(t, key);
   for (;;)
   { /* check whether 'key' is somewhere in the chain */
@@ -634,10 +1416,11 @@ static const TValue *getgeneric(Table *t, const TValue *key)
     {
       int nx = gnext(n);
       if (nx == 0)
-        return luaO_nilobject; /* not found */
+        return notfound(t, oldgeneric(t, key));
       n += nx;
     }
   }
+#endif
 }
 
 const TValue *luaH_getstr(Table *t, TString *key)
@@ -778,9 +1561,18 @@ lua_Unsigned luaH_getn(Table *t)
 
 #if defined(LUA_DEBUG)
 
+/*
+** with open addressing, returns the first node of the first group
+** probed for 'key'
+*/
 Node *luaH_mainposition(const Table *t, const TValue *key)
 {
+#if LUAI_SWISSHASH
+  unsigned int g = hashgroup(hashkey(key)) & (ngroups(t) - 1);
+  return gnode(t, g * GROUPSIZE);
+#else
   return mainposition(t, key);
+#endif
 }
 
 int luaH_isdummy(const Table *t) { return isdummy(t); }
@@ -35,6 +35,65 @@
 #define allocsizenode(t)	(isdummy(t) ? 0 : sizenode(t))
 
 
+/*
+** Layout of the hash part (see 'ltable.c'): 1 for open addressing with
+** control bytes probed a group at a time ("Swiss tables"), 0 (the
+** default) for the classic chained scatter table with Brent's variation.
+*/
+#if !defined(LUAI_SWISSHASH)
+#define LUAI_SWISSHASH	0
+#endif
+
+
+/*
+** A full hash part with at least LUAI_INCREHASH nodes grows
+** incrementally (see 'ltable.c'): each insertion moves LUAI_REHASHSTEP
+** more of its nodes to the new part.
+*/
+#if !defined(LUAI_INCREHASH)
+#define LUAI_INCREHASH	(1 << 15)
+#endif
+
+#if !defined(LUAI_REHASHSTEP)
+#define LUAI_REHASHSTEP	32
+#endif
+
+
+/* maximum number of keys in a shape (see 'ltable.c') */
+#if !defined(LUAI_MAXSHAPEKEYS)
+#define LUAI_MAXSHAPEKEYS	16
+#endif
+
+
+/*
+** Check whether entry 'hint' of table 't' holds short-string key 'key'.
+** A hint is just a slot index (for a table with a shape) or a node
+** index (otherwise), so it never needs invalidation: after a resize or
+** rehash (or with another table), an out-of-range index or a different
+** key in that entry simply makes the check fail.
+*/
+#define icachehit(t,key,hint) \
+  ((t)->shape != NULL \
+    ? ((hint) < cast(unsigned int, (t)->shape->nkeys) && \
+       (t)->shape->keys[hint] == (key)) \
+    : ((hint) < cast(unsigned int, sizenode(t)) && \
+       ttisshrstring(gkey(gnode(t, hint))) && \
+       tsvalue(gkey(gnode(t, hint))) == (key)))
+
+/* value of entry 'hint' of table 't' */
+#define icacheval(t,hint) \
+  ((t)->shape != NULL ? cast(const TValue *, &(t)->slots[hint]) \
+                      : cast(const TValue *, gval(gnode(t, hint))))
+
+/*
+** 'luaH_getshortstr' with an inline cache: 'ic' points to the hint
+** kept by the instruction doing the access.
+*/
+#define luaH_getshortstrIC(t,key,ic) \
+  (icachehit(t, key, *(ic)) ? icacheval(t, *(ic)) \
+                            : luaH_getshortstrcached(t, key, ic))
+
+
 /* returns the key, given the value of a table entry */
 #define keyfromval(v) \
   (gkey(cast(Node *, cast(char *, (v)) - offsetof(Node, i_val))))
@@ -44,11 +103,15 @@ LUAI_FUNC const TValue *luaH_getint (Table *t, lua_Integer key);
 LUAI_FUNC void luaH_setint (lua_State *L, Table *t, lua_Integer key,
                                                     TValue *value);
 LUAI_FUNC const TValue *luaH_getshortstr (Table *t, TString *key);
+LUAI_FUNC const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                                unsigned int *hint);
 LUAI_FUNC const TValue *luaH_getstr (Table *t, TString *key);
 LUAI_FUNC const TValue *luaH_get (Table *t, const TValue *key);
 LUAI_FUNC TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key);
 LUAI_FUNC TValue *luaH_set (lua_State *L, Table *t, const TValue *key);
 LUAI_FUNC Table *luaH_new (lua_State *L);
+LUAI_FUNC void luaH_useshape (lua_State *L, Table *t);
+LUAI_FUNC void luaH_freeshapes (lua_State *L);
 /**
  * 重新设置Table的大小
  * 说明:luaH_new方法仅仅是初始化了一个Table,真正Table容器大小,需要调用此方法实现
@@ -25,6 +25,8 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -32,6 +34,10 @@
 #include "ltable.h"
 #include "lualib.h"
 
+#if LUAI_GCPTHREADS
+#include <pthread.h>
+#endif
+
 
 
 /*
@@ -123,7 +129,7 @@ static void freeblock (Memcontrol *mc, Header *block) {
 }
 
 
-void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
+static void *debug_realloc_ (void *ud, void *b, size_t oldsize, size_t size) {
   Memcontrol *mc = cast(Memcontrol *, ud);
   Header *block = cast(Header *, b);
   int type;
@@ -175,6 +181,30 @@ void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
 }
 
 
+/*
+** the collector may free blocks from a thread of its own
+*/
+#if LUAI_GCPTHREADS
+
+static pthread_mutex_t memlock = PTHREAD_MUTEX_INITIALIZER;
+
+void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
+  void *res;
+  pthread_mutex_lock(&memlock);
+  res = debug_realloc_(ud, b, oldsize, size);
+  pthread_mutex_unlock(&memlock);
+  return res;
+}
+
+#else
+
+void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
+  return debug_realloc_(ud, b, oldsize, size);
+}
+
+#endif
+
+
 /* }====================================================================== */
 
 
@@ -230,6 +260,14 @@ static void checktable (global_State *g, Table *h) {
   checkobjref(g, hgc, h->metatable);
   for (i = 0; i < h->sizearray; i++)
     checkvalref(g, hgc, &h->array[i]);
+  if (h->shape) {
+    int j;
+    lua_assert(h->sizearray == 0 && isdummy(h));
+    for (j = 0; j < h->shape->nkeys; j++) {
+      checkobjref(g, hgc, h->shape->keys[j]);
+      checkvalref(g, hgc, &h->slots[j]);
+    }
+  }
   for (n = gnode(h, 0); n < limit; n++) {
     if (!ttisnil(gval(n))) {
       lua_assert(!ttisnil(gkey(n)));
@@ -237,6 +275,16 @@ static void checktable (global_State *g, Table *h) {
       checkvalref(g, hgc, gval(n));
     }
   }
+  if (h->oldhash) {  /* entries not moved yet from a growing hash part */
+    lua_assert(!isdummy(h) && h->oldhash->lsizenode < h->lsizenode);
+    limit = h->oldhash->node + twoto(h->oldhash->lsizenode);
+    for (n = h->oldhash->node + h->oldhash->pos; n < limit; n++) {
+      if (!ttisnil(gval(n))) {
+        checkvalref(g, hgc, gkey(n));
+        checkvalref(g, hgc, gval(n));
+      }
+    }
+  }
 }
 
 
@@ -424,7 +472,7 @@ int lua_checkmemory (lua_State *L) {
   markgrays(g);
   /* check 'fixedgc' list */
   for (o = g->fixedgc; o != NULL; o = o->next) {
-    lua_assert(o->tt == LUA_TSHRSTR && isgray(o));
+    lua_assert(novariant(o->tt) == LUA_TSTRING && isgray(o));
   }
   /* check 'allgc' list */
   checkgray(g, g->allgc);
@@ -538,6 +586,69 @@ static int listk (lua_State *L) {
 }
 
 
+/*
+** static histogram of the code of a function and all its nested
+** functions: counts each opcode ("OP") and each pair of adjacent
+** opcodes ("OP1 OP2"), always in their generic form
+*/
+static void addcount (lua_State *L, int t, const char *key) {
+  lua_Integer n;
+  lua_getfield(L, t, key);
+  n = lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  lua_pushinteger(L, n + 1);
+  lua_setfield(L, t, key);
+}
+
+static void ophistogram (lua_State *L, int t, Proto *p) {
+  int pc, i;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    OpCode o = genericop(GET_OPCODE(p->code[pc]));
+    addcount(L, t, luaP_opnames[o]);
+    if (pc + 1 < p->sizecode) {
+      OpCode o1 = genericop(GET_OPCODE(p->code[pc + 1]));
+      addcount(L, t, lua_pushfstring(L, "%s %s", luaP_opnames[o],
+                                                 luaP_opnames[o1]));
+      lua_pop(L, 1);
+    }
+  }
+  for (i = 0; i < p->sizep; i++)
+    ophistogram(L, t, p->p[i]);
+}
+
+static int opstats (lua_State *L) {
+  luaL_argcheck(L, lua_isfunction(L, 1) && !lua_iscfunction(L, 1),
+                 1, "Lua function expected");
+  lua_newtable(L);
+  ophistogram(L, lua_gettop(L), getproto(obj_at(L, 1)));
+  return 1;
+}
+
+
+/*
+** T.jit(f [, on]): whether 'f' runs compiled code; 'on' compiles it at
+** once (true) or keeps it interpreted from now on (false; not to be
+** used while 'f' is running)
+*/
+static int jit (lua_State *L) {
+  Proto *p;
+  luaL_argcheck(L, lua_isfunction(L, 1) && !lua_iscfunction(L, 1),
+                 1, "Lua function expected");
+  p = getproto(obj_at(L, 1));
+#if LUA_USE_JIT
+  if (!lua_isnoneornil(L, 2)) {
+    p->jitcount = 0;  /* no more automatic compilation */
+    if (!lua_toboolean(L, 2) && p->jit != NULL)
+      luaJ_free(p);
+    else if (lua_toboolean(L, 2) && p->jit == NULL)
+      luaJ_compile(L, p);
+  }
+#endif
+  lua_pushboolean(L, p->jit != NULL);
+  return 1;
+}
+
+
 static int listlocals (lua_State *L) {
   Proto *p;
   int pc = cast_int(luaL_checkinteger(L, 2)) - 1;
@@ -643,6 +754,8 @@ static int gc_state (lua_State *L) {
   }
   else {
     global_State *g = G(L);
+    if (isgenerational(g))
+      luaL_error(L, "cannot change states in generational mode");
     lua_lock(L);
     if (option < g->gcstate) {  /* must cross 'pause'? */
       luaC_runtilstate(L, bitmask(GCSpause));  /* run until pause */
@@ -655,6 +768,172 @@ static int gc_state (lua_State *L) {
 }
 
 
+/*
+** records (as digits) the phases entered by the collector, checking
+** that each change starts from the phase entered before
+*/
+static struct {
+  char phases[256];
+  int n;
+  int last;
+} gctrace;
+
+static void tracephase (void *ud, int from, int to) {
+  lua_assert(ud == &gctrace);
+  lua_assert(from == gctrace.last && from != to);
+  UNUSED(ud); UNUSED(from);
+  gctrace.last = to;
+  if (gctrace.n < (int)sizeof(gctrace.phases))
+    gctrace.phases[gctrace.n++] = cast(char, '0' + to);
+}
+
+
+static int gc_trace (lua_State *L) {
+  if (lua_toboolean(L, 1)) {  /* start tracing */
+    gctrace.n = 0;
+    gctrace.last = G(L)->gcstate;
+    lua_setgcphasef(L, tracephase, &gctrace);
+    return 0;
+  }
+  else {  /* stop tracing and return the phases entered */
+    lua_setgcphasef(L, NULL, NULL);
+    lua_pushlstring(L, gctrace.phases, gctrace.n);
+    return 1;
+  }
+}
+
+
+/*
+** turns background freeing on or off; returns whether it was on. (Lua
+** code cannot do that by itself, as it needs a thread-safe allocator;
+** the one here takes a lock.)
+*/
+static int gc_bgfree (lua_State *L) {
+  lua_pushboolean(L, lua_gc(L, LUA_GCBGFREE, lua_toboolean(L, 1)));
+  return 1;
+}
+
+
+/*
+** sets the number of threads marking in parallel; returns the previous
+** one
+*/
+static int gc_parallel (lua_State *L) {
+  lua_pushinteger(L, lua_gc(L, LUA_GCPARALLEL, (int)luaL_checkinteger(L, 1)));
+  return 1;
+}
+
+
+/*
+** sets the soft or the hard limit for the memory in use, which only a
+** host can do; returns the previous one
+*/
+static int gc_limit (lua_State *L) {
+  static const char *const opts[] = {"soft", "hard", NULL};
+  static const int optsnum[] = {LUA_GCSETSOFTLIMIT, LUA_GCSETHARDLIMIT};
+  int o = optsnum[luaL_checkoption(L, 1, NULL, opts)];
+  lua_pushinteger(L, lua_gc(L, o, (int)luaL_checkinteger(L, 2)));
+  return 1;
+}
+
+
+/*
+** counts the calls to the memory-limit function; the hard limit is
+** raised by 'raise' Kbytes when reached
+*/
+static struct {
+  int soft, hard;
+  int raise;
+} memlimits;
+
+static void countlimit (void *ud, lua_State *L, int what, size_t total) {
+  lua_assert(ud == &memlimits);
+  UNUSED(ud);
+  if (what == LUA_GCSETSOFTLIMIT) {
+    lua_assert(total > G(L)->memsoft);
+    memlimits.soft++;
+  }
+  else {
+    lua_assert(what == LUA_GCSETHARDLIMIT && total > G(L)->memhard);
+    memlimits.hard++;
+    if (memlimits.raise > 0) {
+      int hard = lua_gc(L, LUA_GCSETHARDLIMIT, 0);
+      lua_gc(L, LUA_GCSETHARDLIMIT, hard + memlimits.raise);
+    }
+  }
+}
+
+
+static int mem_limits (lua_State *L) {
+  if (!lua_isnone(L, 1)) {  /* start counting */
+    memlimits.soft = memlimits.hard = 0;
+    memlimits.raise = (int)luaL_checkinteger(L, 1);
+    lua_setmemlimitf(L, countlimit, &memlimits);
+    return 0;
+  }
+  else {  /* stop counting and return the counts */
+    lua_setmemlimitf(L, NULL, NULL);
+    lua_pushinteger(L, memlimits.soft);
+    lua_pushinteger(L, memlimits.hard);
+    return 2;
+  }
+}
+
+
+/*
+** With a string, pins it ('luaS_pin') and returns the pinned
+** string; without arguments, returns the hits and misses of the API
+** string cache
+*/
+static int str_cache (lua_State *L) {
+  if (!lua_isnone(L, 1)) {
+    const char *s = luaL_checkstring(L, 1);
+    TString *ts;
+    lua_lock(L);
+    ts = luaS_pin(L, s);
+    setsvalue2s(L, L->top, ts);
+    api_incr_top(L);
+    lua_unlock(L);
+    return 1;
+  }
+  else {
+    size_t hits, misses;
+    lua_strcachestats(L, &hits, &misses);
+    lua_pushinteger(L, (lua_Integer)hits);
+    lua_pushinteger(L, (lua_Integer)misses);
+    return 2;
+  }
+}
+
+
+static int extfreed = 0;  /* external strings released */
+
+static void freeext (void *ud, const char *s, size_t len) {
+  lua_assert(ud == &extfreed && s[len] == '\0');
+  extfreed++;
+  free((void *)s);
+}
+
+/*
+** With a string, pushes an external string with a copy of it (in
+** memory not controlled by Lua); without arguments, returns how many
+** external strings were released
+*/
+static int ext_string (lua_State *L) {
+  if (!lua_isnone(L, 1)) {
+    size_t len;
+    const char *s = luaL_checklstring(L, 1, &len);
+    char *copy = (char *)malloc(len + 1);
+    if (copy == NULL) luaL_error(L, "not enough memory");
+    memcpy(copy, s, len + 1);
+    lua_pushexternalstring(L, copy, len, freeext, &extfreed);
+  }
+  else
+    lua_pushinteger(L, extfreed);
+  return 1;
+}
+
+
 static int hash_query (lua_State *L) {
   if (lua_isnone(L, 2)) {
     luaL_argcheck(L, lua_type(L, 1) == LUA_TSTRING, 1, "string expected");
@@ -689,6 +968,15 @@ static int table_query (lua_State *L) {
     lua_pushinteger(L, t->sizearray);
     lua_pushinteger(L, allocsizenode(t));
     lua_pushinteger(L, isdummy(t) ? 0 : t->lastfree - t->node);
+    if (t->shape) {  /* number of keys in its shape */
+      lua_pushinteger(L, t->shape->nkeys);
+      return 4;
+    }
+    if (t->oldhash) {  /* nodes still to move from a growing hash part */
+      lua_pushnil(L);
+      lua_pushinteger(L, twoto(t->oldhash->lsizenode) - t->oldhash->pos);
+      return 5;
+    }
   }
   else if ((unsigned int)i < t->sizearray) {
     lua_pushinteger(L, i);
@@ -724,6 +1012,8 @@ static int string_query (lua_State *L) {
   else if (s < tb->size) {
     TString *ts;
     int n = 0;
+    if (tb->oldhash != NULL && s % tb->oldsize >= tb->oldpos)
+      return 0;  /* bucket not in use yet */
     for (ts = tb->hash[s]; ts != NULL; ts = ts->u.hnext) {
       setsvalue2s(L, L->top, ts);
       api_incr_top(L);
@@ -831,7 +1121,8 @@ static int num2int (lua_State *L) {
 static int newstate (lua_State *L) {
   void *ud;
   lua_Alloc f = lua_getallocf(L, &ud);
-  lua_State *L1 = lua_newstate(f, ud);
+  lua_State *L1 = lua_toboolean(L, 1) ? luaL_newarenastate()
+                                      : lua_newstate(f, ud);
   if (L1) {
     lua_atpanic(L1, tpanic);
     lua_pushlightuserdata(L, L1);
@@ -1512,30 +1803,39 @@ static int coresume (lua_State *L) {
 static const struct luaL_Reg tests_funcs[] = {
   {"checkmemory", lua_checkmemory},
   {"closestate", closestate},
+  {"bgfree", gc_bgfree},
   {"d2s", d2s},
   {"doonnewstack", doonnewstack},
   {"doremote", doremote},
+  {"extstring", ext_string},
   {"gccolor", gc_color},
+  {"gclimit", gc_limit},
+  {"gcparallel", gc_parallel},
   {"gcstate", gc_state},
+  {"gctrace", gc_trace},
   {"getref", getref},
   {"hash", hash_query},
   {"int2fb", int2fb_aux},
   {"log2", log2_aux},
   {"limits", get_limits},
+  {"jit", jit},
   {"listcode", listcode},
   {"listk", listk},
   {"listlocals", listlocals},
   {"loadlib", loadlib},
+  {"memlimits", mem_limits},
   {"checkpanic", checkpanic},
   {"newstate", newstate},
   {"newuserdata", newuserdata},
   {"num2int", num2int},
+  {"opstats", opstats},
   {"pushuserdata", pushuserdata},
   {"querystr", string_query},
   {"querytab", table_query},
   {"ref", tref},
   {"resume", coresume},
   {"s2d", s2d},
+  {"strcache", str_cache},
   {"sethook", sethook},
   {"stacklevel", stacklevel},
   {"testC", testC},
@@ -1563,6 +1863,8 @@ int luaB_opentests (lua_State *L) {
   lua_assert(ud == cast(void *, &l_memcontrol));
   lua_setallocf(L, lua_getallocf(L, NULL), ud);
   luaL_newlib(L, tests_funcs);
+  lua_pushboolean(L, LUAI_SWISSHASH);  /* layout of hash parts */
+  lua_setfield(L, -2, "swisshash");
   return 1;
 }
 
@@ -125,5 +125,31 @@ LUA_API void *debug_realloc (void *ud, void *block,
 #define STRCACHE_N	23
 #define STRCACHE_M	5
 
+
+/* compile functions almost at once, so that tests run compiled code */
+#define LUAI_JITHOT	2
+
+/* grow middle-sized tables incrementally, and slowly */
+#define LUAI_INCREHASH	256
+#define LUAI_REHASHSTEP	4
+
+/* resize the string table incrementally (almost) always, and slowly */
+#define LUAI_INCRESTRT	8
+#define LUAI_STRREHASHSTEP	2
+
+/* build most concatenations of long strings in shared buffers */
+#define LUAI_MINBUFFSTR	64
+
+/* yield without long jumps whenever possible (all C code here allows it) */
+#define LUAI_STACKLESSYIELD	1
+
+/* keep only a few dead threads for reuse, so that the pool fills up */
+#define LUAI_THREADPOOL	4
+
+/* mark in parallel (with 4 markers) whenever the collector can */
+#define LUAI_GCPARMIN	1
+#define LUAI_GCTHREADS	4
+#define luai_ncpus()	4
+
 #endif
 
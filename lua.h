@@ -123,6 +123,24 @@ typedef int (*lua_Writer) (lua_State *L, const void *p, size_t sz, void *ud);
 typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize);
 
 
+/*
+ ** Type for functions called when the collector changes phase
+ */
+typedef void (*lua_GCPhaseF) (void *ud, int from, int to);
+
+
+/*
+ ** Type for functions called when memory use crosses a limit
+ */
+typedef void (*lua_MemLimitF) (void *ud, lua_State *L, int what, size_t total);
+
+
+/*
+ ** Type for functions that release the memory of external strings
+ */
+typedef void (*lua_FreeF) (void *ud, const char *s, size_t len);
+
+
 
 /*
  ** generic extra include file
@@ -153,6 +171,7 @@ extern const char lua_ident[];
 LUA_API lua_State *(lua_newstate) (lua_Alloc f, void *ud);
 LUA_API void       (lua_close) (lua_State *L);
 LUA_API lua_State *(lua_newthread) (lua_State *L);
+LUA_API int        (lua_resetthread) (lua_State *L);
 
 LUA_API lua_CFunction (lua_atpanic) (lua_State *L, lua_CFunction panicf);
 
@@ -315,6 +334,9 @@ LUA_API const char *(lua_pushlstring) (lua_State *L, const char *s, size_t len);
  * 压入一个字符串到栈L->top上
  */
 LUA_API const char *(lua_pushstring) (lua_State *L, const char *s);
+LUA_API const char *(lua_pushexternalstring) (lua_State *L, const char *s,
+                                             size_t len, lua_FreeF freef,
+                                             void *ud);
 /**
  * 压入字符串到栈L->top上
  */
@@ -422,10 +444,63 @@ LUA_API int (lua_isyieldable) (lua_State *L);
 #define LUA_GCSETPAUSE		6
 #define LUA_GCSETSTEPMUL	7
 #define LUA_GCISRUNNING		9
+#define LUA_GCGEN		10
+#define LUA_GCINC		11
+#define LUA_GCSETMINORMUL	12
+#define LUA_GCSETMAJORMUL	13
+#define LUA_GCBGFREE		14
+#define LUA_GCSETSTEPTIME	15
+#define LUA_GCSETMAXPAUSE	16
+#define LUA_GCMEMRATE		17
+#define LUA_GCSETSOFTLIMIT	18
+#define LUA_GCSETHARDLIMIT	19
+#define LUA_GCPARALLEL		20
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
 
+/*
+ ** phases of a collection cycle
+ */
+#define LUA_GCPPROPAGATE	0
+#define LUA_GCPATOMIC		1
+#define LUA_GCPSWPALLGC		2
+#define LUA_GCPSWPFINOBJ	3
+#define LUA_GCPSWPTOBEFNZ	4
+#define LUA_GCPSWPEND		5
+#define LUA_GCPCALLFIN		6
+#define LUA_GCPPAUSE		7
+
+#define LUA_NUMGCPHASES		8
+
+
+/*
+ ** collector statistics, accumulated since the state was created (times
+ ** in microseconds; objects are counted by their basic type, with
+ ** function prototypes counted as functions)
+ */
+typedef struct lua_GCStats {
+	size_t cycles;  /* complete cycles (major collections) */
+	size_t minors;  /* minor collections (generational mode) */
+	size_t emergencies;  /* emergency collections */
+	size_t phasetime[LUA_NUMGCPHASES];  /* time spent in each phase */
+	size_t maxatomic;  /* longest atomic phase */
+	size_t marked[LUA_NUMTAGS];  /* objects found marked by the sweep */
+	size_t swept[LUA_NUMTAGS];  /* dead objects freed by the sweep */
+	size_t freedbytes;  /* memory freed by the sweep */
+	size_t finalizers;  /* finalizers called */
+} lua_GCStats;
+
+LUA_API void (lua_gcstats) (lua_State *L, lua_GCStats *s);
+LUA_API lua_GCPhaseF (lua_getgcphasef) (lua_State *L, void **ud);
+LUA_API void (lua_setgcphasef) (lua_State *L, lua_GCPhaseF f, void *ud);
+LUA_API lua_MemLimitF (lua_getmemlimitf) (lua_State *L, void **ud);
+LUA_API void (lua_setmemlimitf) (lua_State *L, lua_MemLimitF f, void *ud);
+LUA_API int (lua_memdump) (lua_State *L, lua_Writer writer, void *data);
+LUA_API int (lua_heapsnapshot) (lua_State *L, lua_Writer writer,
+                                void *data);
+
+
 /*
  ** miscellaneous functions
  */
@@ -439,6 +514,10 @@ LUA_API void  (lua_len)    (lua_State *L, int idx);
 
 LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
 
+LUA_API const char *(lua_pinstring) (lua_State *L, const char *s);
+LUA_API void (lua_strcachestats) (lua_State *L, size_t *hits,
+                                  size_t *misses);
+
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 
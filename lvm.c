@@ -22,6 +22,7 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -59,6 +60,25 @@
 
 #endif
 
+/*
+** Try to convert string 'obj' to a number, which goes to 'result'.
+** A string with its bytes in a 'StrBuff' may be followed by the bytes
+** of longer strings; it gets a '\0' at its end during the conversion.
+*/
+static int l_strton(const TValue *obj, TValue *result)
+{
+	char *s = svalue(obj);
+	size_t len = vslen(obj);
+	char c = s[len];
+	int res;
+	if (c != '\0') /* not terminated? */
+		s[len] = '\0';
+	res = (luaO_str2num(s, result) == len + 1);
+	if (c != '\0')
+		s[len] = c; /* restore byte of the longer string */
+	return res;
+}
+
 /*
 ** Try to convert a value to a float. The float case is already handled
 ** by the macro 'tonumber'.
@@ -71,8 +91,7 @@ int luaV_tonumber_(const TValue *obj, lua_Number *n)
 		*n = cast_num(ivalue(obj));
 		return 1;
 	}
-	else if (cvt2num(obj) && /* string convertible to number? */
-			 luaO_str2num(svalue(obj), &v) == vslen(obj) + 1)
+	else if (cvt2num(obj) && l_strton(obj, &v)) /* string convertible to number? */
 	{
 		*n = nvalue(&v); /* convert result of 'luaO_str2num' to a float */
 		return 1;
@@ -109,8 +128,7 @@ again:
 		*p = ivalue(obj);
 		return 1;
 	}
-	else if (cvt2num(obj) &&
-			 luaO_str2num(svalue(obj), &v) == vslen(obj) + 1)
+	else if (cvt2num(obj) && l_strton(obj, &v))
 	{
 		obj = &v;
 		goto again; /* convert result from 'luaO_str2num' to an integer */
@@ -158,6 +176,43 @@ static int forlimit(const TValue *obj, lua_Integer *p, lua_Integer step,
 	return 1;
 }
 
+/*
+** Prepare a numeric for loop (OP_FORPREP): 'ra' points to the initial
+** value, followed by the limit and the step. Make them all integers
+** or all floats, and pre-decrement the initial value by the step.
+*/
+void luaV_forprep(lua_State *L, StkId ra)
+{
+	TValue *init = ra;
+	TValue *plimit = ra + 1;
+	TValue *pstep = ra + 2;
+	lua_Integer ilimit;
+	int stopnow;
+	if (ttisinteger(init) && ttisinteger(pstep) &&
+		forlimit(plimit, &ilimit, ivalue(pstep), &stopnow))
+	{
+		/* all values are integer */
+		lua_Integer initv = (stopnow ? 0 : ivalue(init));
+		setivalue(plimit, ilimit);
+		setivalue(init, intop(-, initv, ivalue(pstep)));
+	}
+	else
+	{ /* try making all values floats */
+		lua_Number ninit;
+		lua_Number nlimit;
+		lua_Number nstep;
+		if (!tonumber(plimit, &nlimit))
+			luaG_runerror(L, "'for' limit must be a number");
+		setfltvalue(plimit, nlimit);
+		if (!tonumber(pstep, &nstep))
+			luaG_runerror(L, "'for' step must be a number");
+		setfltvalue(pstep, nstep);
+		if (!tonumber(init, &ninit))
+			luaG_runerror(L, "'for' initial value must be a number");
+		setfltvalue(init, luai_numsub(L, ninit, nstep));
+	}
+}
+
 /*
 ** Finish the table access 'val = t[key]'.
 ** if 'slot' is NULL, 't' is not a table; otherwise, 'slot' points to
@@ -260,7 +315,7 @@ void luaV_finishset(lua_State *L, const TValue *t, TValue *key,
 ** -larger than zero if 'ls' is smaller-equal-larger than 'rs'.
 ** The code is a little tricky because it allows '\0' in the strings
 ** and it uses 'strcoll' (to respect locales) for each segments
-** of the strings.
+** of the strings. Both strings must end with a '\0' (see 'cmpstr').
 */
 static int l_strcmp(const TString *ls, const TString *rs)
 {
@@ -386,6 +441,19 @@ static int LEnum(const TValue *l, const TValue *r)
 	}
 }
 
+/*
+** Compare two strings with 'l_strcmp', first giving a '\0' at their
+** ends to those in a 'StrBuff' that may lack it.
+*/
+static int cmpstr(lua_State *L, TString *ls, TString *rs)
+{
+	if (isopenstr(ls))
+		luaS_sealbuff(L, ls);
+	if (isopenstr(rs))
+		luaS_sealbuff(L, rs);
+	return l_strcmp(ls, rs);
+}
+
 /*
 ** Main operation less than; return 'l < r'.
 */
@@ -395,7 +463,7 @@ int luaV_lessthan(lua_State *L, const TValue *l, const TValue *r)
 	if (ttisnumber(l) && ttisnumber(r)) /* both operands are numbers? */
 		return LTnum(l, r);
 	else if (ttisstring(l) && ttisstring(r)) /* both are strings? */
-		return l_strcmp(tsvalue(l), tsvalue(r)) < 0;
+		return cmpstr(L, tsvalue(l), tsvalue(r)) < 0;
 	else if ((res = luaT_callorderTM(L, l, r, TM_LT)) < 0) /* no metamethod? */
 		luaG_ordererror(L, l, r);						   /* error */
 	return res;
@@ -415,7 +483,7 @@ int luaV_lessequal(lua_State *L, const TValue *l, const TValue *r)
 	if (ttisnumber(l) && ttisnumber(r)) /* both operands are numbers? */
 		return LEnum(l, r);
 	else if (ttisstring(l) && ttisstring(r)) /* both are strings? */
-		return l_strcmp(tsvalue(l), tsvalue(r)) <= 0;
+		return cmpstr(L, tsvalue(l), tsvalue(r)) <= 0;
 	else if ((res = luaT_callorderTM(L, l, r, TM_LE)) >= 0) /* try 'le' */
 		return res;
 	else
@@ -556,6 +624,12 @@ void luaV_concat(lua_State *L, int total)
 				copy2buff(top, n, buff); /* copy strings to buffer */
 				ts = luaS_newlstr(L, buff, tl);
 			}
+			else if (tl >= LUAI_MINBUFFSTR && ttislngstring(top - n))
+			{ /* appending to a long string; keep it in a buffer */
+				TString *first = tsvalue(top - n);
+				ts = luaS_extend(L, first, tl);
+				copy2buff(top, n - 1, getstr(ts) + first->u.lnglen);
+			}
 			else
 			{ /* long string; copy strings directly to final result */
 				ts = luaS_createlngstrobj(L, tl);
@@ -734,7 +808,7 @@ void luaV_finishOp(lua_State *L)
 	CallInfo *ci = L->ci;
 	StkId base = ci->u.l.base;
 	Instruction inst = *(ci->u.l.savedpc - 1); /* interrupted instruction */
-	OpCode op = GET_OPCODE(inst);
+	OpCode op = genericop(GET_OPCODE(inst));
 	switch (op)
 	{ /* finish its execution */
 	case OP_ADD:
@@ -874,6 +948,45 @@ void luaV_finishOp(lua_State *L)
 		lua_assert(base <= L->top && L->top < L->stack + L->stacksize);    \
 	}
 
+/*
+** rewrite the instruction being executed so that it uses opcode 'o'
+** from now on (see "quickened opcodes" in 'lopcodes.h')
+*/
+#define quicken(o) SET_OPCODE(cl->p->code[pcRel(ci->u.l.savedpc, cl->p)], o)
+
+/*
+** second half of a superinstruction: fetch the next instruction (an
+** 'o') and jump straight to its code 'lbl'. With line or count hooks,
+** take the normal path instead, so that 'vmfetch' can trace it.
+*/
+#define fusenext(o, lbl)                                    \
+	{                                                       \
+		if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))   \
+		{                                                   \
+			vmbreak;                                        \
+		}                                                   \
+		i = *(ci->u.l.savedpc++);                           \
+		lua_assert(GET_OPCODE(i) == o);                     \
+		ra = RA(i);                                         \
+		goto lbl;                                           \
+	}
+
+/*
+** at the backward jump of a loop: go (back) to compiled code if the
+** function has it or this iteration makes it hot (see 'ljit.h')
+*/
+#if LUA_USE_JIT
+#define jitloop()                      \
+	{                                  \
+		if (luaJ_loopwanted(L, cl->p)) \
+			goto newframe;             \
+	}
+#else
+#define jitloop() \
+	{             \
+	}
+#endif
+
 #define vmdispatch(o) switch (o)
 #define vmcase(l) case l:
 #define vmbreak break
@@ -893,6 +1006,28 @@ void luaV_finishOp(lua_State *L)
 			Protect(luaV_finishget(L, t, k, v, slot)); \
 	}
 
+/*
+** 'gettableProtected' with an inline cache: when 't' is a table and
+** 'k' is a short string (typically a constant field name), look it up
+** through the cache slot of the current instruction.
+*/
+#define gettableCached(L, t, k, v)                                      \
+	{                                                                   \
+		if (ttistable(t) && ttisshrstring(k))                           \
+		{                                                               \
+			const TValue *slot = luaH_getshortstrIC(hvalue(t), tsvalue(k), \
+				cl->p->icache + pcRel(ci->u.l.savedpc, cl->p));         \
+			if (!ttisnil(slot))                                         \
+			{                                                           \
+				setobj2s(L, v, slot);                                   \
+			}                                                           \
+			else                                                        \
+				Protect(luaV_finishget(L, t, k, v, slot));              \
+		}                                                               \
+		else                                                            \
+			gettableProtected(L, t, k, v);                              \
+	}
+
 /* same for 'luaV_settable' */
 #define settableProtected(L, t, k, v)                  \
 	{                                                  \
@@ -908,12 +1043,29 @@ void luaV_execute(lua_State *L)
 	LClosure *cl;				  //当前所在的函数环境
 	TValue *k;					  //当前函数环境的常量数组
 	StkId base;					  //当前函数环境的战base地址
+#if LUA_USE_JUMPTABLE
+#include "ljumptab.h"
+#endif
 	ci->callstatus |= CIST_FRESH; /* fresh invocation of 'luaV_execute" */
 newframe:						  /* reentry point when frame changes (call/return) */
 	lua_assert(ci == L->ci);
 	cl = clLvalue(ci->func); /* local reference to function's closure */
 	k = cl->p->k;			 /* local reference to function's constant table */
 	base = ci->u.l.base;	 /* local copy of function's base */
+#if LUA_USE_JIT
+	if (luaJ_wanted(L, ci, cl->p))
+	{ /* run compiled code (see 'ljit.c') */
+		switch (luaJ_execute(L, ci))
+		{
+		case LUAJ_CALL: /* it called a Lua function */
+			ci = L->ci;
+			goto newframe; /* restart luaV_execute over new Lua function */
+		case LUAJ_YIELD: /* a C function it called yielded */
+			return;
+		}
+		base = ci->u.l.base; /* continue interpreting where it stopped */
+	}
+#endif
 	/* main loop of interpreter */
 	for (;;)
 	{
@@ -932,6 +1084,17 @@ newframe:						  /* reentry point when frame changes (call/return) */
 			{
 				TValue *rb = k + GETARG_Bx(i);
 				setobj2s(L, ra, rb);
+				switch (GET_OPCODE(*ci->u.l.savedpc))
+				{ /* fuse with next instruction? */
+				case OP_CALL:
+					quicken(OP_LOADKCALL);
+					break;
+				case OP_RETURN:
+					quicken(OP_LOADKRETURN);
+					break;
+				default:
+					break;
+				}
 				vmbreak;
 			}
 			vmcase(OP_LOADKX)
@@ -969,14 +1132,16 @@ newframe:						  /* reentry point when frame changes (call/return) */
 			{
 				TValue *upval = cl->upvals[GETARG_B(i)]->v;
 				TValue *rc = RKC(i);
-				gettableProtected(L, upval, rc, ra);
+				if (GET_OPCODE(*ci->u.l.savedpc) == OP_CALL)
+					quicken(OP_GETTABUPCALL);
+				gettableCached(L, upval, rc, ra);
 				vmbreak;
 			}
 			vmcase(OP_GETTABLE)
 			{
 				StkId rb = RB(i);
 				TValue *rc = RKC(i);
-				gettableProtected(L, rb, rc, ra);
+				gettableCached(L, rb, rc, ra);
 				vmbreak;
 			}
 			vmcase(OP_SETTABUP)
@@ -1008,7 +1173,9 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				int c = GETARG_C(i);
 				Table *t = luaH_new(L);
 				sethvalue(L, ra, t);
-				if (b != 0 || c != 0)
+				if (b == 0 && c != 0 && luaO_fb2int(c) <= LUAI_MAXSHAPEKEYS)
+					luaH_useshape(L, t); /* a record */
+				else if (b != 0 || c != 0)
 					luaH_resize(L, t, luaO_fb2int(b), luaO_fb2int(c));
 				checkGC(L, ra + 1);
 				vmbreak;
@@ -1020,7 +1187,12 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				TValue *rc = RKC(i);
 				TString *key = tsvalue(rc); /* key must be a string */
 				setobjs2s(L, ra + 1, rb);
-				if (luaV_fastget(L, rb, key, aux, luaH_getstr))
+				if (ttistable(rb) && key->tt == LUA_TSHRSTR)
+					aux = luaH_getshortstrIC(hvalue(rb), key,
+						cl->p->icache + pcRel(ci->u.l.savedpc, cl->p));
+				else
+					(void)luaV_fastget(L, rb, key, aux, luaH_getstr);
+				if (aux != NULL && !ttisnil(aux))
 				{
 					setobj2s(L, ra, aux);
 				}
@@ -1029,6 +1201,7 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				vmbreak;
 			}
 			vmcase(OP_ADD)
+			l_add:
 			{
 				TValue *rb = RKB(i);
 				TValue *rc = RKC(i);
@@ -1039,6 +1212,12 @@ newframe:						  /* reentry point when frame changes (call/return) */
 					lua_Integer ib = ivalue(rb);
 					lua_Integer ic = ivalue(rc);
 					setivalue(ra, intop(+, ib, ic));
+					quicken(OP_ADDII);
+				}
+				else if (ttisfloat(rb) && ttisfloat(rc))
+				{
+					setfltvalue(ra, luai_numadd(L, fltvalue(rb), fltvalue(rc)));
+					quicken(OP_ADDFF);
 				}
 				else if (tonumber(rb, &nb) && tonumber(rc, &nc))
 				{
@@ -1051,6 +1230,7 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				vmbreak;
 			}
 			vmcase(OP_SUB)
+			l_sub:
 			{
 				TValue *rb = RKB(i);
 				TValue *rc = RKC(i);
@@ -1061,6 +1241,12 @@ newframe:						  /* reentry point when frame changes (call/return) */
 					lua_Integer ib = ivalue(rb);
 					lua_Integer ic = ivalue(rc);
 					setivalue(ra, intop(-, ib, ic));
+					quicken(OP_SUBII);
+				}
+				else if (ttisfloat(rb) && ttisfloat(rc))
+				{
+					setfltvalue(ra, luai_numsub(L, fltvalue(rb), fltvalue(rc)));
+					quicken(OP_SUBFF);
 				}
 				else if (tonumber(rb, &nb) && tonumber(rc, &nc))
 				{
@@ -1073,6 +1259,7 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				vmbreak;
 			}
 			vmcase(OP_MUL)
+			l_mul:
 			{
 				TValue *rb = RKB(i);
 				TValue *rc = RKC(i);
@@ -1083,6 +1270,12 @@ newframe:						  /* reentry point when frame changes (call/return) */
 					lua_Integer ib = ivalue(rb);
 					lua_Integer ic = ivalue(rc);
 					setivalue(ra, intop(*, ib, ic));
+					quicken(OP_MULII);
+				}
+				else if (ttisfloat(rb) && ttisfloat(rc))
+				{
+					setfltvalue(ra, luai_nummul(L, fltvalue(rb), fltvalue(rc)));
+					quicken(OP_MULFF);
 				}
 				else if (tonumber(rb, &nb) && tonumber(rc, &nc))
 				{
@@ -1314,6 +1507,8 @@ newframe:						  /* reentry point when frame changes (call/return) */
 			vmcase(OP_JMP)
 			{
 				dojump(ci, i, 0);
+				if (GETARG_sBx(i) < 0)
+					jitloop();
 				vmbreak;
 			}
 			vmcase(OP_EQ)
@@ -1327,17 +1522,31 @@ newframe:						  /* reentry point when frame changes (call/return) */
 					vmbreak;
 			}
 			vmcase(OP_LT)
+			l_lt:
 			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc))
+					quicken(OP_LTII);
+				else if (ttisfloat(rb) && ttisfloat(rc))
+					quicken(OP_LTFF);
 				Protect(
-					if (luaV_lessthan(L, RKB(i), RKC(i)) != GETARG_A(i))
+					if (luaV_lessthan(L, rb, rc) != GETARG_A(i))
 						ci->u.l.savedpc++;
 					else donextjump(ci);)
 					vmbreak;
 			}
 			vmcase(OP_LE)
+			l_le:
 			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc))
+					quicken(OP_LEII);
+				else if (ttisfloat(rb) && ttisfloat(rc))
+					quicken(OP_LEFF);
 				Protect(
-					if (luaV_lessequal(L, RKB(i), RKC(i)) != GETARG_A(i))
+					if (luaV_lessequal(L, rb, rc) != GETARG_A(i))
 						ci->u.l.savedpc++;
 					else donextjump(ci);)
 					vmbreak;
@@ -1363,13 +1572,25 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				vmbreak;
 			}
 			vmcase(OP_CALL)
+			l_call:
 			{
 				int b = GETARG_B(i);
 				int nresults = GETARG_C(i) - 1;
 				if (b != 0)
+				{
 					L->top = ra + b; /* else previous instruction set top */
+					if (ttisLclosure(ra) &&
+						luaD_canfastcall(L, clLvalue(ra)->p, b - 1))
+					{ /* plain call to a Lua function */
+						luaD_fastcall(L, ra, nresults, clLvalue(ra)->p);
+						ci = L->ci;
+						goto newframe; /* restart luaV_execute over new Lua function */
+					}
+				}
 				if (luaD_precall(L, ra, nresults))
 				{ /* C function? */
+					if (luaD_yielded(L))
+						return; /* it yielded without a long jump */
 					if (nresults >= 0)
 						L->top = ci->top; /* adjust results */
 					Protect((void)0);	  /* update 'base' */
@@ -1388,7 +1609,9 @@ newframe:						  /* reentry point when frame changes (call/return) */
 					L->top = ra + b; /* else previous instruction set top */
 				lua_assert(GETARG_C(i) - 1 == LUA_MULTRET);
 				if (luaD_precall(L, ra, LUA_MULTRET))
-				{					  /* C function? */
+				{ /* C function? */
+					if (luaD_yielded(L))
+						return;		  /* it yielded without a long jump */
 					Protect((void)0); /* update 'base' */
 				}
 				else
@@ -1418,6 +1641,7 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				vmbreak;
 			}
 			vmcase(OP_RETURN)
+			l_return:
 			{
 				int b = GETARG_B(i);
 				if (cl->p->sizep > 0)
@@ -1436,17 +1660,20 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				}
 			}
 			vmcase(OP_FORLOOP)
+			l_forloop:
 			{
 				if (ttisinteger(ra))
 				{ /* integer loop? */
 					lua_Integer step = ivalue(ra + 2);
 					lua_Integer idx = intop(+, ivalue(ra), step); /* increment index */
 					lua_Integer limit = ivalue(ra + 1);
+					quicken(OP_FORLOOPI);
 					if ((0 < step) ? (idx <= limit) : (limit <= idx))
 					{
 						ci->u.l.savedpc += GETARG_sBx(i); /* jump back */
 						chgivalue(ra, idx);				  /* update internal index... */
 						setivalue(ra + 3, idx);			  /* ...and external index */
+						jitloop();
 					}
 				}
 				else
@@ -1454,46 +1681,21 @@ newframe:						  /* reentry point when frame changes (call/return) */
 					lua_Number step = fltvalue(ra + 2);
 					lua_Number idx = luai_numadd(L, fltvalue(ra), step); /* inc. index */
 					lua_Number limit = fltvalue(ra + 1);
+					quicken(OP_FORLOOPF);
 					if (luai_numlt(0, step) ? luai_numle(idx, limit)
 											: luai_numle(limit, idx))
 					{
 						ci->u.l.savedpc += GETARG_sBx(i); /* jump back */
 						chgfltvalue(ra, idx);			  /* update internal index... */
 						setfltvalue(ra + 3, idx);		  /* ...and external index */
+						jitloop();
 					}
 				}
 				vmbreak;
 			}
 			vmcase(OP_FORPREP)
 			{
-				TValue *init = ra;
-				TValue *plimit = ra + 1;
-				TValue *pstep = ra + 2;
-				lua_Integer ilimit;
-				int stopnow;
-				if (ttisinteger(init) && ttisinteger(pstep) &&
-					forlimit(plimit, &ilimit, ivalue(pstep), &stopnow))
-				{
-					/* all values are integer */
-					lua_Integer initv = (stopnow ? 0 : ivalue(init));
-					setivalue(plimit, ilimit);
-					setivalue(init, intop(-, initv, ivalue(pstep)));
-				}
-				else
-				{ /* try making all values floats */
-					lua_Number ninit;
-					lua_Number nlimit;
-					lua_Number nstep;
-					if (!tonumber(plimit, &nlimit))
-						luaG_runerror(L, "'for' limit must be a number");
-					setfltvalue(plimit, nlimit);
-					if (!tonumber(pstep, &nstep))
-						luaG_runerror(L, "'for' step must be a number");
-					setfltvalue(pstep, nstep);
-					if (!tonumber(init, &ninit))
-						luaG_runerror(L, "'for' initial value must be a number");
-					setfltvalue(init, luai_numsub(L, ninit, nstep));
-				}
+				luaV_forprep(L, ra);
 				ci->u.l.savedpc += GETARG_sBx(i);
 				vmbreak;
 			}
@@ -1518,6 +1720,7 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				{									  /* continue loop? */
 					setobjs2s(L, ra, ra + 1);		  /* save control variable */
 					ci->u.l.savedpc += GETARG_sBx(i); /* jump back */
+					jitloop();
 				}
 				vmbreak;
 			}
@@ -1583,6 +1786,196 @@ newframe:						  /* reentry point when frame changes (call/return) */
 				lua_assert(0);
 				vmbreak;
 			}
+			vmcase(OP_ADDII)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc))
+				{
+					setivalue(ra, intop(+, ivalue(rb), ivalue(rc)));
+					vmbreak;
+				}
+				quicken(OP_ADD); /* types changed: back to generic form */
+				goto l_add;
+			}
+			vmcase(OP_ADDFF)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisfloat(rb) && ttisfloat(rc))
+				{
+					setfltvalue(ra, luai_numadd(L, fltvalue(rb), fltvalue(rc)));
+					vmbreak;
+				}
+				quicken(OP_ADD);
+				goto l_add;
+			}
+			vmcase(OP_SUBII)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc))
+				{
+					setivalue(ra, intop(-, ivalue(rb), ivalue(rc)));
+					vmbreak;
+				}
+				quicken(OP_SUB); /* types changed: back to generic form */
+				goto l_sub;
+			}
+			vmcase(OP_SUBFF)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisfloat(rb) && ttisfloat(rc))
+				{
+					setfltvalue(ra, luai_numsub(L, fltvalue(rb), fltvalue(rc)));
+					vmbreak;
+				}
+				quicken(OP_SUB);
+				goto l_sub;
+			}
+			vmcase(OP_MULII)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc))
+				{
+					setivalue(ra, intop(*, ivalue(rb), ivalue(rc)));
+					vmbreak;
+				}
+				quicken(OP_MUL); /* types changed: back to generic form */
+				goto l_mul;
+			}
+			vmcase(OP_MULFF)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisfloat(rb) && ttisfloat(rc))
+				{
+					setfltvalue(ra, luai_nummul(L, fltvalue(rb), fltvalue(rc)));
+					vmbreak;
+				}
+				quicken(OP_MUL);
+				goto l_mul;
+			}
+			vmcase(OP_LTII)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc))
+				{
+					if ((ivalue(rb) < ivalue(rc)) != GETARG_A(i))
+						ci->u.l.savedpc++;
+					else
+						donextjump(ci);
+					vmbreak;
+				}
+				quicken(OP_LT);
+				goto l_lt;
+			}
+			vmcase(OP_LTFF)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisfloat(rb) && ttisfloat(rc))
+				{
+					if (luai_numlt(fltvalue(rb), fltvalue(rc)) != GETARG_A(i))
+						ci->u.l.savedpc++;
+					else
+						donextjump(ci);
+					vmbreak;
+				}
+				quicken(OP_LT);
+				goto l_lt;
+			}
+			vmcase(OP_LEII)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc))
+				{
+					if ((ivalue(rb) <= ivalue(rc)) != GETARG_A(i))
+						ci->u.l.savedpc++;
+					else
+						donextjump(ci);
+					vmbreak;
+				}
+				quicken(OP_LE);
+				goto l_le;
+			}
+			vmcase(OP_LEFF)
+			{
+				TValue *rb = RKB(i);
+				TValue *rc = RKC(i);
+				if (ttisfloat(rb) && ttisfloat(rc))
+				{
+					if (luai_numle(fltvalue(rb), fltvalue(rc)) != GETARG_A(i))
+						ci->u.l.savedpc++;
+					else
+						donextjump(ci);
+					vmbreak;
+				}
+				quicken(OP_LE);
+				goto l_le;
+			}
+			vmcase(OP_FORLOOPI)
+			{
+				if (ttisinteger(ra))
+				{
+					lua_Integer step = ivalue(ra + 2);
+					lua_Integer idx = intop(+, ivalue(ra), step); /* increment index */
+					lua_Integer limit = ivalue(ra + 1);
+					if ((0 < step) ? (idx <= limit) : (limit <= idx))
+					{
+						ci->u.l.savedpc += GETARG_sBx(i); /* jump back */
+						chgivalue(ra, idx);				  /* update internal index... */
+						setivalue(ra + 3, idx);			  /* ...and external index */
+						jitloop();
+					}
+					vmbreak;
+				}
+				quicken(OP_FORLOOP);
+				goto l_forloop;
+			}
+			vmcase(OP_FORLOOPF)
+			{
+				if (ttisfloat(ra))
+				{
+					lua_Number step = fltvalue(ra + 2);
+					lua_Number idx = luai_numadd(L, fltvalue(ra), step); /* inc. index */
+					lua_Number limit = fltvalue(ra + 1);
+					if (luai_numlt(0, step) ? luai_numle(idx, limit)
+											: luai_numle(limit, idx))
+					{
+						ci->u.l.savedpc += GETARG_sBx(i); /* jump back */
+						chgfltvalue(ra, idx);			  /* update internal index... */
+						setfltvalue(ra + 3, idx);		  /* ...and external index */
+						jitloop();
+					}
+					vmbreak;
+				}
+				quicken(OP_FORLOOP);
+				goto l_forloop;
+			}
+			vmcase(OP_GETTABUPCALL)
+			{
+				TValue *upval = cl->upvals[GETARG_B(i)]->v;
+				TValue *rc = RKC(i);
+				gettableCached(L, upval, rc, ra);
+				fusenext(OP_CALL, l_call);
+			}
+			vmcase(OP_LOADKCALL)
+			{
+				TValue *rb = k + GETARG_Bx(i);
+				setobj2s(L, ra, rb);
+				fusenext(OP_CALL, l_call);
+			}
+			vmcase(OP_LOADKRETURN)
+			{
+				TValue *rb = k + GETARG_Bx(i);
+				setobj2s(L, ra, rb);
+				fusenext(OP_RETURN, l_return);
+			}
 		}
 	}
 }
@@ -37,6 +37,20 @@
 #endif
 
 
+/*
+** Use a "labels as values" jump table in 'luaV_execute' (see file
+** 'ljumptab.h') when the compiler supports it; otherwise, the
+** interpreter dispatches through a plain 'switch'.
+*/
+#if !defined(LUA_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define LUA_USE_JUMPTABLE	1
+#else
+#define LUA_USE_JUMPTABLE	0
+#endif
+#endif
+
+
 #define tonumber(o,n) \
 	(ttisfloat(o) ? (*(n) = fltvalue(o), 1) : luaV_tonumber_(o,n))
 
@@ -102,6 +116,7 @@ LUAI_FUNC void luaV_finishget (lua_State *L, const TValue *t, TValue *key,
                                StkId val, const TValue *slot);
 LUAI_FUNC void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
                                StkId val, const TValue *slot);
+LUAI_FUNC void luaV_forprep (lua_State *L, StkId ra);
 LUAI_FUNC void luaV_finishOp (lua_State *L);
 LUAI_FUNC void luaV_execute (lua_State *L);
 LUAI_FUNC void luaV_concat (lua_State *L, int total);
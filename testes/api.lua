@@ -946,6 +946,31 @@ assert(T.doremote(L1, "return a.x") == "1")
 
 T.closestate(L1)
 
+-- state with its own arena
+L1 = T.newstate(true)
+T.loadlib(L1)
+assert(T.doremote(L1, [[
+  local G = require"_G"; local string = require"string"
+  local t = {}
+  for i = 1, 20000 do
+    t[i] = {i, G.tostring(i), string.rep("x", i % 300)}   -- all size classes
+  end
+  for i = 1, 20000, 2 do t[i] = nil end
+  G.collectgarbage()
+  local s = 0
+  for i = 2, 20000, 2 do s = s + t[i][1] + #t[i][3] end
+  for i = 1, 1000 do t[i] = {} ; t[i][100] = i end   -- tables grow
+  for i = 1, 1000 do   -- arrays shrink into the arena
+    local u = t[i]
+    for j = 1, 64 do u[j] = j end
+    for j = 9, 64 do u[j] = nil end
+    u.x = i   -- rehash
+    G.assert(u[8] == 8 and u[9] == nil and u[100] == i and u.x == i)
+  end
+  return s
+]]) == "101495200")
+T.closestate(L1)
+
 L1 = nil
 
 print('+')
@@ -1161,6 +1186,22 @@ res1, res2, top = T.testC([[testudata -1 xuxu
 			    return 3]], y)
 assert(not res1 and not res2 and top == 4)
 
+-- external strings
+do
+  collectgarbage()
+  local freed = T.extstring()
+  local s = string.rep("abc", 100)
+  local e = T.extstring(s)
+  assert(e == s and #e == 300 and ({[s] = 1})[e] == 1)
+  assert(e .. "x" == s .. "x" and e < s .. "x")
+  assert(T.extstring(" 10 ") + 1 == 11)   -- short strings are copied...
+  assert(T.extstring() == freed + 1)     -- ...and released at once
+  assert(T.extstring(string.rep(" ", 100) .. "0x10") + 1 == 17)
+  e = nil; s = nil
+  collectgarbage()
+  assert(T.extstring() == freed + 3)
+end
+
 -- erase metatables
 do
   local r = debug.getregistry()
@@ -75,6 +75,47 @@ function a.b.c:f2 (x,y) self[x] = y end
 assert(a.b.c.f1(4) == 5)
 a.b.c:f2('k', 12); assert(a.b.c.k == 12)
 
+
+-- plain Lua-to-Lua calls (exact number of arguments, no vararg, no
+-- hooks) take a shorter path; check it against the general one
+do
+  local function add (x, y) return x + y end
+  local function va (...) return select('#', ...), ... end
+  local function deep (n, x)    -- reuses the 'CallInfo's of previous calls
+    if n == 0 then return x, debug.getinfo(1, "n").name end
+    local r, name = deep(n - 1, add(x, 1))
+    return r, name
+  end
+  for i = 1, 3 do
+    local r, name = deep(100 * i, 0)
+    assert(r == 100 * i and name == "deep")
+  end
+  assert(add(1, 2) == 3 and add(1, 2, 3) == 3)    -- extra argument
+  assert(not pcall(add, 1))                        -- missing argument
+  local n, a, b = va(1, 2)
+  assert(n == 2 and a == 1 and b == 2 and va() == 0)
+  local function big (a)     -- frame larger than the stack left
+    local t1, t2, t3, t4, t5, t6, t7, t8, t9, t10 = a, a, a, a, a, a, a, a, a, a
+    local s1, s2, s3, s4, s5, s6, s7, s8, s9, s10 = a, a, a, a, a, a, a, a, a, a
+    if a == 0 then return t10 + s10 end
+    return big(a - 1) + t1 + s1
+  end
+  assert(big(500) == 500 * 501)
+  local function none (x) end
+  local x, y = none(1)
+  assert(x == nil and y == nil)
+
+  -- with hooks on, calls go through the general path and are seen
+  local calls = 0
+  debug.sethook(function (e) calls = calls + 1 end, "c")
+  local r = deep(10, 0)
+  debug.sethook()
+  assert(r == 10 and calls >= 21)   -- 11 'deep' + 10 'add' (+ 'sethook')
+  calls = 0
+  r = deep(10, 0)
+  assert(r == 10 and calls == 0)
+end
+
 print('+')
 
 t = nil   -- 'declare' t
@@ -235,5 +235,225 @@ function (a) while a < 10 do a = a + 1 end end,
 function (a) while true do if not(a < 10) then break end; a = a + 1; end end
 )
 
+
+-- quickened (type-specialized) opcodes
+do
+  local function op (f, n)   -- opcode of 'n'-th instruction of 'f'
+    return string.match(T.listcode(f)[n], "%- (%u+)")
+  end
+  local function f (a, b) return a + b end
+  local function lt (a, b) if a < b then return 1 else return 0 end end
+  T.jit(f, false); T.jit(lt, false)   -- only the interpreter quickens
+  check(f, 'ADD', 'RETURN', 'RETURN')
+  assert(f(1, 2) == 3 and op(f, 1) == 'ADDII')
+  assert(math.type(f(1, 2)) == 'integer')
+  assert(f(1.5, 2.0) == 3.5 and op(f, 1) == 'ADDFF')
+  assert(f(1, 2) == 3 and op(f, 1) == 'ADDII')
+  assert(f(1, 2.5) == 3.5 and op(f, 1) == 'ADD')   -- mixed: stays generic
+  assert(f("10", 2) == 12 and op(f, 1) == 'ADD')
+  assert(f(math.maxinteger, 1) == math.mininteger)   -- wraps around
+  local mt = {__add = function (a, b) return "add" end}
+  assert(f(setmetatable({}, mt), 1) == "add" and op(f, 1) == 'ADD')
+  -- a quickened instruction is dumped in its generic form
+  assert(f(1, 2) == 3 and op(f, 1) == 'ADDII')
+  local f1 = load(string.dump(f))
+  assert(op(f1, 1) == 'ADD' and f1(2, 3) == 5)
+
+  assert(lt(1, 2) == 1 and op(lt, 1) == 'LTII')
+  assert(lt(2, 1) == 0 and lt(2.0, 1.0) == 0 and op(lt, 1) == 'LTFF')
+  assert(lt(0/0, 1.0) == 0 and lt(-math.huge, 0.0) == 1)
+  assert(lt("a", "b") == 1 and op(lt, 1) == 'LT')
+  assert(lt(1, 2.5) == 1 and lt(math.maxinteger, 2.0^63) == 1)
+  local function checkerror (msg, f, ...)
+    local s, err = pcall(f, ...)
+    assert(not s and string.find(err, msg))
+  end
+  assert(lt(1, 2) == 1 and op(lt, 1) == 'LTII')
+  checkerror("compare two table values", lt, {}, {})
+
+  local function loop (a, b, c)
+    local s = 0
+    for i = a, b, c do s = s + i end
+    return s
+  end
+  local n = 0
+  for _, l in ipairs(T.listcode(loop)) do
+    if string.find(l, "FORLOOP") then n = n + 1 end
+  end
+  assert(n == 1)
+  assert(loop(1, 10, 1) == 55 and loop(1, 2.5, 0.5) == 7.0)
+  assert(loop(10, 1, -1) == 55 and loop(1, 0, 1) == 0)
+  assert(math.type(loop(1, 3, 1)) == 'integer')
+end
+
+
+-- superinstructions
+do
+  local function op (f, n)   -- opcode of 'n'-th instruction of 'f'
+    return string.match(T.listcode(f)[n], "%- (%u+)")
+  end
+  local function count (f, o)   -- number of instructions 'o' in 'f'
+    local n = 0
+    for _, l in ipairs(T.listcode(f)) do
+      if string.find(l, "%- " .. o .. " ") then n = n + 1 end
+    end
+    return n
+  end
+  local function k () return "k" end
+  T.jit(k, false)   -- only the interpreter fuses instructions
+  check(k, 'LOADK', 'RETURN', 'RETURN')
+  assert(T.opstats(k)["LOADK RETURN"] == 1 and T.opstats(k).RETURN == 2)
+  assert(k() == "k" and op(k, 1) == 'LOADKRETURN' and k() == "k")
+  assert(T.opstats(k)["LOADK RETURN"] == 1)   -- counts generic forms
+  assert(op(load(string.dump(k)), 1) == 'LOADK')
+
+  -- (compiled from source: this file may run without debug information)
+  local g = load"XX = 0; XY(); print('x', XX)"
+  T.jit(g, false)
+  XY = function () XX = XX + 1 end
+  local print = print
+  _ENV.print = function (a, b) assert(a == "x"); XX = b end
+  assert(count(g, 'GETTABUPCALL') == 0)
+  g(); assert(XX == 1)
+  assert(count(g, 'GETTABUPCALL') == 2 and count(g, 'CALL') == 2)
+  g(); assert(XX == 1)
+  _ENV.print = print
+  -- debug information still sees the plain instructions
+  XY = nil
+  local st, msg = pcall(g)
+  assert(not st and string.find(msg, "global 'XY'"))
+  local c = load"local x = ...; local r = x('a'); return r"
+  T.jit(c, false)
+  assert(c(string.upper) == "A" and count(c, 'LOADKCALL') == 1)
+  st, msg = pcall(c, nil)
+  assert(not st and string.find(msg, "local 'x'"))
+  -- hooks see both instructions of a pair
+  local function trace (f)
+    local debug = require"debug"
+    local n = 0
+    debug.sethook(function () n = n + 1 end, "", 1)
+    f()
+    debug.sethook()
+    return n
+  end
+  XY = function () end
+  g = function () XY(); return "k" end
+  T.jit(g, false)
+  local n = trace(g)
+  assert(count(g, 'GETTABUPCALL') == 1 and count(g, 'LOADKRETURN') == 1)
+  assert(trace(g) == n)
+  XX = nil; XY = nil
+end
+
+
+-- compiled code (when the baseline compiler is available)
+if T.jit(function () end, true) then
+  local function twin (f)   -- compiled and interpreted versions of 'f'
+    local s = string.dump(f)
+    local c, i = load(s), load(s)
+    assert(T.jit(c, true) and not T.jit(i, false))
+    return c, i
+  end
+  local function same (f, ...)
+    local c, i = twin(f)
+    local r1 = table.pack(pcall(c, ...))
+    local r2 = table.pack(pcall(i, ...))
+    assert(r1.n == r2.n)
+    for j = 1, r1.n do
+      assert(r1[j] == r2[j] or r1[j] ~= r1[j] and r2[j] ~= r2[j])
+      assert(math.type(r1[j]) == math.type(r2[j]))
+    end
+    return table.unpack(r1, 1, r1.n)
+  end
+  local function arith (a, b, n)
+    local s, p = 0, 1
+    for i = 1, n do
+      s = s + a * i - b
+      if s < p then p = p - 1 elseif s <= b then p = p + 1 end
+      if s == p or not s then p = 0 end
+    end
+    return s, p, a + b, a - b, a * b, a / b, a // b, a % b, -a
+  end
+  same(arith, 3, 7, 10)
+  same(arith, 3.5, -7.25, 10)
+  same(arith, math.maxinteger, 1, 3)   -- wrap around
+  same(arith, "10", 2, 3)   -- string coercion
+  same(arith, 0/0, 1.0, 3)
+  same(arith, {}, 1, 3)   -- error
+  local mt = {__add = function (a, b) return 10 end,
+              __sub = function (a, b) return 1 end,
+              __mul = function (a, b) return a end,
+              __lt = function () return true end,
+              __le = function () return false end}
+  assert(not same(arith, setmetatable({}, mt), 1, 3))
+  local function loops (n, t)
+    local s = 0
+    for i = n, 1, -1 do s = s + i end
+    for i = 1, n, 0.5 do s = s + i end
+    for k, v in pairs(t) do s = s + v end
+    for i, v in ipairs(t) do s = s + i * v end
+    local x = n
+    while x > 0 do x = x - 3; if x == 2 then break end end
+    return s, x, #t, t.x, t[1], t[10], not t.x, ("a" .. n .. "b")
+  end
+  same(loops, 10, {1, 2, 3, x = 4})
+  same(loops, 10.5, {})
+  same(loops, "x", {})   -- error
+  local function calls (...)
+    local t = {...}
+    local a, b = select('#', ...), ...
+    local up = 0
+    local function f (x) up = up + x; return x, up end
+    for i = 1, 3 do
+      local c = f(i)
+      t[#t + 1] = function () return c + i end
+    end
+    return a, b, up, t[#t](), string.format("%d", up), f(f(2))
+  end
+  same(calls)
+  same(calls, 10, 20, 30)
+  local function index (new, n)   -- 'new' gives fresh tables for each run
+    local t, u = new()
+    for i = 1, n do t[i] = t[i] and i or "v" .. i; u[i] = t[i - 1] end
+    return t[1], t[n], t[n + 1], u[1], u[n], #u, t[0.5], t.x
+  end
+  same(index, function () return {}, {} end, 5)
+  same(index, function () return {1, 2, false, 4}, {nil, nil} end, 6)
+  same(index, function ()
+    return setmetatable({}, {__index = function (t, k) return k end}),
+           setmetatable({0, 0}, {__newindex = function () end})
+  end, 4)
+  same(index, function () return "abc", {} end, 2)   -- error
+
+  -- errors report the right place
+  local f = load"local t = ...; return t.x.y"
+  assert(T.jit(f, true))
+  local st, msg = pcall(f, {})
+  assert(not st and string.find(msg, "^%[string.-%]:1:.-field 'x'"))
+
+  -- hooks stop compiled loops
+  local function inf () local i = 0; while true do i = i + 1 end end
+  assert(T.jit(inf, true))
+  local debug = require"debug"
+  debug.sethook(function () error("stop") end, "", 1000)
+  st, msg = pcall(inf)
+  debug.sethook()
+  assert(not st and string.find(msg, "stop"))
+
+  -- yields inside compiled code
+  local lt = function (a, b) return coroutine.yield(a < b) end
+  local function cmp (a, b, n)
+    local c = 0
+    for i = 1, n do if a < b then c = c + i end end
+    return c
+  end
+  assert(T.jit(cmp, true))
+  local a = setmetatable({}, {__lt = function (x, y) return lt(1, 2) end})
+  local co = coroutine.wrap(cmp)
+  assert(co(a, a, 3) == true)
+  assert(co(true) == true and co(false) == true)
+  assert(co(true) == 4)
+end
+
 print 'OK'
 
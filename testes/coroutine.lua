@@ -177,6 +177,85 @@ do
 end
 
 
+-- yields straight from the coroutine's Lua code return to 'resume'
+-- without a long jump; yields inside 'pcall', metamethods, or with a
+-- C function as body mix both ways
+do
+  local mt = {__index = function (_, k) return coroutine.yield(k) end}
+  local co = coroutine.wrap(function ()
+    local t = setmetatable({}, mt)
+    for i = 1, 300 do   -- long enough for the loop to get compiled
+      local a = coroutine.yield(i)
+      local ok, b = pcall(coroutine.yield, -i)
+      local c = t[2 * i]
+      assert(a == i and ok and b == -i and c == 2 * i)
+    end
+    return "end"
+  end)
+  local v = co()
+  while v ~= "end" do v = co(v) end
+
+  co = coroutine.create(coroutine.yield)
+  local a, b, c = coroutine.resume(co, 1, 2)
+  assert(a and b == 1 and c == 2 and coroutine.status(co) == "suspended")
+  a, b, c = coroutine.resume(co, 3, 4)
+  assert(a and b == 3 and c == 4 and coroutine.status(co) == "dead")
+
+  co = coroutine.create(function (x)
+    x = coroutine.yield(x)
+    return coroutine.yield(x) .. error(x)
+  end)
+  assert(select(2, coroutine.resume(co, 10)) == 10)
+  assert(select(2, coroutine.resume(co, 20)) == 20)
+  a, b = coroutine.resume(co, "x")
+  assert(not a and b == 20 and coroutine.status(co) == "dead")
+end
+
+
+-- recycling coroutines
+do
+  local function body (x) return coroutine.yield(x) + 1 end
+  local co = coroutine.create(function ()
+    local x = 1
+    coroutine.yield(function () x = x + 1; return x end)
+  end)
+  local _, inc = coroutine.resume(co)
+  assert(coroutine.recycle(co, body) == co)
+  assert(inc() == 2 and inc() == 3)   -- its upvalue was closed
+  assert(coroutine.status(co) == "suspended")
+  assert(select(2, coroutine.resume(co, 5)) == 5)
+  assert(select(2, coroutine.resume(co, 5)) == 6)
+  assert(coroutine.status(co) == "dead")
+
+  co = coroutine.create(error)
+  assert(not coroutine.resume(co, "x"))
+  coroutine.recycle(co)
+  assert(coroutine.status(co) == "dead")
+  coroutine.recycle(co, body)
+  assert(select(2, coroutine.resume(co, 1)) == 1)
+
+  local a, b = pcall(coroutine.recycle, coroutine.running())
+  assert(not a and string.find(b, "running"))
+  co = coroutine.create(function (co)
+    return pcall(coroutine.recycle, co)
+  end)
+  a, b = coroutine.resume(coroutine.create(function ()
+    return select(3, coroutine.resume(co, coroutine.running()))
+  end))
+  assert(a and string.find(b, "normal"))
+
+  -- many short-lived coroutines, some with large stacks, reuse the
+  -- threads (and stacks) freed by the collector
+  local function deep (n) if n == 0 then return coroutine.yield(0) end
+    return 1 + deep(n - 1) end
+  for i = 1, 500 do
+    local co = coroutine.wrap(function (n) local t = {n}; return deep(n) end)
+    local n = i % 7 == 0 and 300 or i % 5
+    assert(co(n) == 0 and co(i) == i + n)
+  end
+end
+
+
 -- errors in coroutines
 function foo ()
   assert(debug.getinfo(1).currentline == debug.getinfo(foo).linedefined + 1)
@@ -101,6 +101,37 @@ while contCreate <= limit do
   contCreate = contCreate+1
 end
 
+if T then   -- string table grows incrementally, shrinks in a single pass
+  local t = {}
+  for i = 1, 5000 do t[i] = "s" .. i end
+  local size, nuse = T.querystr()
+  assert(size >= 5000 and nuse >= 5000)
+  for i = 1, 5000 do   -- strings are found while (and after) moving
+    assert(t[i] == "s" .. i and string.format("s%d", i) == t[i])
+  end
+  t = nil
+  for i = 1, 10 do
+    collectgarbage()
+    for i = 1, 1000 do a = "x" .. i end
+    if T.querystr() < size then break end
+  end
+  assert(T.querystr() < size)
+  a = "a"
+end
+
+if T then   -- API string cache and pinned strings
+  local hits = T.strcache()
+  for i = 1, 10 do require("string") end   -- looks up field '_LOADED'
+  assert(T.strcache() >= hits + 10)
+  local p = T.strcache(string.rep("p", 100))   -- new string is fixed
+  assert(p == string.rep("p", 100) and T.gccolor(p) == "grey")
+  T.strcache("pin" .. "ned" .. 1)   -- existing string is kept as a key
+  collectgarbage()
+  local snap = debug.heapsnapshot()
+  assert(string.find(snap, '"(pinned strings)"', 1, true))
+  assert(string.find(snap, '"value":"pinned1"', 1, true))
+end
+
 
 contCreate = 0
 
@@ -592,6 +623,361 @@ if T then
   assert(T.totalmem("thread") == t + 1)
 end
 
+-- a graph large enough to overflow the deques of parallel markers
+-- (the test build marks in parallel in all atomic phases), marked
+-- with and without helpers
+for _, n in ipairs(T and {4, 1} or {0}) do
+  print("large graph")
+  if T then assert(T.gcparallel(n) == 4) end
+  local keep = {}
+  local wk = setmetatable({}, {__mode = "k"})
+  local wv = setmetatable({}, {__mode = "v"})
+  for i = 1, 10000 do
+    local t = {i, tostring(i), function () return i end}
+    keep[i] = t
+    wk[t] = {t}     -- value refers to its key
+    wv[i] = (i % 2 == 0) and t or {}
+  end
+  local k1, k2 = {}, {}
+  wk[k1] = k2; wk[k2] = {}; keep.k = k1    -- chain through ephemerons
+  collectgarbage()
+  assert(wk[k1] == k2 and wk[k2])
+  local n = 0
+  for k in pairs(wk) do n = n + 1 end
+  assert(n == 10002)
+  for i = 1, 10000 do
+    local t = keep[i]
+    assert(t[1] == i and t[2] == tostring(i) and t[3]() == i and wk[t][1] == t)
+    assert(wv[i] == (i % 2 == 0 and t or nil))
+  end
+  if T then T.gcparallel(4) end
+end
+
+-- background freeing (only an embedder can turn it on)
+if T then
+  print("background freeing")
+  assert(T.bgfree(true) == false)
+  if T.bgfree(true) then   -- is it available?
+    local long = string.rep("x", 50)
+    local function garbage (n)   -- (no short strings, no buffer boxes)
+      for i = 1, n do local t = {i, {}, long .. i, function () end} end
+    end
+    garbage(1000)   -- warm up
+    local m
+    repeat   -- until the collector has nothing else to shrink
+      m = collectgarbage("count")
+      collectgarbage()
+    until collectgarbage("count") == m
+    local total, blocks = T.totalmem()
+    garbage(20000)
+    for i = 1, 50 do collectgarbage("step") end
+    collectgarbage()   -- waits for the freer
+    -- the freer really gave all that memory back to the allocator
+    local total1, blocks1 = T.totalmem()
+    assert(collectgarbage("count") <= m)
+    assert(total1 <= total and blocks1 <= blocks)
+    T.checkmemory()
+    assert(collectgarbage("generational") == "incremental")
+    garbage(20000)
+    collectgarbage("step")
+    collectgarbage()
+    assert(collectgarbage("incremental") == "generational")
+    garbage(1000)
+    assert(T.bgfree(false) == true)
+    garbage(1000)
+    collectgarbage()
+    T.checkmemory()
+  end
+  assert(T.bgfree(false) == false)
+end
+
+-- steps paced by time
+do
+  print("timed steps")
+  assert(collectgarbage("setsteptime", 1) == 0)
+  assert(collectgarbage("setmaxpause", 0) == 0)
+  local t = {}
+  for i = 1, 10000 do t[i] = {i} end
+  collectgarbage()
+  local c = collectgarbage("stats").cycles
+  local n = 0
+  repeat n = n + 1 until collectgarbage("step")   -- finish a cycle
+  assert(n > 10 and collectgarbage("stats").cycles == c + 1)   -- 1us each
+  collectgarbage("setsteptime", 10000000)
+  assert(collectgarbage("step"))   -- a large budget does a whole cycle
+  -- a step that has already used part of its budget leaves the atomic
+  -- phase to the next one when that phase would go over the limit
+  assert(collectgarbage("setmaxpause", 1) == 0)
+  local s0 = collectgarbage("stats")
+  if T then T.gctrace(true) end
+  assert(not collectgarbage("step"))   -- stops before the atomic phase
+  local s1 = collectgarbage("stats")
+  if T then assert(T.gctrace() == "01" and T.gcstate() == "atomic") end
+  assert(s1.cycles == s0.cycles and s1.phasetime.propagate > s0.phasetime.propagate)
+  for _, p in ipairs{"sweepallgc", "sweepfinobj", "sweeptobefnz",
+                     "sweepend", "callfin"} do
+    assert(s1.phasetime[p] == s0.phasetime[p])   -- not reached
+  end
+  if T then T.gctrace(true) end
+  assert(collectgarbage("step"))   -- starts with it and ends the cycle
+  local s2 = collectgarbage("stats")
+  if T then assert(T.gctrace() == "234567") end
+  assert(s2.cycles == s1.cycles + 1 and s2.maxatomic >= s1.maxatomic)
+  assert(collectgarbage("setsteptime", 200) == 10000000)
+  assert(collectgarbage("setmaxpause", 1000) == 1)
+  t = nil
+  local m = collectgarbage("count")
+  for i = 1, 100000 do local a = {} end   -- automatic steps keep up
+  assert(collectgarbage("count") < m + 3000)
+  assert(collectgarbage("setsteptime", 0) == 200)
+  assert(collectgarbage("setmaxpause", 0) == 1000)
+  assert(collectgarbage("setsteptime", -1) == 0)   -- negative means 0
+end
+
+-- statistics
+do
+  print("statistics")
+  collectgarbage()
+  local s0 = collectgarbage("stats")
+  local t = {}
+  for i = 1, 1000 do t[i] = {} end
+  t = nil
+  setmetatable({}, {__gc = function () end})
+  collectgarbage()
+  local s1 = collectgarbage("stats")
+  assert(s1.cycles > s0.cycles and s1.minors == s0.minors)
+  assert(s1.swept.table >= s0.swept.table + 1001)
+  assert(s1.marked.table > s0.marked.table)
+  assert(s1.freedbytes > s0.freedbytes)
+  assert(s1.finalizers > s0.finalizers)
+  assert(s1.maxatomic >= s0.maxatomic)
+  for _, p in ipairs{"propagate", "atomic", "sweepallgc", "sweepfinobj",
+                     "sweeptobefnz", "sweepend", "callfin", "pause"} do
+    assert(s1.phasetime[p] >= s0.phasetime[p])
+  end
+  if T then
+    T.gctrace(true)
+    collectgarbage()
+    assert(string.find(T.gctrace(), "01234567$"))   -- one phase after other
+    collectgarbage("generational")
+    T.gctrace(true)
+    local m = collectgarbage("stats").minors
+    collectgarbage("step")
+    local ph = T.gctrace()
+    assert(ph == "120" and collectgarbage("stats").minors == m + 1)
+    collectgarbage("incremental")
+  end
+end
+
+-- memory accounting
+do
+  print("memory accounting")
+  local function memdump ()
+    local d = {types = {}, pools = {}, sites = {}}
+    for l in string.gmatch(collectgarbage("memdump"), "[^\n]+") do
+      local kind, name, n1, n2 = string.match(l, "^(%a+)\t([^\t]+)\t?(%d*)\t?(%d*)$")
+      if kind == "rate" then d.rate = tonumber(name)
+      else
+        d[kind .. "s"][name] = {tonumber(n1), tonumber(n2)}
+      end
+    end
+    return d
+  end
+  collectgarbage()
+  assert(collectgarbage("memrate", 1000) == 0)
+  local line = debug.getinfo(1, "l").currentline + 2
+  local function alloc ()
+    local t = {}; for i = 1, 2000 do t[i] = {i} end; return t
+  end
+  local keep = alloc()
+  local d = memdump()
+  assert(d.rate == 1000 and d.types.table[1] > 2000)
+  assert(d.types.table[2] > 2000 * 56 and d.types.thread[1] >= 1)
+  local site = d.sites[debug.getinfo(1, "S").short_src .. ":" .. line]
+  assert(site[1] > 50 and site[2] == site[1] * 1000)
+  keep = nil
+  collectgarbage()
+  assert(memdump().types.table[1] < d.types.table[1] - 1900)
+  assert(collectgarbage("memrate", 0) == 1000)
+  d = memdump()
+  assert(d.rate == nil and next(d.sites) == nil)
+  assert(d.pools.thread[1] == 0)   -- a full collection emptied the pool
+  -- dead threads kept for reuse are reported apart from live ones
+  for i = 1, 10 do coroutine.wrap(function () end)() end
+  repeat until collectgarbage("step")   -- finish a cycle
+  d = memdump()
+  local n = d.pools.thread[1]
+  assert(n >= 1 and d.pools.thread[2] > n * 100)
+  assert(select(2, string.gsub(debug.heapsnapshot(), "%(thread pool%)", "")) == n)
+end
+
+-- heap snapshots
+do
+  print("heap snapshots")
+  local t = {10, "a\"b\n", x = {}, [true] = print, w = setmetatable({}, {__mode = "k"})}
+  t.w[t.x] = 1
+  local function f () return t end
+  local nodes, ids
+  local function snapshot ()
+    local s = debug.heapsnapshot()
+    nodes, ids = {}, {}
+    for l in string.gmatch(s, "[^\n]+") do
+      local oid, ty = string.match(l, '^{"id":"([^"]*)","type":"([^"]*)"')
+      local refs = {}
+      for rid, name in string.gmatch(l, '%["([^"]*)","([^"]*)"%]') do
+        refs[name] = rid
+      end
+      nodes[oid] = {type = ty, line = l, refs = refs}
+      local addr = string.match(l, '"addr":"([^"]*)"')
+      if addr then ids[addr] = oid end
+    end
+    return s
+  end
+  local function id (o) return ids[string.match(tostring(o), ": (.*)")] end
+  local s = snapshot()
+  assert(string.find(s, '^{"id":"root"') and nodes.root.refs["(registry)"])
+  local n = nodes[id(t)]
+  assert(n.type == "table" and n.refs.x == id(t.x) and n.refs.w == id(t.w))
+  assert(nodes[n.refs["[2]"]].type == "string" and
+         string.find(nodes[n.refs["[2]"]].line,
+                     '"value":"a\\u0022b\\u000a"', 1, true))
+  n = nodes[id(t.w)]
+  assert(string.find(n.line, '"weak":"k"') and n.refs["(key)"] == id(t.x))
+  n = nodes[id(f)]
+  assert(n.type == "function" and n.refs.t == id(t))
+  assert(nodes[n.refs["(proto)"]].type == "proto")
+  assert(f() == t)
+  -- ids do not change between snapshots and are never reused
+  local old = {id(t), id(t.x), id(f)}
+  local oldnodes = nodes
+  t.x = nil; t.w = nil; collectgarbage()
+  for i = 1, 100 do t[i + 2] = {} end
+  snapshot()
+  assert(id(t) == old[1] and id(f) == old[3] and not nodes[old[2]])
+  for i = 1, 100 do assert(not oldnodes[id(t[i + 2])]) end
+  if T then   -- an error in the writer leaves the collector running
+    T.totalmem(T.totalmem() + 10 * 1024)   -- no room for the snapshot
+    local st, msg = pcall(debug.heapsnapshot)
+    T.totalmem(0)
+    assert(not st and string.find(msg, "not enough memory"))
+    assert(collectgarbage("isrunning"))
+  end
+end
+
+-- memory limits (set by the host)
+if T then
+  print("memory limits")
+  collectgarbage()
+  local base = math.floor(collectgarbage("count"))
+  local oldpause = collectgarbage("setpause", 10000)
+  T.memlimits(0)
+  -- crossing the soft limit starts collecting, even with a long pause
+  local stats = collectgarbage("stats")
+  assert(T.gclimit("soft", base + 500) == 0)
+  for i = 1, 200 do local s = string.rep("x", 10000) .. i end
+  assert(collectgarbage("count") < base + 1500)
+  assert(collectgarbage("stats").cycles > stats.cycles)
+  assert(T.gclimit("soft", 0) == base + 500)
+  -- the hard limit collects garbage before failing an allocation
+  assert(T.gclimit("hard", base + 1000) == 0)
+  for i = 1, 200 do local s = string.rep("x", 10000) .. i end
+  local t = {}
+  local st, msg = pcall(function ()
+    for i = 1, math.huge do t[i] = string.rep("x", 1000) .. i end
+  end)
+  assert(not st and msg == "not enough memory" and #t > 500)
+  assert(collectgarbage("count") < base + 1000)
+  t = nil
+  local soft, hard = T.memlimits()
+  assert(soft >= 1 and hard >= 1)
+  -- the limit function can raise the limit
+  T.memlimits(1000)
+  local s = string.rep("x", 1500 * 1024)
+  soft, hard = T.memlimits()
+  assert(hard == 1 and #s == 1500 * 1024)
+  assert(T.gclimit("hard", 0) > base + 1000)
+  collectgarbage("setpause", oldpause)
+  collectgarbage()
+end
+
+-- generational mode
+do
+  print("generational mode")
+  assert(collectgarbage("generational") == "incremental")
+  assert(collectgarbage("generational") == "generational")
+  local minor = collectgarbage("setminormul", 20)
+  local major = collectgarbage("setmajormul", 100)
+  assert(minor == 20 and major == 100)
+
+  -- young objects stored in old ones must survive minor collections
+  local t = {}
+  local u = setmetatable({}, {})
+  local co = coroutine.create(function (x)
+    local y = {x}
+    coroutine.yield()
+    return y[1][1]
+  end)
+  collectgarbage()   -- a major collection: everything is old now
+  for i = 1, 100 do t[i] = {i} end   -- backward barrier
+  getmetatable(u).__index = function () return 10 end
+  setmetatable(u, {__index = getmetatable(u).__index})  -- forward barrier
+  assert(coroutine.resume(co, {20}))   -- young objects in an old thread
+  assert(collectgarbage("step") == true)   -- each step is a collection
+  collectgarbage("step")
+  for i = 1, 100 do assert(t[i][1] == i) end
+  assert(u.x == 10)
+  assert(select(2, coroutine.resume(co)) == 20)
+
+  -- young garbage goes in a minor collection; old garbage only in a
+  -- major one
+  local w = setmetatable({}, {__mode = "v"})
+  collectgarbage()
+  w[1] = {}
+  collectgarbage("step")
+  assert(w[1] == nil)
+  local x = {}
+  w[1] = x
+  collectgarbage("step")   -- 'x' survives, so it is old now
+  x = nil
+  collectgarbage("step")
+  assert(w[1] ~= nil)
+  collectgarbage()
+  assert(w[1] == nil)
+
+  -- ephemerons
+  local e = setmetatable({}, {__mode = "k"})
+  collectgarbage()
+  local k = {}
+  e[k] = {k}
+  collectgarbage("step")
+  assert(e[k][1] == k)
+  e[{}] = {}   -- young key
+  collectgarbage("step")
+  assert(next(e) == k and next(e, k) == nil)
+  k = nil
+  collectgarbage()
+  assert(next(e) == nil)
+
+  -- finalizers
+  local finished = false
+  setmetatable({}, {__gc = function (o) finished = true; t[1] = o end})
+  collectgarbage("step")
+  assert(finished and t[1])
+  t[1] = nil
+
+  -- the collector runs by itself
+  finished = false
+  setmetatable({}, {__gc = function () finished = true end})
+  repeat local a = {{}, {}} until finished
+  if T then T.checkmemory() end
+
+  assert(collectgarbage("incremental") == "generational")
+  assert(collectgarbage("incremental") == "incremental")
+  collectgarbage()
+  if T then T.checkmemory() end
+end
+
+
 -- create an object to be collected when state is closed
 do
   local setmetatable,assert,type,print,getmetatable =
@@ -57,6 +57,45 @@ local function mp2 (n)   -- minimum power of 2 >= n
   return mp
 end
 
+-- size of a hash part holding 'n' keys: open addressing ('T.swisshash')
+-- keeps 1/8 of the nodes of large parts empty
+local function hsize (n)
+  local mp = mp2(n)
+  if T.swisshash and mp >= 16 and n > mp - mp/8 then mp = mp * 2 end
+  return mp
+end
+
+-- sizes (array and hash parts) of a table filled with keys 'n', 'n - 1',
+-- ..., 1: with open addressing, the hash part rehashes before it is
+-- full, so the last rehash may come before the array part could take
+-- all keys
+local function revsizes (n)
+  local na, nh, inhash = 0, 0, 0
+  local function room (size)   -- keys that a hash part of 'size' takes
+    if T.swisshash and size >= 16 then return size - size // 8 end
+    return size
+  end
+  for k = n, 1, -1 do
+    if k > na then
+      if inhash == room(nh) then   -- rehash: keys are k..n
+        local total, a = n - k + 1, 0
+        local twotoi = 1
+        na = 0
+        while total > twotoi // 2 do   -- see 'computesizes'
+          local c = math.max(0, math.min(twotoi, n) - k + 1)  -- keys <= 2^i
+          if c > twotoi // 2 then na, a = twotoi, c end
+          twotoi = twotoi * 2
+        end
+        inhash = total - a
+        nh = inhash == 0 and 0 or hsize(inhash)
+      else
+        inhash = inhash + 1
+      end
+    end
+  end
+  return na, nh
+end
+
 local function fb (n)
   local r, nn = T.int2fb(n)
   assert(r < 256)
@@ -90,7 +129,7 @@ end
 do
   local s = 0
   for _ in pairs(math) do s = s + 1 end
-  check(math, 0, mp2(s))
+  check(math, 0, hsize(s))
 end
 
 
@@ -103,7 +142,7 @@ for i=1,lim do
   for k=0,lim do 
     local t = load(s..'}', '')()
     assert(#t == i)
-    check(t, fb(i), mp2(k))
+    check(t, fb(i), hsize(k))
     s = string.format('%sa%d=%d,', s, k, k)
   end
 end
@@ -138,7 +177,7 @@ a = {}
 for i = 1,lim do
   a['a'..i] = 1
   assert(#a == 0)
-  check(a, 0, mp2(i))
+  check(a, 0, hsize(i))
 end
 
 a = {}
@@ -160,7 +199,11 @@ end
 for i=1,lim do
   local a = {}
   for i=i,1,-1 do a[i] = i end   -- fill in reverse
-  check(a, mp2(i), 0)
+  if not T.swisshash then
+    check(a, mp2(i), 0)
+  else
+    check(a, revsizes(i))
+  end
 end
 
 -- size tests for vararg
@@ -177,6 +220,116 @@ end
 local a = {}
 for i=1,lim do a[i] = true; foo(i, table.unpack(a)) end
 
+
+-- record tables (constructors with only named fields) use shapes
+do
+  local function nkeys (t) return select(4, T.querytab(t)) end
+  local function mk (x, y) return {x = x, y = y} end
+  local a, b = mk(1, 2), mk(3, 4)
+  check(a, 0, 0); assert(nkeys(a) == 2 and a.x == 1 and b.y == 4)
+  a.z = 10; b.w = 20   -- grow, taking different paths
+  assert(nkeys(a) == 3 and nkeys(b) == 3)
+  assert(a.z == 10 and a.w == nil and b.w == 20 and b.z == nil)
+  a.x = nil   -- removing a field keeps the shape
+  assert(nkeys(a) == 3 and a.x == nil)
+  local s = {}
+  for k, v in pairs(a) do s[#s + 1] = k .. "=" .. v end
+  table.sort(s); assert(table.concat(s, ",") == "y=2,z=10")
+  a.x = 5
+  assert(next(a) == "x" and next(a, "x") == "y" and next(a, "z") == nil)
+  checkerror("invalid key", next, a, "w")
+  a[1] = 10   -- non-string key: back to the hash part
+  assert(nkeys(a) == nil and a[1] == 10 and a.x == 5 and a.z == 10)
+  check(a, 0, 4)
+  b[1.5] = 1; assert(nkeys(b) == nil and b.y == 4 and b.w == 20)
+  local r = {x = 1}
+  for i = 1, 20 do r["k" .. i] = i end   -- too many keys
+  assert(nkeys(r) == nil and r.x == 1 and r.k20 == 20)
+  local long = string.rep("a", 50)
+  r = {x = 1}; r[long] = 2   -- long-string key
+  assert(nkeys(r) == nil and r[long] == 2 and r.x == 1)
+  r = {x = 1}; table.insert(r, 1)   -- array part
+  assert(nkeys(r) == nil and r[1] == 1 and r.x == 1)
+  r = {x = 1, y = 2}; r.y = nil; r.y = 3; assert(nkeys(r) == 2)
+  -- same field from tables with different layouts at the same site
+  local function getx (t) return t.x end
+  local u = {}; u.x = 7
+  for i = 1, 5 do
+    assert(getx(mk(i, 0)) == i and getx({y = 0, x = i}) == i)
+    assert(getx(u) == 7 and getx({}) == nil and getx({y = 1}) == nil)
+  end
+  -- shapes in weak tables
+  local w = setmetatable({x = {}, y = 1}, {__mode = "v"})
+  local k = setmetatable({x = {}, y = {}}, {__mode = "k"})
+  collectgarbage()
+  assert(w.x == nil and w.y == 1 and type(k.x) == "table")
+  assert(nkeys(w) == 2 and nkeys(k) == 2)
+  -- many tables sharing and releasing shapes
+  local l = {}
+  for i = 1, 100 do l[i] = {a = i, b = i}; l[i]["c" .. i % 7] = i end
+  collectgarbage()
+  for i = 1, 100 do assert(l[i].a == i and l[i]["c" .. i % 7] == i) end
+  l = nil; collectgarbage()
+end
+
+
+-- large hash parts grow incrementally (tests use a small threshold)
+do
+  local function moving (t) return select(5, T.querytab(t)) end
+  local function key (i) return (i % 3 == 0) and "k" .. i or -i - 0.5 end
+  local a = {}
+  local n = 0
+  repeat n = n + 1; a[key(n)] = n until moving(a)
+  local _, h = T.querytab(a)
+  assert(h >= 512 and moving(a) > 0)
+  a[key(1)] = nil; a[key(3)] = nil   -- remove some entries
+  local seen = 0
+  for k, v in pairs(a) do   -- old entries come after the new ones
+    assert(k == key(v) and a[k] == v)
+    a[k] = v * 2   -- assign existing fields (in both parts)
+    seen = seen + 1
+  end
+  assert(seen == n - 2 and moving(a))
+  for i = 4, n do assert(a[key(i)] == 2 * i) end
+  while moving(a) do n = n + 1; a[key(n)] = n end   -- finish it
+  assert(a[key(1)] == nil and a[key(3)] == nil and a[key(4)] == 8)
+  assert(a[key(n)] == n and next(a, key(n)) ~= key(n))
+  -- weak tables while growing
+  local keep = {}
+  local w = setmetatable({}, {__mode = "k"})
+  repeat
+    local k = {}
+    keep[#keep + 1] = k; w[k] = #keep; w[{}] = 0
+  until moving(w)
+  collectgarbage()
+  for i = 1, #keep do assert(w[keep[i]] == i) end
+  seen = 0
+  for k, v in pairs(w) do assert(keep[v] == k); seen = seen + 1 end
+  assert(seen == #keep)
+  -- resizing a growing table takes its old entries too
+  a = {}
+  n = 0
+  repeat n = n + 1; a["x" .. n] = n until moving(a)
+  table.move({1, 2, 3}, 1, 3, 1, a)   -- array part may resize
+  for i = 1, n do assert(a["x" .. i] == i) end
+  assert(a[3] == 3)
+  -- a part full of dead keys does not grow
+  a = {}
+  for i = 1, 1000 do a["y" .. i] = i end
+  for i = 1, 1000 do a["y" .. i] = nil end
+  local _, h0 = T.querytab(a)
+  for i = 1, 20000 do a["z" .. i] = i; a["z" .. i] = nil end
+  local _, h = T.querytab(a)
+  assert(h <= h0 and not moving(a) and next(a) == nil)
+  -- integer keys still move to the array part
+  a = {}
+  for i = 1, 1000 do a["w" .. i] = i end
+  for i = 1, 2000 do a[i] = i end
+  local asize = T.querytab(a)
+  assert(asize >= 1000)
+  for i = 1, 2000 do assert(a[i] == i) end
+end
+
 end  --]
 
 
@@ -628,4 +781,40 @@ for k,v in ipairs(a) do
 end
 assert(i == a.n)
 
+
+do   -- field accesses through inline caches
+  local function getx (t) return t.x end
+  local function callm (t) return t:m() end
+  local objs = {}
+  for i = 1, 20 do
+    local t = {x = i, m = function () return -i end}
+    for j = 1, i do t["k" .. j] = j end   -- different sizes and layouts
+    objs[i] = t
+  end
+  for round = 1, 3 do
+    for i = 1, #objs do
+      assert(getx(objs[i]) == i and callm(objs[i]) == -i)
+    end
+  end
+  local t = objs[5]
+  for j = 1, 100 do t["n" .. j] = j end   -- rehash moves 'x'
+  assert(getx(t) == 5 and callm(t) == -5)
+  t.x = nil; t.m = nil   -- cached slots now hold nil...
+  setmetatable(t, {__index = {x = "mt", m = function () return "m" end}})
+  assert(getx(t) == "mt" and callm(t) == "m")   -- ...so check __index
+  for j = 1, 100 do t["n" .. j] = nil end
+  for j = 1, 200 do t[-j] = j end   -- rehash drops dead keys
+  t.x = 0
+  assert(getx(t) == 0 and callm(t) == "m")
+  assert(getx({}) == nil and getx(setmetatable({}, {__index = t})) == 0)
+  X = 10
+  local function getg () return X end
+  assert(getg() == 10)
+  for j = 1, 100 do _G["Xglobal" .. j] = j end
+  assert(getg() == 10)
+  for j = 1, 100 do _G["Xglobal" .. j] = nil end
+  X = nil
+  assert(getg() == nil)
+end
+
 print"OK"
@@ -366,6 +366,27 @@ if not _port then
 end
 
 
+-- appending to long strings (which may share buffers)
+do
+  local s = string.rep("x", 2000)
+  for i = 1, 100 do s = s .. i .. ";" end
+  local t = s
+  s = s .. "a"
+  local u = t .. "b"    -- 't' is no longer the longest in its buffer
+  assert(#s == #t + 1 and s:sub(1, -2) == t and u == t .. "b")
+  assert(s:sub(-1) == "a" and u:sub(-1) == "b" and t:sub(-1) == ";")
+  assert(t < s and t < u and s < u and t ~= s)
+  local a = {[t] = 1}
+  assert(a[u:sub(1, -2)] == 1 and a[s] == nil)
+  -- conversions see only the string, not what follows it in the buffer
+  local n = string.rep(" ", 2000) .. "10"
+  local m = n .. "  "
+  local k = n .. "x"
+  assert(n + 1 == 11 and m + 1 == 11 and tonumber(k) == nil)
+  assert(#n == 2002 and string.format("%s", n):sub(-3) == " 10")
+end
+
+
 -- bug in Lua 5.3.2
 -- 'gmatch' iterator does not work across coroutines
 do